@@ -46,7 +46,7 @@ extern "C" {
 
 /* the maximum number of supported AT clients */
 #ifndef AT_CLIENT_NUM_MAX
-#define AT_CLIENT_NUM_MAX              1
+#define AT_CLIENT_NUM_MAX              2
 #endif
 
 #define AT_CMD_EXPORT(_name_, _args_expr_, _test_, _query_, _setup_, _exec_)   \
@@ -172,6 +172,13 @@ struct at_client
     rt_size_t recv_line_len;
     /* The maximum supported receive data length */
     rt_size_t recv_bufsz;
+
+    /* the current send command buffer */
+    char *send_buf;
+    /* The maximum supported send cmd length */
+    rt_size_t send_bufsz;
+    /* The length of last cmd */
+    rt_size_t last_cmd_len;
 #if 0
     rt_sem_t rx_notice;
 #endif
@@ -230,6 +237,7 @@ int at_obj_set_urc_table(at_client_t client, const struct at_urc * table, rt_siz
 
 /* AT client send commands to AT server and waiter response */
 int at_obj_exec_cmd(at_client_t client, at_response_t resp, const char *cmd_expr, ...);
+int at_obj_exec_raw_cmd(at_client_t client, at_response_t resp, const char *cmd, rt_size_t cmd_size);
 
 /* AT response object create and delete */
 at_response_t at_create_resp(rt_size_t buf_size, rt_size_t line_num, rt_int32_t timeout);
@@ -250,6 +258,7 @@ int at_resp_parse_line_args_by_kw(at_response_t resp, const char *keyword, const
  */
 
 #define at_exec_cmd(resp, ...)                   at_obj_exec_cmd(at_client_get_first(), resp, __VA_ARGS__)
+#define at_exec_raw_cmd(resp, cmd, size)         at_obj_exec_raw_cmd(at_client_get_first(), resp, cmd, size)
 #define at_client_wait_connect(timeout)          at_client_obj_wait_connect(at_client_get_first(), timeout)
 #define at_client_send(buf, size)                at_client_obj_send(at_client_get_first(), buf, size)
 #define at_client_recv(buf, size, timeout)       at_client_obj_recv(at_client_get_first(), buf, size, timeout)
@@ -31,9 +31,8 @@ extern rt_size_t at_utils_send(rt_device_t dev,
                                rt_off_t pos,
                                const void *buffer,
                                rt_size_t size);
-extern rt_size_t at_vprintfln(rt_device_t device, const char *format, va_list args);
+extern rt_size_t at_vprintfln(rt_device_t device, char *send_buf, rt_size_t buf_size, const char *format, va_list args);
 extern void at_print_raw_cmd(const char *type, const char *cmd, rt_size_t size);
-extern const char *at_get_last_cmd(rt_size_t *cmd_size);
 
 /**
  * Create response object.
@@ -272,28 +271,9 @@ int at_resp_parse_line_args_by_kw(at_response_t resp, const char *keyword, const
     return resp_args_num;
 }
 
-/**
- * Send commands to AT server and wait response.
- *
- * @param client current AT client object
- * @param resp AT response object, using RT_NULL when you don't care response
- * @param cmd_expr AT commands expression
- *
- * @return 0 : success
- *        -1 : response status error
- *        -2 : wait timeout
- *        -7 : enter AT CLI mode
- * result = at_exec_cmd(resp, "AT+CIFSR");
- */
-int at_obj_exec_cmd(at_client_t client, at_response_t resp, const char *cmd_expr, ...)
+/* lock the client and reset the response object before sending a command */
+static int at_obj_exec_prepare(at_client_t client, at_response_t resp)
 {
-    va_list args;
-    rt_size_t cmd_size = 0;
-    rt_err_t result = RT_EOK;
-    const char *cmd = RT_NULL;
-
-    RT_ASSERT(cmd_expr);
-
     if (client == RT_NULL)
     {
         LOG_E("input AT Client object is NULL, please create or get AT Client object!");
@@ -319,15 +299,18 @@ int at_obj_exec_cmd(at_client_t client, at_response_t resp, const char *cmd_expr
     client->resp = resp;
     rt_sem_control(client->resp_notice, RT_IPC_CMD_RESET, RT_NULL);
 
-    va_start(args, cmd_expr);
-    at_vprintfln(client->device, cmd_expr, args);
-    va_end(args);
+    return RT_EOK;
+}
+
+/* wait the response of the sent command and unlock the client */
+static int at_obj_exec_wait(at_client_t client, at_response_t resp, const char *cmd, rt_size_t cmd_size)
+{
+    rt_err_t result = RT_EOK;
 
     if (resp != RT_NULL)
     {
         if (rt_sem_take(client->resp_notice, resp->timeout) != RT_EOK)
         {
-            cmd = at_get_last_cmd(&cmd_size);
             LOG_W("execute command (%.*s) timeout (%d ticks)!", cmd_size, cmd, resp->timeout);
             client->resp_status = AT_RESP_TIMEOUT;
             result = -RT_ETIMEOUT;
@@ -335,7 +318,6 @@ int at_obj_exec_cmd(at_client_t client, at_response_t resp, const char *cmd_expr
         }
         if (client->resp_status != AT_RESP_OK)
         {
-            cmd = at_get_last_cmd(&cmd_size);
             LOG_E("execute command (%.*s) failed!", cmd_size, cmd);
             result = -RT_ERROR;
             goto __exit;
@@ -350,6 +332,85 @@ __exit:
     return result;
 }
 
+/**
+ * Send commands to AT server and wait response.
+ *
+ * @param client current AT client object
+ * @param resp AT response object, using RT_NULL when you don't care response
+ * @param cmd_expr AT commands expression
+ *
+ * @return 0 : success
+ *        -1 : response status error
+ *        -2 : wait timeout
+ *        -7 : enter AT CLI mode
+ * result = at_exec_cmd(resp, "AT+CIFSR");
+ */
+int at_obj_exec_cmd(at_client_t client, at_response_t resp, const char *cmd_expr, ...)
+{
+    va_list args;
+    rt_err_t result = RT_EOK;
+
+    RT_ASSERT(cmd_expr);
+
+    result = at_obj_exec_prepare(client, resp);
+    if (result != RT_EOK)
+    {
+        return result;
+    }
+
+    va_start(args, cmd_expr);
+    client->last_cmd_len = at_vprintfln(client->device, client->send_buf, client->send_bufsz, cmd_expr, args);
+    va_end(args);
+
+    /* the end sign is not a part of the command in log */
+    client->last_cmd_len -= 2;
+
+    return at_obj_exec_wait(client, resp, client->send_buf, client->last_cmd_len);
+}
+
+/**
+ * Send a pre-encoded command to AT server and wait response.
+ * The command is written to the device as it is, no format and no end sign is appended,
+ * so it is suitable for constant commands which are encoded at compile time.
+ *
+ * @param client current AT client object
+ * @param resp AT response object, using RT_NULL when you don't care response
+ * @param cmd AT command buffer, including the end sign(eg: \r\n)
+ * @param cmd_size AT command buffer size
+ *
+ * @return 0 : success
+ *        -1 : response status error
+ *        -2 : wait timeout
+ *        -7 : enter AT CLI mode
+ * result = at_exec_raw_cmd(resp, "AT+CIFSR\r\n", sizeof("AT+CIFSR\r\n") - 1);
+ */
+int at_obj_exec_raw_cmd(at_client_t client, at_response_t resp, const char *cmd, rt_size_t cmd_size)
+{
+    rt_err_t result = RT_EOK;
+
+    RT_ASSERT(cmd);
+
+    result = at_obj_exec_prepare(client, resp);
+    if (result != RT_EOK)
+    {
+        return result;
+    }
+
+#ifdef AT_PRINT_RAW_CMD
+    at_print_raw_cmd("sendline", cmd, cmd_size);
+#endif
+
+    at_utils_send(client->device, 0, cmd, cmd_size);
+
+    /* the end sign is not a part of the command in log */
+    if ((cmd_size >= 2) && (rt_memcmp(cmd + cmd_size - 2, AT_END_CR_LF, 2) == 0))
+    {
+        cmd_size -= 2;
+    }
+
+    return at_obj_exec_wait(client, resp, cmd, cmd_size);
+}
+
 /**
  * Waiting for connection to external devices.
  *
@@ -825,6 +886,16 @@ static int at_client_para_init(at_client_t client)
         goto __exit;
     }
 
+    client->last_cmd_len = 0;
+    client->send_bufsz = AT_CMD_MAX_LEN;
+    client->send_buf = (char *)rt_calloc(1, client->send_bufsz);
+    if (client->send_buf == RT_NULL)
+    {
+        LOG_E("AT client initialize failed! No memory for send buffer.");
+        result = -RT_ENOMEM;
+        goto __exit;
+    }
+
     rt_snprintf(name, RT_NAME_MAX, "%s%d", AT_CLIENT_LOCK_NAME, at_client_num);
     client->lock = rt_mutex_create(name, RT_IPC_FLAG_PRIO);
     if (client->lock == RT_NULL)
@@ -902,6 +973,11 @@ __exit:
             rt_free(client->recv_line_buf);
         }
 
+        if (client->send_buf)
+        {
+            rt_free(client->send_buf);
+        }
+
         rt_memset(client, 0x00, sizeof(struct at_client));
     }
     else
@@ -14,9 +14,6 @@
 #include <stdio.h>
 #include "at_adapter.h"
 
-static char send_buf[AT_CMD_MAX_LEN];
-static rt_size_t last_cmd_len = 0;
-
 /**
  * dump hex format data to console device
  *
@@ -62,12 +59,6 @@ void at_print_raw_cmd(const char *name, const char *buf, rt_size_t size)
 }
 
 
-const char *at_get_last_cmd(rt_size_t *cmd_size)
-{
-    *cmd_size = last_cmd_len;
-    return send_buf;
-}
-
 RT_WEAK rt_size_t at_utils_send(rt_device_t dev,
                                 rt_off_t    pos,
                                 const void *buffer,
@@ -76,27 +67,29 @@ RT_WEAK rt_size_t at_utils_send(rt_device_t dev,
     return com_write(dev, buffer, size);
 }
 
-rt_size_t at_vprintf(rt_device_t device, const char *format, va_list args)
+rt_size_t at_vprintf(rt_device_t device, char *send_buf, rt_size_t buf_size, const char *format, va_list args)
 {
-    last_cmd_len = vsnprintf(send_buf, sizeof(send_buf), format, args);
+    rt_size_t len = vsnprintf(send_buf, buf_size, format, args);
+    if(len > buf_size - 1)
+        len = buf_size - 1;
 
 #ifdef AT_PRINT_RAW_CMD
-    at_print_raw_cmd("sendline", send_buf, last_cmd_len);
+    at_print_raw_cmd("sendline", send_buf, len);
 #endif
 
-    return com_write(device, (unsigned char *)send_buf, last_cmd_len);
+    return com_write(device, (unsigned char *)send_buf, len);
 }
 
-rt_size_t at_vprintfln(rt_device_t device, const char *format, va_list args)
+rt_size_t at_vprintfln(rt_device_t device, char *send_buf, rt_size_t buf_size, const char *format, va_list args)
 {
     rt_size_t len = 0;
 
-    last_cmd_len = vsnprintf(send_buf, sizeof(send_buf) - 2, format, args);
-    if(last_cmd_len > sizeof(send_buf) - 2)
-        last_cmd_len = sizeof(send_buf) - 2;
-    rt_memcpy(send_buf + last_cmd_len, "\r\n", 2);
+    len = vsnprintf(send_buf, buf_size - 2, format, args);
+    if(len > buf_size - 2)
+        len = buf_size - 2;
+    rt_memcpy(send_buf + len, "\r\n", 2);
 
-    len = last_cmd_len + 2;
+    len = len + 2;
 
 #ifdef AT_PRINT_RAW_CMD
     at_print_raw_cmd("sendline", send_buf, len);
@@ -8,50 +8,62 @@
 #include <sys/errno.h>
 #include <sys/unistd.h>
 #include <sys/select.h>
+#include <stdio.h>
 
 #define AT_UART             UART_NUM_1
 #define AT_UART_RX_BUF_SIZE (1024)
 #define AT_UART_BAUD_RATE   (115200)
 #define AT_UART_TX_PIN      (GPIO_NUM_23)
 #define AT_UART_RX_PIN      (GPIO_NUM_22)
+/* 接收FIFO达到该字节数时拉高RTS */
+#define AT_UART_RTS_THRESH  (100)
 
 typedef struct
 {
     int fd;
+    char name[8];
+    at_uart_cfg_t cfg;
 } at_uart_drv_t;
 
 static const char *TAG = "at_uart_drv";
-static at_uart_drv_t at_uart_drv = {-1};
+static at_uart_drv_t s_uart_drv[UART_NUM_MAX] = {0};
 
-static void at_uart_init(void)
+static void at_uart_init(void *user_data)
 {
+    char path[16] = {0};
+    at_uart_drv_t *obj = (at_uart_drv_t *)user_data;
     uart_config_t uart_config = {
-        .baud_rate = AT_UART_BAUD_RATE,
+        .baud_rate = obj->cfg.baud_rate,
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE};
-
-    ESP_ERROR_CHECK(uart_param_config(AT_UART, &uart_config));
-    ESP_ERROR_CHECK(uart_set_pin(AT_UART, AT_UART_TX_PIN, AT_UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-    ESP_ERROR_CHECK(uart_driver_install(AT_UART, AT_UART_RX_BUF_SIZE * 2, 0, 0, NULL, 0));
-    at_uart_drv.fd = open("/dev/uart/1", O_RDWR);
-
-    if (at_uart_drv.fd == -1)
+        .flow_ctrl = (obj->cfg.flow_ctrl) ? (UART_HW_FLOWCTRL_CTS_RTS) : (UART_HW_FLOWCTRL_DISABLE),
+        .rx_flow_ctrl_thresh = AT_UART_RTS_THRESH};
+
+    ESP_ERROR_CHECK(uart_param_config(obj->cfg.uart_num, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(obj->cfg.uart_num, obj->cfg.tx_pin, obj->cfg.rx_pin,
+                                 (obj->cfg.flow_ctrl) ? (obj->cfg.rts_pin) : (UART_PIN_NO_CHANGE),
+                                 (obj->cfg.flow_ctrl) ? (obj->cfg.cts_pin) : (UART_PIN_NO_CHANGE)));
+    ESP_ERROR_CHECK(uart_driver_install(obj->cfg.uart_num, AT_UART_RX_BUF_SIZE * 2, 0, 0, NULL, 0));
+    snprintf(path, sizeof(path), "/dev/uart/%d", obj->cfg.uart_num);
+    obj->fd = open(path, O_RDWR);
+
+    if (obj->fd == -1)
     {
         ESP_LOGE(TAG, "Cannot open UART");
         return;
     }
 
-    esp_vfs_dev_uart_use_driver(1);
+    esp_vfs_dev_uart_use_driver(obj->cfg.uart_num);
 }
 
-bool at_uart_available(void)
+static bool at_uart_available(void *user_data)
 {
     size_t size = 0;
     bool ret = false;
+    at_uart_drv_t *obj = (at_uart_drv_t *)user_data;
 
-    if ((-1 != at_uart_drv.fd) && (ESP_OK == uart_get_buffered_data_len(AT_UART, &size)))
+    if ((-1 != obj->fd) && (ESP_OK == uart_get_buffered_data_len(obj->cfg.uart_num, &size)))
     {
         ret = (size > 0);
     }
@@ -59,18 +71,21 @@ bool at_uart_available(void)
     return ret;
 }
 
-static int at_uart_write(const void *src, uint32_t size)
+static int at_uart_write(void *user_data, const void *src, uint32_t size)
 {
-    return (-1 != at_uart_drv.fd) ? (uart_write_bytes(AT_UART, src, size)) :(0);
+    at_uart_drv_t *obj = (at_uart_drv_t *)user_data;
+
+    return (-1 != obj->fd) ? (uart_write_bytes(obj->cfg.uart_num, src, size)) :(0);
 }
 
-static int at_uart_read(void *buf, uint32_t length, uint32_t timeout_ms)
+static int at_uart_read(void *user_data, void *buf, uint32_t length, uint32_t timeout_ms)
 {
     int ret = 0;
     fd_set read_set = {0};
     struct timeval tv = {0};
+    at_uart_drv_t *obj = (at_uart_drv_t *)user_data;
 
-    if (-1 != at_uart_drv.fd)
+    if (-1 != obj->fd)
     {
         if (portMAX_DELAY != timeout_ms)
         {
@@ -79,13 +94,13 @@ static int at_uart_read(void *buf, uint32_t length, uint32_t timeout_ms)
         }
         
         FD_ZERO(&read_set);
-        FD_SET(at_uart_drv.fd, &read_set);
-        ret = select(at_uart_drv.fd + 1, &read_set, NULL, NULL, (portMAX_DELAY != timeout_ms) ? (&tv) : (NULL));
+        FD_SET(obj->fd, &read_set);
+        ret = select(obj->fd + 1, &read_set, NULL, NULL, (portMAX_DELAY != timeout_ms) ? (&tv) : (NULL));
 
-        if ((ret > 0) && FD_ISSET(at_uart_drv.fd, &read_set))
+        if ((ret > 0) && FD_ISSET(obj->fd, &read_set))
         {
             // 使用read时，0xd会被被替换，所以此处使用uart_read_bytes
-            return uart_read_bytes(AT_UART, buf, length, 0);
+            return uart_read_bytes(obj->cfg.uart_num, buf, length, 0);
         }
         else
         {
@@ -99,16 +114,35 @@ static int at_uart_read(void *buf, uint32_t length, uint32_t timeout_ms)
     }
 }
 
-static void at_uart_flush_input(void)
+static void at_uart_flush_input(void *user_data)
 {
-    uart_flush_input(AT_UART);
+    at_uart_drv_t *obj = (at_uart_drv_t *)user_data;
+
+    uart_flush_input(obj->cfg.uart_num);
 }
 
-void at_uart_drv_get(com_drv_t *drv)
+void at_uart_drv_get(com_drv_t *drv, const at_uart_cfg_t *cfg)
 {
-    if (drv)
+    at_uart_drv_t *obj = NULL;
+    at_uart_cfg_t default_cfg = {
+        .uart_num = AT_UART,
+        .baud_rate = AT_UART_BAUD_RATE,
+        .tx_pin = AT_UART_TX_PIN,
+        .rx_pin = AT_UART_RX_PIN,
+        .flow_ctrl = false};
+
+    /* 未指定配置时使用默认串口 */
+    (!cfg) ? (cfg = &default_cfg) : (0);
+
+    if (drv && (cfg->uart_num < UART_NUM_MAX))
     {
-        drv->name = "uart1";
+        obj = &s_uart_drv[cfg->uart_num];
+        obj->fd = -1;
+        obj->cfg = *cfg;
+        snprintf(obj->name, sizeof(obj->name), "uart%d", cfg->uart_num);
+
+        drv->name = obj->name;
+        drv->user_data = obj;
         drv->init = at_uart_init;
         drv->read = at_uart_read;
         drv->write = at_uart_write;
@@ -2,4 +2,17 @@
 
 #include "com_interface.h"
 
-void at_uart_drv_get(com_drv_t *drv);
\ No newline at end of file
+typedef struct
+{
+    int uart_num;
+    int baud_rate;
+    int tx_pin;
+    int rx_pin;
+    /* 开启RTS/CTS硬件流控，模组侧也需开启(如AT+IFC=2,2)，
+       未开启时大量连续发送(如HTTP流式POST)可能溢出模组的接收缓冲 */
+    bool flow_ctrl;
+    int rts_pin;
+    int cts_pin;
+} at_uart_cfg_t;
+
+void at_uart_drv_get(com_drv_t *drv, const at_uart_cfg_t *cfg);
\ No newline at end of file
@@ -8,7 +8,7 @@
 void com_init(com_inface_t *p)
 {
     DEBUG_ASSERT(((com_drv_t *)p)->init);
-    ((com_drv_t *)p)->init();
+    ((com_drv_t *)p)->init(((com_drv_t *)p)->user_data);
 }
 
 const char *com_device_name(com_inface_t *p)
@@ -19,23 +19,23 @@ const char *com_device_name(com_inface_t *p)
 bool com_available(com_inface_t *p)
 {
     DEBUG_ASSERT(((com_drv_t *)p)->available);
-    return ((com_drv_t *)p)->available();
+    return ((com_drv_t *)p)->available(((com_drv_t *)p)->user_data);
 }
 
 int com_read(com_inface_t *p, void *buf, uint32_t length, uint32_t timeout_ms)
 {
     DEBUG_ASSERT(((com_drv_t *)p)->read);
-    return ((com_drv_t *)p)->read(buf, length, timeout_ms);
+    return ((com_drv_t *)p)->read(((com_drv_t *)p)->user_data, buf, length, timeout_ms);
 }
 
 int com_write(com_inface_t *p, const void *src, uint32_t size)
 {
     DEBUG_ASSERT(((com_drv_t *)p)->write);
-    return ((com_drv_t *)p)->write(src, size);
+    return ((com_drv_t *)p)->write(((com_drv_t *)p)->user_data, src, size);
 }
 
 void com_flush(com_inface_t *p)
 {
     DEBUG_ASSERT(((com_drv_t *)p)->flush);
-    ((com_drv_t *)p)->flush();
+    ((com_drv_t *)p)->flush(((com_drv_t *)p)->user_data);
 }
\ No newline at end of file
@@ -8,11 +8,12 @@ typedef void com_inface_t;
 typedef struct
 {
     const char *name;
-    void (*init)(void);
-    bool (*available)(void);
-    int (*read)(void *buf, uint32_t length, uint32_t timeout_ms);
-    int (*write)(const void *src, uint32_t size);
-    void (*flush)(void);
+    void *user_data;
+    void (*init)(void *user_data);
+    bool (*available)(void *user_data);
+    int (*read)(void *user_data, void *buf, uint32_t length, uint32_t timeout_ms);
+    int (*write)(void *user_data, const void *src, uint32_t size);
+    void (*flush)(void *user_data);
 } com_drv_t;
 
 void com_init(com_inface_t *p);
@@ -0,0 +1,318 @@
+#include "mqtt_batch.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "mqtt_batch";
+
+// 在mutex中交换缓存后释放mutex再发送，发送期间发布者可继续合并，send_lock保证各帧按顺序发送
+static void private_mqtt_batch_flush_topic(mqtt_batch_t *obj, mqtt_batch_topic_t *topic)
+{
+    bool ok = false;
+    int len = 0;
+    int count = 0;
+    char *buf = NULL;
+
+    if (pdTRUE != xSemaphoreTake(obj->send_lock, portMAX_DELAY))
+    {
+        return;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        if (topic->count)
+        {
+            buf = topic->buf;
+            len = topic->len;
+            count = topic->count;
+            topic->buf = topic->spare;
+            topic->spare = NULL;
+            topic->len = 0;
+            topic->count = 0;
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (buf)
+    {
+        ok = (mqtt_publish_async(obj->mqtt, topic->topic, buf, len, topic->qos, topic->retain) >= 0);
+        if (!ok)
+        {
+            ESP_LOGE(TAG, "publish %d merged messages to %s failed", count, topic->topic);
+        }
+
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            if (ok)
+            {
+                topic->publish_out++;
+                topic->bytes_out += len;
+            }
+            else
+            {
+                topic->drop += count;
+            }
+
+            topic->spare = buf;
+            xSemaphoreGive(obj->mutex);
+        }
+    }
+
+    xSemaphoreGive(obj->send_lock);
+}
+
+// 等待最早到期的主题并发送，写满的主题由发布者直接发送，收到stop后发送剩余消息并退出
+static void private_mqtt_batch_task(void *argument)
+{
+    TickType_t now = 0;
+    TickType_t wait = 0;
+    mqtt_batch_topic_t *topic = NULL;
+    mqtt_batch_topic_t *expired = NULL;
+    mqtt_batch_t *obj = (mqtt_batch_t *)argument;
+
+    while (!obj->stop)
+    {
+        wait = portMAX_DELAY;
+        expired = NULL;
+
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            now = xTaskGetTickCount();
+
+            for (int i = 0; i < obj->topic_num; i++)
+            {
+                topic = &obj->topics[i];
+
+                if (topic->count && ((int32_t)(topic->deadline - now) <= 0))
+                {
+                    expired = topic;
+                    break;
+                }
+                else if (topic->count && (topic->deadline - now < wait))
+                {
+                    wait = topic->deadline - now;
+                }
+            }
+
+            xSemaphoreGive(obj->mutex);
+        }
+
+        if (expired)
+        {
+            private_mqtt_batch_flush_topic(obj, expired);
+            continue;
+        }
+
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+
+    mqtt_batch_flush(obj);
+    xSemaphoreGive(obj->exit);
+    vTaskDelete(NULL);
+}
+
+bool mqtt_batch_init(mqtt_batch_t *obj, mqtt_inface_t *mqtt, mqtt_batch_topic_t *topics, int topic_num)
+{
+    bool ret = false;
+    mqtt_batch_topic_t *topic = NULL;
+
+    obj->mqtt = mqtt;
+    obj->topics = topics;
+    obj->topic_num = topic_num;
+    obj->mutex = NULL;
+    obj->send_lock = NULL;
+    obj->exit = NULL;
+    obj->stop = false;
+    obj->task = NULL;
+
+    /* 失败时由deinit释放，先清空所有句柄和缓存 */
+    for (int i = 0; i < topic_num; i++)
+    {
+        topics[i].buf = NULL;
+        topics[i].spare = NULL;
+        topics[i].len = 0;
+        topics[i].count = 0;
+    }
+
+    for (int i = 0; i < topic_num; i++)
+    {
+        topic = &topics[i];
+        (0 == topic->latency) ? (topic->latency = MQTT_BATCH_DEFAULT_LATENCY) : (0);
+        (0 == topic->size) ? (topic->size = MQTT_BATCH_DEFAULT_SIZE) : (0);
+        topic->buf = malloc(topic->size);
+        topic->spare = malloc(topic->size);
+        if (!topic->buf || !topic->spare)
+        {
+            ESP_LOGE(TAG, "No memory for mqtt batch buffer");
+            goto __exit;
+        }
+    }
+
+    obj->mutex = xSemaphoreCreateMutex();
+    obj->send_lock = xSemaphoreCreateMutex();
+    obj->exit = xSemaphoreCreateBinary();
+    if (!obj->mutex || !obj->send_lock || !obj->exit)
+    {
+        ESP_LOGE(TAG, "Create semaphore object failed! memory not enough");
+        goto __exit;
+    }
+
+    xTaskCreate(private_mqtt_batch_task, "mqtt_batch_task", 1024 * 3, obj, 5, &obj->task);
+    if (!obj->task)
+    {
+        ESP_LOGE(TAG, "mqtt_batch_task create failed! memory not enough");
+        goto __exit;
+    }
+
+    ret = true;
+
+__exit:
+
+    if (!ret)
+    {
+        mqtt_batch_deinit(obj);
+    }
+
+    return ret;
+}
+
+// 未配置合并的主题直接发送
+bool mqtt_batch_publish(mqtt_batch_t *obj, const char *topic, const char *data, int len, int qos, int retain)
+{
+    bool ret = false;
+    bool room = false;
+    bool full = false;
+    mqtt_batch_topic_t *batch = NULL;
+
+    for (int i = 0; i < obj->topic_num; i++)
+    {
+        if (!strcmp(obj->topics[i].topic, topic))
+        {
+            batch = &obj->topics[i];
+            break;
+        }
+    }
+
+    if (!batch)
+    {
+        return mqtt_publish(obj->mqtt, topic, data, len, qos, retain);
+    }
+
+    if ((len > 0xFFFF) || (len + MQTT_BATCH_RECORD_HEAD > batch->size))
+    {
+        ESP_LOGE(TAG, "message is too long for batch %s (%d)", topic, len);
+        return false;
+    }
+
+    while (!ret && (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+    {
+        room = (batch->len + MQTT_BATCH_RECORD_HEAD + len <= batch->size);
+
+        if (room)
+        {
+            batch->buf[batch->len++] = (len >> 8) & 0xFF;
+            batch->buf[batch->len++] = len & 0xFF;
+            memcpy(batch->buf + batch->len, data, len);
+            batch->len += len;
+            batch->msg_in++;
+            batch->bytes_in += len;
+
+            /* 第一条消息决定发送时间 */
+            if (1 == ++batch->count)
+            {
+                batch->deadline = xTaskGetTickCount() + pdMS_TO_TICKS(batch->latency);
+                xTaskNotifyGive(obj->task);
+            }
+
+            /* 剩余空间不足以放下任何消息时立即发送 */
+            full = (batch->len + MQTT_BATCH_RECORD_HEAD >= batch->size);
+            ret = true;
+        }
+
+        xSemaphoreGive(obj->mutex);
+
+        /* 放不下时先发送已合并的消息，再重新写入 */
+        if (!room)
+        {
+            private_mqtt_batch_flush_topic(obj, batch);
+        }
+    }
+
+    if (full)
+    {
+        private_mqtt_batch_flush_topic(obj, batch);
+    }
+
+    return ret;
+}
+
+// 立即发送所有主题中合并的消息
+void mqtt_batch_flush(mqtt_batch_t *obj)
+{
+    for (int i = 0; i < obj->topic_num; i++)
+    {
+        private_mqtt_batch_flush_topic(obj, &obj->topics[i]);
+    }
+}
+
+// 通知发送任务退出，任务发送剩余消息后应答，不会在持有锁时被删除
+void mqtt_batch_deinit(mqtt_batch_t *obj)
+{
+    if (obj->task)
+    {
+        obj->stop = true;
+        xTaskNotifyGive(obj->task);
+        xSemaphoreTake(obj->exit, portMAX_DELAY);
+        obj->task = NULL;
+    }
+
+    if (obj->mutex)
+    {
+        vSemaphoreDelete(obj->mutex);
+        obj->mutex = NULL;
+    }
+
+    if (obj->send_lock)
+    {
+        vSemaphoreDelete(obj->send_lock);
+        obj->send_lock = NULL;
+    }
+
+    if (obj->exit)
+    {
+        vSemaphoreDelete(obj->exit);
+        obj->exit = NULL;
+    }
+
+    for (int i = 0; i < obj->topic_num; i++)
+    {
+        free(obj->topics[i].buf);
+        free(obj->topics[i].spare);
+        obj->topics[i].buf = NULL;
+        obj->topics[i].spare = NULL;
+    }
+}
+
+// 格式: len(u16，大端) | data[len]，长度超出帧时停止
+bool mqtt_batch_unframe(const char *frame, int len, int *offset, const char **data, int *data_len)
+{
+    int size = 0;
+
+    if (*offset + MQTT_BATCH_RECORD_HEAD > len)
+    {
+        return false;
+    }
+
+    size = ((uint8_t)frame[*offset] << 8) | (uint8_t)frame[*offset + 1];
+    if (*offset + MQTT_BATCH_RECORD_HEAD + size > len)
+    {
+        return false;
+    }
+
+    *data = frame + *offset + MQTT_BATCH_RECORD_HEAD;
+    *data_len = size;
+    *offset += MQTT_BATCH_RECORD_HEAD + size;
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "mqtt_interface.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/*
+ * 同一主题的小消息在延迟预算内合并为一帧发送，接收端按以下格式拆分:
+ *   len(u16，大端) | data[len] | len | data | ...
+ */
+#define MQTT_BATCH_DEFAULT_LATENCY 200
+#define MQTT_BATCH_DEFAULT_SIZE 512
+#define MQTT_BATCH_RECORD_HEAD 2
+
+typedef struct
+{
+    /* 合并的主题及发送参数 */
+    const char *topic;
+    int qos;
+    int retain;
+    /* 第一条消息最多等待的时间(ms)，为0时使用MQTT_BATCH_DEFAULT_LATENCY */
+    uint32_t latency;
+    /* 帧的最大长度，写满后立即发送，为0时使用MQTT_BATCH_DEFAULT_SIZE */
+    int size;
+
+    /* 正在合并的帧，发送时与spare交换，发送期间可继续合并 */
+    char *buf;
+    char *spare;
+    int len;
+    int count;
+    TickType_t deadline;
+
+    /* 合并前的消息数和长度，以及实际发送的帧数和长度 */
+    uint32_t msg_in;
+    uint32_t bytes_in;
+    uint32_t publish_out;
+    uint32_t bytes_out;
+    uint32_t drop;
+} mqtt_batch_topic_t;
+
+typedef struct
+{
+    mqtt_inface_t *mqtt;
+    mqtt_batch_topic_t *topics;
+    int topic_num;
+    /* mutex保护合并缓存，send_lock保证同一时刻只发送一帧，发送时不持有mutex */
+    SemaphoreHandle_t mutex;
+    SemaphoreHandle_t send_lock;
+    /* 发送任务收到stop后发送剩余消息并通过exit应答 */
+    SemaphoreHandle_t exit;
+    volatile bool stop;
+    TaskHandle_t task;
+} mqtt_batch_t;
+
+bool mqtt_batch_init(mqtt_batch_t *obj, mqtt_inface_t *mqtt, mqtt_batch_topic_t *topics, int topic_num);
+bool mqtt_batch_publish(mqtt_batch_t *obj, const char *topic, const char *data, int len, int qos, int retain);
+void mqtt_batch_flush(mqtt_batch_t *obj);
+void mqtt_batch_deinit(mqtt_batch_t *obj);
+/* 接收端依次取出帧中的消息，offset从0开始，返回false时结束，此时offset不等于len说明帧格式错误 */
+bool mqtt_batch_unframe(const char *frame, int len, int *offset, const char **data, int *data_len);
\ No newline at end of file
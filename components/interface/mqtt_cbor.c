@@ -0,0 +1,518 @@
+#include "mqtt_cbor.h"
+#include <math.h>
+#include <string.h>
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NINT 1
+#define CBOR_MAJOR_BYTES 2
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_TAG 6
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_FALSE 20
+#define CBOR_TRUE 21
+#define CBOR_NULL 22
+#define CBOR_HALF 25
+#define CBOR_FLOAT 26
+#define CBOR_DOUBLE 27
+
+static void private_mqtt_cbor_write(mqtt_cbor_writer_t *obj, const void *data, size_t len)
+{
+    if (obj->error || (len > obj->size - obj->len))
+    {
+        obj->error = true;
+        return;
+    }
+
+    memcpy(obj->buf + obj->len, data, len);
+    obj->len += len;
+}
+
+// 写入类型和参数，参数按最短的大端格式编码
+static void private_mqtt_cbor_put_head(mqtt_cbor_writer_t *obj, uint8_t major, uint64_t value)
+{
+    int num = 0;
+    uint8_t head[9] = {0};
+
+    if (value < 24)
+    {
+        head[num++] = (major << 5) | value;
+    }
+    else
+    {
+        int bytes = (value <= 0xFF) ? (1) : ((value <= 0xFFFF) ? (2) : ((value <= 0xFFFFFFFF) ? (4) : (8)));
+
+        head[num++] = (major << 5) | ((1 == bytes) ? (24) : ((2 == bytes) ? (25) : ((4 == bytes) ? (26) : (27))));
+
+        for (int i = bytes - 1; i >= 0; i--)
+        {
+            head[num++] = (value >> (i * 8)) & 0xFF;
+        }
+    }
+
+    private_mqtt_cbor_write(obj, head, num);
+}
+
+void mqtt_cbor_writer_init(mqtt_cbor_writer_t *obj, void *buf, size_t size)
+{
+    obj->buf = buf;
+    obj->size = size;
+    obj->len = 0;
+    obj->error = false;
+}
+
+void mqtt_cbor_put_uint(mqtt_cbor_writer_t *obj, uint64_t value)
+{
+    private_mqtt_cbor_put_head(obj, CBOR_MAJOR_UINT, value);
+}
+
+void mqtt_cbor_put_int(mqtt_cbor_writer_t *obj, int64_t value)
+{
+    if (value >= 0)
+    {
+        private_mqtt_cbor_put_head(obj, CBOR_MAJOR_UINT, value);
+    }
+    else
+    {
+        private_mqtt_cbor_put_head(obj, CBOR_MAJOR_NINT, (uint64_t)(-1 - value));
+    }
+}
+
+void mqtt_cbor_put_float(mqtt_cbor_writer_t *obj, float value)
+{
+    uint32_t bits = 0;
+    uint8_t data[5] = {(CBOR_MAJOR_SIMPLE << 5) | CBOR_FLOAT};
+
+    memcpy(&bits, &value, sizeof(bits));
+    data[1] = bits >> 24;
+    data[2] = bits >> 16;
+    data[3] = bits >> 8;
+    data[4] = bits;
+    private_mqtt_cbor_write(obj, data, sizeof(data));
+}
+
+void mqtt_cbor_put_bool(mqtt_cbor_writer_t *obj, bool value)
+{
+    uint8_t data = (CBOR_MAJOR_SIMPLE << 5) | ((value) ? (CBOR_TRUE) : (CBOR_FALSE));
+
+    private_mqtt_cbor_write(obj, &data, 1);
+}
+
+void mqtt_cbor_put_null(mqtt_cbor_writer_t *obj)
+{
+    uint8_t data = (CBOR_MAJOR_SIMPLE << 5) | CBOR_NULL;
+
+    private_mqtt_cbor_write(obj, &data, 1);
+}
+
+void mqtt_cbor_put_text(mqtt_cbor_writer_t *obj, const char *text, size_t len)
+{
+    private_mqtt_cbor_put_head(obj, CBOR_MAJOR_TEXT, len);
+    private_mqtt_cbor_write(obj, text, len);
+}
+
+void mqtt_cbor_put_bytes(mqtt_cbor_writer_t *obj, const void *data, size_t len)
+{
+    private_mqtt_cbor_put_head(obj, CBOR_MAJOR_BYTES, len);
+    private_mqtt_cbor_write(obj, data, len);
+}
+
+void mqtt_cbor_put_array(mqtt_cbor_writer_t *obj, size_t num)
+{
+    private_mqtt_cbor_put_head(obj, CBOR_MAJOR_ARRAY, num);
+}
+
+void mqtt_cbor_put_map(mqtt_cbor_writer_t *obj, size_t num)
+{
+    private_mqtt_cbor_put_head(obj, CBOR_MAJOR_MAP, num);
+}
+
+int mqtt_cbor_encode_record(mqtt_cbor_writer_t *obj, const mqtt_cbor_field_t *schema, int field_num, const void *record)
+{
+    const uint8_t *member = NULL;
+
+    mqtt_cbor_put_map(obj, field_num);
+
+    for (int i = 0; i < field_num; i++)
+    {
+        member = (const uint8_t *)record + schema[i].offset;
+        mqtt_cbor_put_uint(obj, schema[i].key);
+
+        switch (schema[i].type)
+        {
+        case MQTT_CBOR_U8:
+            mqtt_cbor_put_uint(obj, *(const uint8_t *)member);
+            break;
+        case MQTT_CBOR_U16:
+            mqtt_cbor_put_uint(obj, *(const uint16_t *)member);
+            break;
+        case MQTT_CBOR_U32:
+            mqtt_cbor_put_uint(obj, *(const uint32_t *)member);
+            break;
+        case MQTT_CBOR_I8:
+            mqtt_cbor_put_int(obj, *(const int8_t *)member);
+            break;
+        case MQTT_CBOR_I16:
+            mqtt_cbor_put_int(obj, *(const int16_t *)member);
+            break;
+        case MQTT_CBOR_I32:
+            mqtt_cbor_put_int(obj, *(const int32_t *)member);
+            break;
+        case MQTT_CBOR_FLOAT:
+            mqtt_cbor_put_float(obj, *(const float *)member);
+            break;
+        case MQTT_CBOR_BOOL:
+            mqtt_cbor_put_bool(obj, *(const bool *)member);
+            break;
+        case MQTT_CBOR_TEXT:
+            mqtt_cbor_put_text(obj, (const char *)member, strnlen((const char *)member, schema[i].size));
+            break;
+        default:
+            obj->error = true;
+            break;
+        }
+    }
+
+    return (obj->error) ? (-1) : ((int)obj->len);
+}
+
+void mqtt_cbor_reader_init(mqtt_cbor_reader_t *obj, const void *buf, size_t len)
+{
+    obj->buf = buf;
+    obj->len = len;
+    obj->pos = 0;
+    obj->error = false;
+}
+
+// 读取类型和参数，不支持不定长编码
+static bool private_mqtt_cbor_get_head(mqtt_cbor_reader_t *obj, uint8_t *major, uint8_t *info, uint64_t *value)
+{
+    int bytes = 0;
+
+    if (obj->error || (obj->pos >= obj->len))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    *major = obj->buf[obj->pos] >> 5;
+    *info = obj->buf[obj->pos++] & 0x1F;
+    *value = *info;
+
+    if (*info >= 24)
+    {
+        bytes = (*info <= 27) ? (1 << (*info - 24)) : (0);
+
+        if (!bytes || (bytes > obj->len - obj->pos))
+        {
+            obj->error = true;
+            return false;
+        }
+
+        for (*value = 0; bytes--; obj->pos++)
+        {
+            *value = (*value << 8) | obj->buf[obj->pos];
+        }
+    }
+
+    return true;
+}
+
+// 读取指定类型的参数，类型不符时置错误
+static bool private_mqtt_cbor_expect(mqtt_cbor_reader_t *obj, uint8_t expect, uint64_t *value)
+{
+    uint8_t info = 0;
+    uint8_t major = 0;
+
+    if (private_mqtt_cbor_get_head(obj, &major, &info, value) && (major == expect))
+    {
+        return true;
+    }
+
+    obj->error = true;
+
+    return false;
+}
+
+bool mqtt_cbor_get_uint(mqtt_cbor_reader_t *obj, uint64_t *value)
+{
+    return private_mqtt_cbor_expect(obj, CBOR_MAJOR_UINT, value);
+}
+
+bool mqtt_cbor_get_int(mqtt_cbor_reader_t *obj, int64_t *value)
+{
+    uint8_t info = 0;
+    uint8_t major = 0;
+    uint64_t raw = 0;
+
+    if (!private_mqtt_cbor_get_head(obj, &major, &info, &raw) || (raw > INT64_MAX) ||
+        ((CBOR_MAJOR_UINT != major) && (CBOR_MAJOR_NINT != major)))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    *value = (CBOR_MAJOR_UINT == major) ? ((int64_t)raw) : (-1 - (int64_t)raw);
+
+    return true;
+}
+
+// 接受整数、半精度、单精度和双精度数
+bool mqtt_cbor_get_float(mqtt_cbor_reader_t *obj, float *value)
+{
+    uint8_t info = 0;
+    uint8_t major = 0;
+    uint64_t raw = 0;
+    float single = 0;
+    double dual = 0;
+    int exp = 0;
+    uint32_t mant = 0;
+
+    if (!private_mqtt_cbor_get_head(obj, &major, &info, &raw))
+    {
+        return false;
+    }
+
+    if (CBOR_MAJOR_UINT == major)
+    {
+        *value = (float)raw;
+    }
+    else if (CBOR_MAJOR_NINT == major)
+    {
+        *value = -1.0f - (float)raw;
+    }
+    else if ((CBOR_MAJOR_SIMPLE == major) && (CBOR_HALF == info))
+    {
+        exp = (raw >> 10) & 0x1F;
+        mant = raw & 0x3FF;
+        single = (0 == exp) ? (mant / 16777216.0f) : ((31 == exp) ? ((mant) ? (NAN) : (INFINITY)) : (ldexpf(mant + 1024, exp - 25)));
+        *value = (raw & 0x8000) ? (-single) : (single);
+    }
+    else if ((CBOR_MAJOR_SIMPLE == major) && (CBOR_FLOAT == info))
+    {
+        mant = raw;
+        memcpy(&single, &mant, sizeof(single));
+        *value = single;
+    }
+    else if ((CBOR_MAJOR_SIMPLE == major) && (CBOR_DOUBLE == info))
+    {
+        memcpy(&dual, &raw, sizeof(dual));
+        *value = (float)dual;
+    }
+    else
+    {
+        obj->error = true;
+    }
+
+    return !obj->error;
+}
+
+bool mqtt_cbor_get_bool(mqtt_cbor_reader_t *obj, bool *value)
+{
+    uint8_t info = 0;
+    uint8_t major = 0;
+    uint64_t raw = 0;
+
+    if (!private_mqtt_cbor_get_head(obj, &major, &info, &raw) || (CBOR_MAJOR_SIMPLE != major) ||
+        ((CBOR_TRUE != info) && (CBOR_FALSE != info)))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    *value = (CBOR_TRUE == info);
+
+    return true;
+}
+
+static bool private_mqtt_cbor_get_string(mqtt_cbor_reader_t *obj, uint8_t major, const uint8_t **data, size_t *len)
+{
+    uint64_t raw = 0;
+
+    if (!private_mqtt_cbor_expect(obj, major, &raw) || (raw > obj->len - obj->pos))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    *data = obj->buf + obj->pos;
+    *len = raw;
+    obj->pos += raw;
+
+    return true;
+}
+
+bool mqtt_cbor_get_text(mqtt_cbor_reader_t *obj, const char **text, size_t *len)
+{
+    return private_mqtt_cbor_get_string(obj, CBOR_MAJOR_TEXT, (const uint8_t **)text, len);
+}
+
+bool mqtt_cbor_get_bytes(mqtt_cbor_reader_t *obj, const uint8_t **data, size_t *len)
+{
+    return private_mqtt_cbor_get_string(obj, CBOR_MAJOR_BYTES, data, len);
+}
+
+// 每个元素至少占一个字节，元素数超过剩余长度时视为格式错误
+static bool private_mqtt_cbor_get_container(mqtt_cbor_reader_t *obj, uint8_t major, size_t *num)
+{
+    uint64_t raw = 0;
+
+    if (!private_mqtt_cbor_expect(obj, major, &raw) || (raw > obj->len - obj->pos))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    *num = raw;
+
+    return true;
+}
+
+bool mqtt_cbor_get_array(mqtt_cbor_reader_t *obj, size_t *num)
+{
+    return private_mqtt_cbor_get_container(obj, CBOR_MAJOR_ARRAY, num);
+}
+
+bool mqtt_cbor_get_map(mqtt_cbor_reader_t *obj, size_t *num)
+{
+    return private_mqtt_cbor_get_container(obj, CBOR_MAJOR_MAP, num);
+}
+
+static bool private_mqtt_cbor_skip(mqtt_cbor_reader_t *obj, int depth)
+{
+    uint8_t info = 0;
+    uint8_t major = 0;
+    uint64_t raw = 0;
+
+    if ((depth > MQTT_CBOR_MAX_DEPTH) || !private_mqtt_cbor_get_head(obj, &major, &info, &raw))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    switch (major)
+    {
+    case CBOR_MAJOR_BYTES:
+    case CBOR_MAJOR_TEXT:
+        (raw > obj->len - obj->pos) ? (obj->error = true) : (obj->pos += raw);
+        break;
+    case CBOR_MAJOR_MAP:
+        raw *= 2;
+        /* fall through */
+    case CBOR_MAJOR_ARRAY:
+        (raw > obj->len - obj->pos) ? (obj->error = true) : (0);
+
+        for (uint64_t i = 0; !obj->error && (i < raw); i++)
+        {
+            private_mqtt_cbor_skip(obj, depth + 1);
+        }
+        break;
+    case CBOR_MAJOR_TAG:
+        private_mqtt_cbor_skip(obj, depth + 1);
+        break;
+    default:
+        break;
+    }
+
+    return !obj->error;
+}
+
+bool mqtt_cbor_skip(mqtt_cbor_reader_t *obj)
+{
+    return private_mqtt_cbor_skip(obj, 0);
+}
+
+// 读取整数并检查是否在成员类型的范围内
+static bool private_mqtt_cbor_get_ranged(mqtt_cbor_reader_t *obj, int64_t min, int64_t max, int64_t *value)
+{
+    if (!mqtt_cbor_get_int(obj, value) || (*value < min) || (*value > max))
+    {
+        obj->error = true;
+        return false;
+    }
+
+    return true;
+}
+
+static void private_mqtt_cbor_decode_field(mqtt_cbor_reader_t *obj, const mqtt_cbor_field_t *field, uint8_t *member)
+{
+    int64_t value = 0;
+    size_t len = 0;
+    const char *text = NULL;
+
+    switch (field->type)
+    {
+    case MQTT_CBOR_U8:
+        (private_mqtt_cbor_get_ranged(obj, 0, UINT8_MAX, &value)) ? (*(uint8_t *)member = value) : (0);
+        break;
+    case MQTT_CBOR_U16:
+        (private_mqtt_cbor_get_ranged(obj, 0, UINT16_MAX, &value)) ? (*(uint16_t *)member = value) : (0);
+        break;
+    case MQTT_CBOR_U32:
+        (private_mqtt_cbor_get_ranged(obj, 0, UINT32_MAX, &value)) ? (*(uint32_t *)member = value) : (0);
+        break;
+    case MQTT_CBOR_I8:
+        (private_mqtt_cbor_get_ranged(obj, INT8_MIN, INT8_MAX, &value)) ? (*(int8_t *)member = value) : (0);
+        break;
+    case MQTT_CBOR_I16:
+        (private_mqtt_cbor_get_ranged(obj, INT16_MIN, INT16_MAX, &value)) ? (*(int16_t *)member = value) : (0);
+        break;
+    case MQTT_CBOR_I32:
+        (private_mqtt_cbor_get_ranged(obj, INT32_MIN, INT32_MAX, &value)) ? (*(int32_t *)member = value) : (0);
+        break;
+    case MQTT_CBOR_FLOAT:
+        mqtt_cbor_get_float(obj, (float *)member);
+        break;
+    case MQTT_CBOR_BOOL:
+        mqtt_cbor_get_bool(obj, (bool *)member);
+        break;
+    case MQTT_CBOR_TEXT:
+        if (field->size && mqtt_cbor_get_text(obj, &text, &len))
+        {
+            /* 超出数组长度的部分被截断 */
+            len = (len < field->size) ? (len) : (field->size - 1u);
+            memcpy(member, text, len);
+            member[len] = '\0';
+        }
+        break;
+    default:
+        obj->error = true;
+        break;
+    }
+}
+
+int mqtt_cbor_decode_record(mqtt_cbor_reader_t *obj, const mqtt_cbor_field_t *schema, int field_num, void *record)
+{
+    int count = 0;
+    int index = 0;
+    size_t num = 0;
+    uint64_t key = 0;
+
+    mqtt_cbor_get_map(obj, &num);
+
+    for (size_t i = 0; !obj->error && (i < num); i++)
+    {
+        if (!mqtt_cbor_get_uint(obj, &key))
+        {
+            break;
+        }
+
+        for (index = 0; (index < field_num) && (schema[index].key != key); index++)
+        {
+        }
+
+        if (index < field_num)
+        {
+            private_mqtt_cbor_decode_field(obj, &schema[index], (uint8_t *)record + schema[index].offset);
+            count++;
+        }
+        else
+        {
+            mqtt_cbor_skip(obj);
+        }
+    }
+
+    return (obj->error) ? (-1) : (count);
+}
\ No newline at end of file
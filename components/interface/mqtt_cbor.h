@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * MQTT消息的CBOR编解码，直接读写调用者提供的缓冲区，不分配内存。
+ * 记录按字典编码为以整数为键的map，字典描述结构体成员的键、类型和偏移，
+ * 解码时跳过未知的键，收发双方只需约定键值。
+ */
+#define MQTT_CBOR_MAX_DEPTH 8
+
+typedef enum
+{
+    MQTT_CBOR_U8,
+    MQTT_CBOR_U16,
+    MQTT_CBOR_U32,
+    MQTT_CBOR_I8,
+    MQTT_CBOR_I16,
+    MQTT_CBOR_I32,
+    MQTT_CBOR_FLOAT,
+    MQTT_CBOR_BOOL,
+    /* char数组，size为数组长度 */
+    MQTT_CBOR_TEXT
+} mqtt_cbor_type_def;
+
+typedef struct
+{
+    uint32_t key;
+    mqtt_cbor_type_def type;
+    uint16_t offset;
+    uint16_t size;
+} mqtt_cbor_field_t;
+
+#define MQTT_CBOR_FIELD(_key_, _type_, _struct_, _member_) \
+    {_key_, _type_, offsetof(_struct_, _member_), sizeof(((_struct_ *)0)->_member_)}
+
+typedef struct
+{
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+    /* 缓冲区不足时置位，之后的写入全部忽略 */
+    bool error;
+} mqtt_cbor_writer_t;
+
+typedef struct
+{
+    const uint8_t *buf;
+    size_t len;
+    size_t pos;
+    /* 格式错误或类型不符时置位，之后的读取全部失败 */
+    bool error;
+} mqtt_cbor_reader_t;
+
+void mqtt_cbor_writer_init(mqtt_cbor_writer_t *obj, void *buf, size_t size);
+void mqtt_cbor_put_uint(mqtt_cbor_writer_t *obj, uint64_t value);
+void mqtt_cbor_put_int(mqtt_cbor_writer_t *obj, int64_t value);
+void mqtt_cbor_put_float(mqtt_cbor_writer_t *obj, float value);
+void mqtt_cbor_put_bool(mqtt_cbor_writer_t *obj, bool value);
+void mqtt_cbor_put_null(mqtt_cbor_writer_t *obj);
+void mqtt_cbor_put_text(mqtt_cbor_writer_t *obj, const char *text, size_t len);
+void mqtt_cbor_put_bytes(mqtt_cbor_writer_t *obj, const void *data, size_t len);
+void mqtt_cbor_put_array(mqtt_cbor_writer_t *obj, size_t num);
+void mqtt_cbor_put_map(mqtt_cbor_writer_t *obj, size_t num);
+/* 按字典把结构体编码为map，返回编码后的总长度，失败时返回-1 */
+int mqtt_cbor_encode_record(mqtt_cbor_writer_t *obj, const mqtt_cbor_field_t *schema, int field_num, const void *record);
+
+void mqtt_cbor_reader_init(mqtt_cbor_reader_t *obj, const void *buf, size_t len);
+bool mqtt_cbor_get_uint(mqtt_cbor_reader_t *obj, uint64_t *value);
+bool mqtt_cbor_get_int(mqtt_cbor_reader_t *obj, int64_t *value);
+bool mqtt_cbor_get_float(mqtt_cbor_reader_t *obj, float *value);
+bool mqtt_cbor_get_bool(mqtt_cbor_reader_t *obj, bool *value);
+/* 文本和字节串返回指向缓冲区内的指针，不复制 */
+bool mqtt_cbor_get_text(mqtt_cbor_reader_t *obj, const char **text, size_t *len);
+bool mqtt_cbor_get_bytes(mqtt_cbor_reader_t *obj, const uint8_t **data, size_t *len);
+bool mqtt_cbor_get_array(mqtt_cbor_reader_t *obj, size_t *num);
+bool mqtt_cbor_get_map(mqtt_cbor_reader_t *obj, size_t *num);
+bool mqtt_cbor_skip(mqtt_cbor_reader_t *obj);
+/* 按字典把map解码到结构体，未知的键被跳过，返回解码的字段数，失败时返回-1 */
+int mqtt_cbor_decode_record(mqtt_cbor_reader_t *obj, const mqtt_cbor_field_t *schema, int field_num, void *record);
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "mqtt_compress.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LZ4_MIN_MATCH 4
+/* 最后5字节必须是字面量，最后一个匹配至少在结尾12字节前开始 */
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MF_LIMIT 12
+#define LZ4_HASH_SIZE (1 << MQTT_COMPRESS_HASH_BITS)
+/* 压缩后的最大长度 */
+#define LZ4_BOUND(len) ((len) + (len) / 255 + 16)
+#define COMPRESS_HEAD 3
+
+static const char *TAG = "mqtt_compress";
+
+static uint32_t private_mqtt_compress_read32(const uint8_t *p)
+{
+    uint32_t value = 0;
+
+    memcpy(&value, p, sizeof(value));
+
+    return value;
+}
+
+static uint32_t private_mqtt_compress_hash(uint32_t value)
+{
+    return (value * 2654435761u) >> (32 - MQTT_COMPRESS_HASH_BITS);
+}
+
+// 长度超过15的部分按255分段写入
+static uint8_t *private_mqtt_compress_put_len(uint8_t *op, int len)
+{
+    for (len -= 15; len >= 255; len -= 255)
+    {
+        *op++ = 255;
+    }
+
+    *op++ = len;
+
+    return op;
+}
+
+// 写入一个序列，match为0时只有字面量，输出空间不足时返回NULL
+static uint8_t *private_mqtt_compress_sequence(uint8_t *op, uint8_t *end, const uint8_t *literal, int literal_len, int offset, int match)
+{
+    uint8_t *token = op++;
+
+    if (op + literal_len + literal_len / 255 + match / 255 + 8 > end)
+    {
+        return NULL;
+    }
+
+    *token = ((literal_len < 15) ? (literal_len) : (15)) << 4;
+    op = (literal_len >= 15) ? (private_mqtt_compress_put_len(op, literal_len)) : (op);
+    memcpy(op, literal, literal_len);
+    op += literal_len;
+
+    if (match)
+    {
+        match -= LZ4_MIN_MATCH;
+        *op++ = offset & 0xFF;
+        *op++ = (offset >> 8) & 0xFF;
+        *token |= (match < 15) ? (match) : (15);
+        op = (match >= 15) ? (private_mqtt_compress_put_len(op, match)) : (op);
+    }
+
+    return op;
+}
+
+// 贪心匹配的LZ4块压缩，输入不超过64KB，返回压缩后的长度，失败时返回-1
+static int private_mqtt_compress_lz4(uint16_t *hash, const uint8_t *in, int len, uint8_t *out, int size)
+{
+    int ip = 0;
+    int ref = 0;
+    int match = 0;
+    int anchor = 0;
+    uint32_t key = 0;
+    uint8_t *op = out;
+    uint8_t *end = out + size;
+
+    /* 表中保存位置加1，0表示空 */
+    memset(hash, 0, LZ4_HASH_SIZE * sizeof(uint16_t));
+
+    while (op && (ip < len - LZ4_MF_LIMIT))
+    {
+        key = private_mqtt_compress_hash(private_mqtt_compress_read32(in + ip));
+        ref = hash[key] - 1;
+        hash[key] = ip + 1;
+
+        if ((ref < 0) || (private_mqtt_compress_read32(in + ref) != private_mqtt_compress_read32(in + ip)))
+        {
+            ip++;
+            continue;
+        }
+
+        for (match = LZ4_MIN_MATCH; (ip + match < len - LZ4_LAST_LITERALS) && (in[ref + match] == in[ip + match]); match++)
+        {
+        }
+
+        op = private_mqtt_compress_sequence(op, end, in + anchor, ip - anchor, ip - ref, match);
+        ip += match;
+        anchor = ip;
+    }
+
+    op = (op) ? (private_mqtt_compress_sequence(op, end, in + anchor, len - anchor, 0, 0)) : (NULL);
+
+    return (op) ? (op - out) : (-1);
+}
+
+static bool private_mqtt_compress_get_len(const uint8_t **ip, const uint8_t *end, int *len)
+{
+    uint8_t value = 255;
+
+    while ((255 == value) && (*ip < end))
+    {
+        value = *(*ip)++;
+        *len += value;
+    }
+
+    return (255 != value);
+}
+
+// 检查全部边界的LZ4块解压，返回解压后的长度，格式错误时返回-1
+static int private_mqtt_compress_unlz4(const uint8_t *in, int len, uint8_t *out, int size)
+{
+    int offset = 0;
+    int literal = 0;
+    int match = 0;
+    uint8_t token = 0;
+    uint8_t *op = out;
+    const uint8_t *ip = in;
+    const uint8_t *end = in + len;
+
+    while (ip < end)
+    {
+        token = *ip++;
+        literal = token >> 4;
+
+        if (((15 == literal) && !private_mqtt_compress_get_len(&ip, end, &literal)) ||
+            (literal > end - ip) || (literal > out + size - op))
+        {
+            return -1;
+        }
+
+        memcpy(op, ip, literal);
+        op += literal;
+        ip += literal;
+
+        /* 最后一个序列只有字面量 */
+        if (ip == end)
+        {
+            break;
+        }
+
+        if (end - ip < 2)
+        {
+            return -1;
+        }
+
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        match = token & 0x0F;
+
+        if (((15 == match) && !private_mqtt_compress_get_len(&ip, end, &match)) ||
+            (0 == offset) || (offset > op - out) || (match + LZ4_MIN_MATCH > out + size - op))
+        {
+            return -1;
+        }
+
+        /* 匹配可能与输出重叠，逐字节复制 */
+        for (match += LZ4_MIN_MATCH; match--; op++)
+        {
+            *op = *(op - offset);
+        }
+    }
+
+    return op - out;
+}
+
+bool mqtt_compress_init(mqtt_compress_t *obj, mqtt_inface_t *mqtt, int threshold, int max_len)
+{
+    obj->mqtt = mqtt;
+    obj->threshold = (threshold > 0) ? (threshold) : (MQTT_COMPRESS_DEFAULT_THRESHOLD);
+    obj->max_len = (max_len < 0xFFFF) ? (max_len) : (0xFFFF);
+    obj->buf_size = COMPRESS_HEAD + LZ4_BOUND(obj->max_len);
+    obj->hash = malloc(LZ4_HASH_SIZE * sizeof(uint16_t));
+    obj->buf = malloc(obj->buf_size);
+    obj->mutex = xSemaphoreCreateMutex();
+
+    if (!obj->hash || !obj->buf || !obj->mutex)
+    {
+        ESP_LOGE(TAG, "No memory for mqtt compress workspace");
+        mqtt_compress_deinit(obj);
+        return false;
+    }
+
+    return true;
+}
+
+bool mqtt_compress_publish(mqtt_compress_t *obj, const char *topic, const char *data, int len, int qos, int retain)
+{
+    bool ret = false;
+    int size = -1;
+    int64_t start = 0;
+
+    if ((len < 0) || (len > obj->max_len))
+    {
+        ESP_LOGE(TAG, "message is too long for compress (%d)", len);
+        return false;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        if (len >= obj->threshold)
+        {
+            start = esp_timer_get_time();
+            size = private_mqtt_compress_lz4(obj->hash, (const uint8_t *)data, len, obj->buf + COMPRESS_HEAD, obj->buf_size - COMPRESS_HEAD);
+            obj->stats.compress_us += esp_timer_get_time() - start;
+        }
+
+        /* 压缩后没有变小时按原样发送 */
+        if ((size > 0) && (size + COMPRESS_HEAD < len + 1))
+        {
+            obj->buf[0] = MQTT_COMPRESS_FLAG_LZ4;
+            obj->buf[1] = (len >> 8) & 0xFF;
+            obj->buf[2] = len & 0xFF;
+            size += COMPRESS_HEAD;
+            obj->stats.compress_num++;
+        }
+        else
+        {
+            obj->buf[0] = MQTT_COMPRESS_FLAG_RAW;
+            memcpy(obj->buf + 1, data, len);
+            size = len + 1;
+            obj->stats.raw_num++;
+        }
+
+        obj->stats.bytes_in += len;
+        obj->stats.bytes_out += size;
+        ret = mqtt_publish(obj->mqtt, topic, (const char *)obj->buf, size, qos, retain);
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+const char *mqtt_compress_decode(mqtt_compress_t *obj, const char *data, int len, char *out, int size, int *out_len)
+{
+    int raw_len = 0;
+    const char *ret = NULL;
+    const uint8_t *in = (const uint8_t *)data;
+
+    if ((len >= 1) && (MQTT_COMPRESS_FLAG_RAW == in[0]))
+    {
+        ret = data + 1;
+        *out_len = len - 1;
+    }
+    else if ((len > COMPRESS_HEAD) && (MQTT_COMPRESS_FLAG_LZ4 == in[0]))
+    {
+        raw_len = (in[1] << 8) | in[2];
+
+        if ((raw_len <= size) && (raw_len == private_mqtt_compress_unlz4(in + COMPRESS_HEAD, len - COMPRESS_HEAD, (uint8_t *)out, raw_len)))
+        {
+            ret = out;
+            *out_len = raw_len;
+        }
+    }
+
+    /* mutex在发送期间一直被持有，接收统计只由接收回调更新，不使用mutex */
+    obj->stats.decode_num++;
+    (!ret) ? (obj->stats.decode_fail++) : (0);
+
+    if (!ret)
+    {
+        ESP_LOGW(TAG, "invalid compressed message (%d)", len);
+    }
+
+    return ret;
+}
+
+void mqtt_compress_deinit(mqtt_compress_t *obj)
+{
+    if (obj->mutex)
+    {
+        vSemaphoreDelete(obj->mutex);
+        obj->mutex = NULL;
+    }
+
+    free(obj->hash);
+    free(obj->buf);
+    obj->hash = NULL;
+    obj->buf = NULL;
+}
\ No newline at end of file
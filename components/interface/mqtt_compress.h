@@ -0,0 +1,51 @@
+#pragma once
+
+#include "mqtt_interface.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/*
+ * 可选的负载压缩，压缩算法为LZ4块格式。经过该层收发的消息第一个字节为标志:
+ *   MQTT_COMPRESS_FLAG_RAW | data
+ *   MQTT_COMPRESS_FLAG_LZ4 | 原始长度(u16，大端) | LZ4块
+ * 小于阈值或压缩后没有变小的消息不压缩，工作区在初始化时一次分配。
+ */
+#define MQTT_COMPRESS_FLAG_RAW 0x00
+#define MQTT_COMPRESS_FLAG_LZ4 0x01
+#define MQTT_COMPRESS_DEFAULT_THRESHOLD 128
+#define MQTT_COMPRESS_HASH_BITS 12
+
+typedef struct
+{
+    uint32_t raw_num;
+    uint32_t compress_num;
+    /* 压缩前后的总长度，用于计算压缩率 */
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    /* 压缩的累计耗时 */
+    uint32_t compress_us;
+    /* 只由接收回调更新，不受mutex保护 */
+    uint32_t decode_num;
+    uint32_t decode_fail;
+} mqtt_compress_stats_t;
+
+typedef struct
+{
+    mqtt_inface_t *mqtt;
+    /* 达到该长度才压缩，为0时使用MQTT_COMPRESS_DEFAULT_THRESHOLD */
+    int threshold;
+    /* 最大消息长度，决定工作区大小 */
+    int max_len;
+    SemaphoreHandle_t mutex;
+    uint16_t *hash;
+    uint8_t *buf;
+    int buf_size;
+    mqtt_compress_stats_t stats;
+} mqtt_compress_t;
+
+bool mqtt_compress_init(mqtt_compress_t *obj, mqtt_inface_t *mqtt, int threshold, int max_len);
+bool mqtt_compress_publish(mqtt_compress_t *obj, const char *topic, const char *data, int len, int qos, int retain);
+/* 解析收到的消息，未压缩时直接返回data中的负载，压缩时解压到out，失败返回NULL，
+   不等待发送，应只在MQTT接收回调中调用 */
+const char *mqtt_compress_decode(mqtt_compress_t *obj, const char *data, int len, char *out, int size, int *out_len);
+void mqtt_compress_deinit(mqtt_compress_t *obj);
\ No newline at end of file
@@ -69,6 +69,7 @@ typedef struct
     char *data;    /*!< Data associated with this event */
     int data_len;  /*!< Length of the data for this event */
     int qos;       /*!< QoS of the messages associated with this event */
+    int msg_id;    /*!< Message id of MQTT_EVT_PUBLISHED / MQTT_EVT_DELETED, returned by mqtt_publish_async */
 } mqtt_msg_t;
 
 typedef struct
@@ -113,16 +114,17 @@ typedef struct
 
 typedef struct
 {
-  void *user_data;
-    void (*register_callback)(mqtt_event_cb_t *cb);
-    bool (*init)(mqtt_cfg_t *cfg);
-    bool (*open)(void);
-    bool (*subscribe)(const char *topic, int qos);
-    bool (*unsubscribe)(const char *topic);
-    bool (*publish)(const char *topic, const char *data, int len, int qos, int retain);
-    bool (*close)(void);
-    mqtt_err_def (*error_code)(void);
-    void (*delete)(void);
+    void *user_data;
+    void (*register_callback)(void *user_data, mqtt_event_cb_t *cb);
+    bool (*init)(void *user_data, mqtt_cfg_t *cfg);
+    bool (*open)(void *user_data);
+    bool (*subscribe)(void *user_data, const char *topic, int qos);
+    bool (*unsubscribe)(void *user_data, const char *topic);
+    bool (*publish)(void *user_data, const char *topic, const char *data, int len, int qos, int retain);
+    int (*publish_async)(void *user_data, const char *topic, const char *data, int len, int qos, int retain);
+    bool (*close)(void *user_data);
+    mqtt_err_def (*error_code)(void *user_data);
+    void (*delete)(void *user_data);
 } mqtt_drv_t;
 
 void mqtt_register_callback(mqtt_inface_t *obj, mqtt_event_cb_t *cb);
@@ -131,6 +133,7 @@ bool mqtt_open(mqtt_inface_t *obj);
 bool mqtt_subscribe(mqtt_inface_t *obj, const char *topic, int qos);
 bool mqtt_unsubscribe(mqtt_inface_t *obj, const char *topic);
 bool mqtt_publish(mqtt_inface_t *obj, const char *topic, const char *data, int len, int qos, int retain);
+int mqtt_publish_async(mqtt_inface_t *obj, const char *topic, const char *data, int len, int qos, int retain);
 int mqtt_read(mqtt_inface_t *obj, void *data, int length);
 bool mqtt_close(mqtt_inface_t *obj);
 mqtt_err_def mqtt_error_code(mqtt_inface_t *obj);
@@ -0,0 +1,392 @@
+#include "mqtt_router.h"
+#include "esp_log.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "mqtt_router";
+
+// 层级名与父节点共同决定散列值
+static uint32_t private_mqtt_router_key(mqtt_router_node_t *parent, const char *level, int len)
+{
+    uint32_t key = 2166136261u ^ ((uint32_t)(uintptr_t)parent * 2654435761u);
+
+    for (int i = 0; i < len; i++)
+    {
+        key = (key ^ (uint8_t)level[i]) * 16777619u;
+    }
+
+    return key;
+}
+
+static mqtt_router_node_t *private_mqtt_router_find(mqtt_router_t *obj, mqtt_router_node_t *parent, const char *level, int len)
+{
+    uint32_t key = private_mqtt_router_key(parent, level, len);
+    mqtt_router_node_t *node = obj->bucket[key % MQTT_ROUTER_BUCKET_NUM];
+
+    while (node && ((node->key != key) || (node->parent != parent) || (node->len != len) || memcmp(node->level, level, len)))
+    {
+        node = node->next;
+    }
+
+    return node;
+}
+
+static mqtt_router_node_t *private_mqtt_router_node_new(mqtt_router_node_t *parent, const char *level, int len)
+{
+    mqtt_router_node_t *node = malloc(sizeof(mqtt_router_node_t) + len + 1);
+
+    if (node)
+    {
+        memset(node, 0, sizeof(mqtt_router_node_t));
+        node->parent = parent;
+        node->key = private_mqtt_router_key(parent, level, len);
+        node->len = len;
+        memcpy(node->level, level, len);
+        node->level[len] = '\0';
+    }
+
+    return node;
+}
+
+// 查找子节点，不存在时按需创建，'+'和'#'节点同时记录在父节点中
+static mqtt_router_node_t *private_mqtt_router_child(mqtt_router_t *obj, mqtt_router_node_t *parent, const char *level, int len)
+{
+    mqtt_router_node_t **bucket = NULL;
+    mqtt_router_node_t *node = private_mqtt_router_find(obj, parent, level, len);
+
+    if (node || !(node = private_mqtt_router_node_new(parent, level, len)))
+    {
+        return node;
+    }
+
+    bucket = &obj->bucket[node->key % MQTT_ROUTER_BUCKET_NUM];
+    node->next = *bucket;
+    *bucket = node;
+    parent->child_num++;
+
+    if ((1 == len) && ('+' == level[0]))
+    {
+        parent->plus = node;
+    }
+    else if ((1 == len) && ('#' == level[0]))
+    {
+        parent->hash = node;
+    }
+
+    return node;
+}
+
+// 删除没有路由也没有子节点的节点
+static void private_mqtt_router_prune(mqtt_router_t *obj, mqtt_router_node_t *node)
+{
+    mqtt_router_node_t *parent = NULL;
+    mqtt_router_node_t **prev = NULL;
+
+    while ((node != obj->root) && !node->route && !node->child_num)
+    {
+        parent = node->parent;
+        prev = &obj->bucket[node->key % MQTT_ROUTER_BUCKET_NUM];
+
+        while (*prev != node)
+        {
+            prev = &(*prev)->next;
+        }
+
+        *prev = node->next;
+        (parent->plus == node) ? (parent->plus = NULL) : (0);
+        (parent->hash == node) ? (parent->hash = NULL) : (0);
+        parent->child_num--;
+        free(node);
+        node = parent;
+    }
+}
+
+// 按订阅逐层找到对应节点，create为false时只查找
+static mqtt_router_node_t *private_mqtt_router_lookup(mqtt_router_t *obj, const char *topic, bool create)
+{
+    int len = 0;
+    const char *end = NULL;
+    mqtt_router_node_t *node = obj->root;
+
+    for (;;)
+    {
+        end = strchr(topic, '/');
+        len = (end) ? (end - topic) : ((int)strlen(topic));
+
+        /* 通配符必须独占一层，'#'只能在最后一层 */
+        if ((memchr(topic, '+', len) && (1 != len)) || (memchr(topic, '#', len) && ((1 != len) || end)))
+        {
+            ESP_LOGE(TAG, "Invalid topic filter");
+
+            if (create)
+            {
+                private_mqtt_router_prune(obj, node);
+            }
+
+            return NULL;
+        }
+
+        node = (create) ? (private_mqtt_router_child(obj, node, topic, len)) : (private_mqtt_router_find(obj, node, topic, len));
+
+        if (!node || !end)
+        {
+            return node;
+        }
+
+        topic = end + 1;
+    }
+}
+
+static int private_mqtt_router_deliver(mqtt_router_node_t *node, mqtt_msg_t *msg)
+{
+    int count = 0;
+
+    for (mqtt_router_route_t *route = node->route; route; route = route->next)
+    {
+        route->handler(route->param, msg);
+        count++;
+    }
+
+    return count;
+}
+
+// level为NULL表示主题已匹配完，$开头的主题不匹配首层通配符
+static int private_mqtt_router_match(mqtt_router_t *obj, mqtt_router_node_t *node, const char *level, mqtt_msg_t *msg, bool system)
+{
+    int len = 0;
+    int count = 0;
+    const char *end = NULL;
+    mqtt_router_node_t *child = NULL;
+
+    obj->visit_num++;
+
+    /* '#'也匹配父级本身 */
+    if (node->hash && !system)
+    {
+        count += private_mqtt_router_deliver(node->hash, msg);
+    }
+
+    if (!level)
+    {
+        return count + private_mqtt_router_deliver(node, msg);
+    }
+
+    end = strchr(level, '/');
+    len = (end) ? (end - level) : ((int)strlen(level));
+    child = private_mqtt_router_find(obj, node, level, len);
+
+    if (child)
+    {
+        count += private_mqtt_router_match(obj, child, (end) ? (end + 1) : (NULL), msg, false);
+    }
+
+    if (node->plus && !system)
+    {
+        count += private_mqtt_router_match(obj, node->plus, (end) ? (end + 1) : (NULL), msg, false);
+    }
+
+    return count;
+}
+
+// 移除一个路由，handler为NULL时移除该节点的全部路由
+static void private_mqtt_router_remove(mqtt_router_t *obj, mqtt_router_node_t *node, mqtt_router_handler_t handler, void *param)
+{
+    mqtt_router_route_t *route = NULL;
+    mqtt_router_route_t **prev = &node->route;
+
+    while (*prev)
+    {
+        route = *prev;
+
+        if (!handler || ((route->handler == handler) && (route->param == param)))
+        {
+            *prev = route->next;
+            obj->route_num--;
+            free(route);
+        }
+        else
+        {
+            prev = &route->next;
+        }
+    }
+
+    private_mqtt_router_prune(obj, node);
+}
+
+static void private_mqtt_router_event(void *param, mqtt_event_def event, mqtt_msg_t *msg)
+{
+    mqtt_router_t *obj = (mqtt_router_t *)param;
+
+    if ((MQTT_EVT_DATA == event) && msg && (mqtt_router_dispatch(obj, msg) > 0))
+    {
+        return;
+    }
+
+    if (obj->event_cb.func)
+    {
+        obj->event_cb.func(obj->event_cb.param, event, msg);
+    }
+}
+
+bool mqtt_router_init(mqtt_router_t *obj, mqtt_inface_t *mqtt, mqtt_event_cb_t *cb)
+{
+    mqtt_event_cb_t router_cb = {.param = obj, .func = private_mqtt_router_event};
+
+    obj->mqtt = mqtt;
+
+    if (cb)
+    {
+        obj->event_cb = *cb;
+    }
+
+    obj->root = private_mqtt_router_node_new(NULL, "", 0);
+    obj->mutex = xSemaphoreCreateMutex();
+    if (!obj->root || !obj->mutex)
+    {
+        ESP_LOGE(TAG, "Create mqtt router failed! memory not enough");
+        mqtt_router_deinit(obj);
+        return false;
+    }
+
+    mqtt_register_callback(mqtt, &router_cb);
+
+    return true;
+}
+
+bool mqtt_router_subscribe(mqtt_router_t *obj, const char *topic, int qos, mqtt_router_handler_t handler, void *param)
+{
+    bool ret = false;
+    mqtt_router_node_t *node = NULL;
+    mqtt_router_route_t *route = malloc(sizeof(mqtt_router_route_t));
+
+    if (!route)
+    {
+        ESP_LOGE(TAG, "No memory for mqtt route");
+        return false;
+    }
+
+    route->handler = handler;
+    route->param = param;
+
+    /* 先添加路由，订阅后立即到达的保留消息也能被分发 */
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        node = private_mqtt_router_lookup(obj, topic, true);
+
+        if (node)
+        {
+            route->next = node->route;
+            node->route = route;
+            obj->route_num++;
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (!node)
+    {
+        free(route);
+        return false;
+    }
+
+    ret = mqtt_subscribe(obj->mqtt, topic, qos);
+
+    if (!ret && (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+    {
+        node = private_mqtt_router_lookup(obj, topic, false);
+
+        if (node)
+        {
+            private_mqtt_router_remove(obj, node, handler, param);
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+// 取消服务器订阅并删除该订阅的全部本地路由
+bool mqtt_router_unsubscribe(mqtt_router_t *obj, const char *topic)
+{
+    bool ret = mqtt_unsubscribe(obj->mqtt, topic);
+    mqtt_router_node_t *node = NULL;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        node = private_mqtt_router_lookup(obj, topic, false);
+
+        if (node)
+        {
+            private_mqtt_router_remove(obj, node, NULL, NULL);
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+// 返回调用的处理函数个数
+int mqtt_router_dispatch(mqtt_router_t *obj, mqtt_msg_t *msg)
+{
+    int count = 0;
+
+    if (!msg->topic)
+    {
+        return 0;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        count = private_mqtt_router_match(obj, obj->root, msg->topic, msg, ('$' == msg->topic[0]));
+        obj->dispatch_num++;
+        (0 == count) ? (obj->unmatched_num++) : (0);
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return count;
+}
+
+void mqtt_router_deinit(mqtt_router_t *obj)
+{
+    mqtt_router_node_t *node = NULL;
+    mqtt_router_route_t *route = NULL;
+
+    /* 恢复应用的回调 */
+    if (obj->root && obj->mutex)
+    {
+        mqtt_register_callback(obj->mqtt, &obj->event_cb);
+    }
+
+    for (int i = 0; i < MQTT_ROUTER_BUCKET_NUM; i++)
+    {
+        while ((node = obj->bucket[i]) != NULL)
+        {
+            obj->bucket[i] = node->next;
+
+            while ((route = node->route) != NULL)
+            {
+                node->route = route->next;
+                free(route);
+            }
+
+            free(node);
+        }
+    }
+
+    if (obj->root)
+    {
+        free(obj->root);
+        obj->root = NULL;
+    }
+
+    if (obj->mutex)
+    {
+        vSemaphoreDelete(obj->mutex);
+        obj->mutex = NULL;
+    }
+
+    obj->route_num = 0;
+}
\ No newline at end of file
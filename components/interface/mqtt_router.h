@@ -0,0 +1,57 @@
+#pragma once
+
+#include "mqtt_interface.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/*
+ * 订阅按层级编译为主题树，收到MQTT_EVT_DATA时逐层匹配并直接调用订阅的处理函数。
+ * 普通层级的子节点按(父节点, 层级名)散列存放，'+'和'#'子节点单独保存，
+ * 每层的查找与同级订阅数量无关。
+ */
+#define MQTT_ROUTER_BUCKET_NUM 64
+
+typedef void (*mqtt_router_handler_t)(void *param, mqtt_msg_t *msg);
+
+typedef struct mqtt_router_route
+{
+    struct mqtt_router_route *next;
+    mqtt_router_handler_t handler;
+    void *param;
+} mqtt_router_route_t;
+
+typedef struct mqtt_router_node
+{
+    struct mqtt_router_node *parent;
+    /* 散列桶中的下一个节点 */
+    struct mqtt_router_node *next;
+    struct mqtt_router_node *plus;
+    struct mqtt_router_node *hash;
+    mqtt_router_route_t *route;
+    uint32_t key;
+    int child_num;
+    int len;
+    char level[];
+} mqtt_router_node_t;
+
+typedef struct
+{
+    mqtt_inface_t *mqtt;
+    /* 未匹配的消息和其他事件交给该回调 */
+    mqtt_event_cb_t event_cb;
+    SemaphoreHandle_t mutex;
+    mqtt_router_node_t *root;
+    mqtt_router_node_t *bucket[MQTT_ROUTER_BUCKET_NUM];
+    int route_num;
+    /* 分发的消息数、未匹配的消息数和查找的节点数 */
+    uint32_t dispatch_num;
+    uint32_t unmatched_num;
+    uint32_t visit_num;
+} mqtt_router_t;
+
+bool mqtt_router_init(mqtt_router_t *obj, mqtt_inface_t *mqtt, mqtt_event_cb_t *cb);
+/* 向服务器订阅并添加本地路由，处理函数在MQTT任务中执行，不能在其中修改订阅 */
+bool mqtt_router_subscribe(mqtt_router_t *obj, const char *topic, int qos, mqtt_router_handler_t handler, void *param);
+bool mqtt_router_unsubscribe(mqtt_router_t *obj, const char *topic);
+int mqtt_router_dispatch(mqtt_router_t *obj, mqtt_msg_t *msg);
+void mqtt_router_deinit(mqtt_router_t *obj);
\ No newline at end of file
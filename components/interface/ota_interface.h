@@ -28,10 +28,10 @@ typedef struct
 typedef struct
 {
     void *user_data;
-    void (*register_callback)(ota_event_cb_t *cb);
-    bool (*init)(void);
-    bool (*start)(const char *url, bool ignore_version_check);
-    void (*restart)(void);
+    void (*register_callback)(void *user_data, ota_event_cb_t *cb);
+    bool (*init)(void *user_data);
+    bool (*start)(void *user_data, const char *url, bool ignore_version_check);
+    void (*restart)(void *user_data);
 } ota_drv_t;
 
 void ota_register_callback(ota_inface_t *obj, ota_event_cb_t *cb);
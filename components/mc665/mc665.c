@@ -1,6 +1,8 @@
 #include "mc665.h"
 #include "esp_log.h"
+#include <stdio.h>
 #include <string.h>
+#include <stdarg.h>
 
 #define MC665_RECV_BUF_SIZE 1024
 #define MC665_RECV_TIMEOUT 10000
@@ -8,8 +10,88 @@
 #define MC665_SIM_READY_BIT BIT0
 #define MC665_SIM_DROP_BIT BIT1
 
+/* 应答中字符串字段的最大长度 */
+#define MC665_PIN_LEN 15
+#define MC665_IMSI_LEN 29
+#define MC665_OPERATOR_LEN 19
+#define MC665_IP_LEN 19
+
+#define MC665_STR(x) MC665_STR_(x)
+#define MC665_STR_(x) #x
+#define MC665_UNPACK(...) __VA_ARGS__
+#define MC665_NARGS(...) MC665_NARGS_(__VA_ARGS__, 4, 3, 2, 1)
+#define MC665_NARGS_(_1, _2, _3, _4, N, ...) N
+
+/* 无需解析应答的指令
+   X(名称, 指令, 应答行数, 超时, 重试次数) */
+#define MC665_EXEC_CMD_TABLE(X)                                          \
+    X(echo_off, "ATE0", 0, MC665_RECV_TIMEOUT, 0)                        \
+    X(search_priority, "AT+GTRAT=10,3,0", 0, MC665_RECV_TIMEOUT, 0)      \
+    X(enable_rf, "AT+CFUN=1", 0, MC665_RECV_TIMEOUT, 0)                  \
+    X(set_apn, "AT+CGDCONT=1,\"IP\"", 0, MC665_RECV_TIMEOUT, 0)
+
+/* 需要解析应答的查询指令
+   X(名称, 指令, 应答前缀, 字段解析表达式, 参数列表, 参数, 应答行数, 超时, 重试次数) */
+#define MC665_QUERY_CMD_TABLE(X)                                                                       \
+    X(cfun, "AT+CFUN?", "+CFUN:", "+CFUN: %d",                                                         \
+      (int *state), (state), 0, MC665_RECV_TIMEOUT, 1)                                                 \
+    X(cpin, "AT+CPIN?", "+CPIN:", "+CPIN: %" MC665_STR(MC665_PIN_LEN) "s",                             \
+      (char *pin), (pin), 0, MC665_RECV_TIMEOUT, 1)                                                    \
+    X(cimi, "AT+CIMI?", "+CIMI:", "+CIMI: %" MC665_STR(MC665_IMSI_LEN) "s",                            \
+      (char *imsi), (imsi), 0, MC665_RECV_TIMEOUT, 1)                                                  \
+    X(csq, "AT+CSQ?", "+CSQ:", "+CSQ: %d,%d",                                                          \
+      (int *rssi, int *ber), (rssi, ber), 0, MC665_RECV_TIMEOUT, 1)                                    \
+    X(cops, "AT+COPS?", "+COPS:", "+COPS: %*d,%*d,\"%" MC665_STR(MC665_OPERATOR_LEN) "[^\"]\",%d",      \
+      (char *operator, int *act), (operator, act), 0, MC665_RECV_TIMEOUT, 1)                           \
+    X(cgreg, "AT+CGREG?", "+CGREG:", "+CGREG: %d,%d",                                                  \
+      (int *mode, int *status), (mode, status), 0, MC665_RECV_TIMEOUT, 1)                              \
+    X(cereg, "AT+CEREG?", "+CEREG:", "+CEREG: %d,%d",                                                  \
+      (int *mode, int *status), (mode, status), 0, MC665_RECV_TIMEOUT, 1)                              \
+    X(creg, "AT+CREG?", "+CREG:", "+CREG: %d,%d",                                                      \
+      (int *mode, int *status), (mode, status), 0, MC665_RECV_TIMEOUT, 1)                              \
+    X(mipcall_request, "AT+MIPCALL=1", "+MIPCALL:", "+MIPCALL: %" MC665_STR(MC665_IP_LEN) "s",         \
+      (char *ip), (ip), 4, 30000, 0)                                                                   \
+    X(mipcall, "AT+MIPCALL?", "+MIPCALL:", "+MIPCALL: %d,%" MC665_STR(MC665_IP_LEN) "s",               \
+      (int *requested, char *ip), (requested, ip), 0, 30000, 0)
+
+typedef enum
+{
+#define X(name, ...) MC665_CMD_##name,
+    MC665_EXEC_CMD_TABLE(X)
+    MC665_QUERY_CMD_TABLE(X)
+#undef X
+    MC665_CMD_NUM
+} mc665_cmd_def;
+
 static const char *TAG = "mc665";
-static struct at_urc s_urc_table[4] = {0};
+static const mc665_cmd_t s_cmd_table[MC665_CMD_NUM] = {
+#define X(name, cmd, line_num, timeout, retry) \
+    [MC665_CMD_##name] = MC665_CMD_INIT(cmd, NULL, NULL, 0, line_num, timeout, retry),
+    MC665_EXEC_CMD_TABLE(X)
+#undef X
+#define X(name, cmd, prefix, expr, params, args, line_num, timeout, retry) \
+    [MC665_CMD_##name] = MC665_CMD_INIT(cmd, prefix, expr, MC665_NARGS args, line_num, timeout, retry),
+    MC665_QUERY_CMD_TABLE(X)
+#undef X
+};
+
+/* 根据指令表生成指令执行函数 private_mc665_exec_xxx */
+#define X(name, cmd, line_num, timeout, retry)                      \
+    static bool private_mc665_exec_##name(mc665_drv_t *obj)         \
+    {                                                               \
+        return mc665_cmd_exec(obj, &s_cmd_table[MC665_CMD_##name]); \
+    }
+MC665_EXEC_CMD_TABLE(X)
+#undef X
+
+/* 根据指令表生成带类型的查询函数 private_mc665_query_xxx */
+#define X(name, cmd, prefix, expr, params, args, line_num, timeout, retry)                \
+    static bool private_mc665_query_##name(mc665_drv_t *obj, MC665_UNPACK params)         \
+    {                                                                                     \
+        return mc665_cmd_query(obj, &s_cmd_table[MC665_CMD_##name], MC665_UNPACK args);   \
+    }
+MC665_QUERY_CMD_TABLE(X)
+#undef X
 
 static void private_mc665_set_event_bits(mc665_drv_t *obj, uint32_t bits)
 {
@@ -88,6 +170,7 @@ static void private_mc665_task(void *argument)
             if (mc665_detect(obj) && mc665_enable_rf(obj))
             {
                 ESP_LOGI(TAG, "MC665 detected");
+                obj->session++;
                 obj->status = MC665_STATUS_WAIT_CARD_READY;
             }
             else
@@ -151,6 +234,7 @@ static void private_mc665_task(void *argument)
             if (mc665_ip_is_available(obj))
             {
                 ESP_LOGI(TAG, "MC665 ready!");
+                obj->session++;
                 obj->status = MC665_STATUS_READY;
 
                 if (obj->event_cb.func)
@@ -193,24 +277,31 @@ bool mc665_init(mc665_drv_t *obj)
         goto __exit;
     }
 
+    (!obj->client) ? (obj->client = at_client_get_first()) : (0);
+    if (!obj->client)
+    {
+        ESP_LOGE(TAG, "at client is NULL, please initialize the at client first!");
+        goto __exit;
+    }
+
     /* 初始化URC */
-    s_urc_table[0].cmd_prefix = "+CME ERROR:";
-    s_urc_table[0].cmd_suffix = "\r\n";
-    s_urc_table[0].func = private_mc665_error_handler;
-    s_urc_table[0].param = obj;
-    s_urc_table[1].cmd_prefix = "+ESMCAUSE:";
-    s_urc_table[1].cmd_suffix = "\r\n";
-    s_urc_table[1].func = private_mc665_error_handler;
-    s_urc_table[1].param = obj;
-    s_urc_table[2].cmd_prefix = "+CMS ERROR:";
-    s_urc_table[2].cmd_suffix = "\r\n";
-    s_urc_table[2].func = private_mc665_error_handler;
-    s_urc_table[2].param = obj;
-    s_urc_table[3].cmd_prefix = "+SIM";
-    s_urc_table[3].cmd_suffix = "\r\n";
-    s_urc_table[3].func = private_mc665_sim_handler;
-    s_urc_table[3].param = obj;
-    if (at_set_urc_table(s_urc_table, 4))
+    obj->urc_table[0].cmd_prefix = "+CME ERROR:";
+    obj->urc_table[0].cmd_suffix = "\r\n";
+    obj->urc_table[0].func = private_mc665_error_handler;
+    obj->urc_table[0].param = obj;
+    obj->urc_table[1].cmd_prefix = "+ESMCAUSE:";
+    obj->urc_table[1].cmd_suffix = "\r\n";
+    obj->urc_table[1].func = private_mc665_error_handler;
+    obj->urc_table[1].param = obj;
+    obj->urc_table[2].cmd_prefix = "+CMS ERROR:";
+    obj->urc_table[2].cmd_suffix = "\r\n";
+    obj->urc_table[2].func = private_mc665_error_handler;
+    obj->urc_table[2].param = obj;
+    obj->urc_table[3].cmd_prefix = "+SIM";
+    obj->urc_table[3].cmd_suffix = "\r\n";
+    obj->urc_table[3].func = private_mc665_sim_handler;
+    obj->urc_table[3].param = obj;
+    if (at_obj_set_urc_table(obj->client, obj->urc_table, MC665_URC_NUM))
     {
         ESP_LOGE(TAG, "at client urc_table initial fail");
         goto __exit;
@@ -290,122 +381,117 @@ void mc665_release_lock(mc665_drv_t *obj)
     xSemaphoreGive(obj->mutex);
 }
 
-// 检查设备是否存在
-bool mc665_detect(mc665_drv_t *obj)
+// 执行指令，失败时按照指令表中的重试次数重新发送（需在持有锁时调用）
+static bool private_mc665_cmd_send(mc665_drv_t *obj, const mc665_cmd_t *cmd)
 {
     bool ret = false;
 
-    if (mc665_take_lock(obj))
+    at_resp_set_info(obj->resp, MC665_RECV_BUF_SIZE, cmd->line_num, cmd->timeout);
+
+    for (int i = 0; !ret && (i <= cmd->retry); i++)
     {
-        ret = (0 == at_client_wait_connect(1000));
-        mc665_release_lock(obj);
+        ret = (0 == at_obj_exec_raw_cmd(obj->client, obj->resp, cmd->cmd, cmd->cmd_len));
     }
 
+    at_resp_set_info(obj->resp, MC665_RECV_BUF_SIZE, 0, MC665_RECV_TIMEOUT);
+
     return ret;
 }
 
-// 关闭回显
-bool mc665_disable_echo(mc665_drv_t *obj)
+bool mc665_cmd_exec(mc665_drv_t *obj, const mc665_cmd_t *cmd)
 {
     bool ret = false;
 
     if (mc665_take_lock(obj))
     {
-        ret = (0 == at_exec_cmd(obj->resp, "ATE0"));
+        ret = private_mc665_cmd_send(obj, cmd);
         mc665_release_lock(obj);
     }
 
     return ret;
 }
 
-// 设置搜网顺序LTE优先
-bool mc665_set_network_search_priority(mc665_drv_t *obj)
+// 执行查询指令，在应答中查找前缀匹配的行，并按照表达式解析出所有字段
+bool mc665_cmd_query(mc665_drv_t *obj, const mc665_cmd_t *cmd, ...)
 {
+    va_list args;
     bool ret = false;
+    const char *line = NULL;
 
     if (mc665_take_lock(obj))
     {
-        ret = (0 == at_exec_cmd(obj->resp, "AT+GTRAT=10,3,0"));
+        if (private_mc665_cmd_send(obj, cmd) && (line = at_resp_get_line_by_kw(obj->resp, cmd->prefix)))
+        {
+            va_start(args, cmd);
+            ret = (cmd->field_num == vsscanf(line, cmd->expr, args));
+            va_end(args);
+        }
+
         mc665_release_lock(obj);
     }
 
     return ret;
 }
 
-// 查询模块射频功能设置，第一个参数非 1 需要设置+CFUN
-bool mc665_rf_is_enabled(mc665_drv_t *obj)
+// 检查设备是否存在
+bool mc665_detect(mc665_drv_t *obj)
 {
-    int state = 0;
     bool ret = false;
 
     if (mc665_take_lock(obj))
     {
-        if (0 == at_exec_cmd(obj->resp, "AT+CFUN?"))
-        {
-            ret = ((obj->resp->line_counts >= 2) && (1 == at_resp_parse_line_args(obj->resp, 2, "+CFUN: %d", &state)) && (1 == state));
-        }
-
+        ret = (0 == at_client_obj_wait_connect(obj->client, 1000));
         mc665_release_lock(obj);
     }
 
     return ret;
 }
 
-// 设置为正常模式,，开启射频功能
-bool mc665_enable_rf(mc665_drv_t *obj)
+// 关闭回显
+bool mc665_disable_echo(mc665_drv_t *obj)
 {
-    bool ret = false;
+    return private_mc665_exec_echo_off(obj);
+}
 
-    if (mc665_take_lock(obj))
-    {
-        ret = (0 == at_exec_cmd(obj->resp, "AT+CFUN=1"));
-        mc665_release_lock(obj);
-    }
+// 设置搜网顺序LTE优先
+bool mc665_set_network_search_priority(mc665_drv_t *obj)
+{
+    return private_mc665_exec_search_priority(obj);
+}
 
-    return ret;
+// 查询模块射频功能设置，第一个参数非 1 需要设置+CFUN
+bool mc665_rf_is_enabled(mc665_drv_t *obj)
+{
+    int state = 0;
+
+    return private_mc665_query_cfun(obj, &state) && (1 == state);
+}
+
+// 设置为正常模式,，开启射频功能
+bool mc665_enable_rf(mc665_drv_t *obj)
+{
+    return private_mc665_exec_enable_rf(obj);
 }
 
 // 查询PIN设置
 bool mc665_read_pin(mc665_drv_t *obj)
 {
-    bool ret = false;
-    const char *line = NULL;
-
-    if (mc665_take_lock(obj))
-    {
-        if (0 == at_exec_cmd(obj->resp, "AT+CPIN?"))
-        {
-            line = at_resp_get_line(obj->resp, 2);
-            ret = (line && strstr(line, "+CPIN: READY"));
-        }
+    char pin[MC665_PIN_LEN + 1] = {0};
 
-        mc665_release_lock(obj);
-    }
-
-    return ret;
+    return private_mc665_query_cpin(obj, pin) && !strcmp(pin, "READY");
 }
 
 // 读取IMSI
 bool mc665_read_imsi(mc665_drv_t *obj, void *buf, uint32_t len)
 {
     bool ret = false;
-    char expr[40] = {0};
-    char ismi[30] = {0};
-
-    if (mc665_take_lock(obj))
-    {
-        if (0 == at_exec_cmd(obj->resp, "AT+CIMI?"))
-        {
-            snprintf(expr, sizeof(expr), "+CIMI: %%%ds", sizeof(ismi) - 1);
-            ret = ((obj->resp->line_counts >= 2) && (1 == at_resp_parse_line_args(obj->resp, 2, expr, ismi)));
+    char imsi[MC665_IMSI_LEN + 1] = {0};
 
-            if (ret && buf && (len > strlen(ismi)))
-            {
-                memcpy(buf, ismi, strlen(ismi));
-            }
-        }
+    ret = private_mc665_query_cimi(obj, imsi);
 
-        mc665_release_lock(obj);
+    if (ret && buf && (len > strlen(imsi)))
+    {
+        memcpy(buf, imsi, strlen(imsi) + 1);
     }
 
     return ret;
@@ -414,33 +500,13 @@ bool mc665_read_imsi(mc665_drv_t *obj, void *buf, uint32_t len)
 // 设置APN
 bool mc665_set_apn(mc665_drv_t *obj)
 {
-    bool ret = false;
-
-    if (mc665_take_lock(obj))
-    {
-        ret = (0 == at_exec_cmd(obj->resp, "AT+CGDCONT=1,\"IP\""));
-        mc665_release_lock(obj);
-    }
-
-    return ret;
+    return private_mc665_exec_set_apn(obj);
 }
 
 // 读取信号强度
 bool mc665_get_csq(mc665_drv_t *obj, int *signal_intensity, int *bit_error_rate)
 {
-    bool ret = false;
-
-    if (mc665_take_lock(obj))
-    {
-        if (signal_intensity && bit_error_rate && (0 == at_exec_cmd(obj->resp, "AT+CSQ?")))
-        {
-            ret = ((obj->resp->line_counts >= 2) && (2 == at_resp_parse_line_args(obj->resp, 2, "+CSQ: %d,%d", signal_intensity, bit_error_rate)));
-        }
-
-        mc665_release_lock(obj);
-    }
-
-    return ret;
+    return signal_intensity && bit_error_rate && private_mc665_query_csq(obj, signal_intensity, bit_error_rate);
 }
 
 // 查询网络自动注册情况,act值参考mc665_act_def
@@ -448,31 +514,21 @@ bool mc665_get_operator_info(mc665_drv_t *obj, void *buf, uint32_t len, int *act
 {
     int temp_act = 0;
     bool ret = false;
-    char operator[20] = {0};
-    char expr[40] = {0};
+    char operator[MC665_OPERATOR_LEN + 1] = {0};
 
-    if (mc665_take_lock(obj))
+    ret = private_mc665_query_cops(obj, operator, &temp_act);
+
+    if (ret)
     {
-        if (0 == at_exec_cmd(obj->resp, "AT+COPS?"))
+        if (buf && (len > strlen(operator)))
         {
-            snprintf(expr, sizeof(expr), "+COPS: %%*d,%%*d,\"%%%d[^\"]\",%%d", sizeof(operator) - 1);
-            ret = ((obj->resp->line_counts >= 2) && (2 == at_resp_parse_line_args(obj->resp, 2, expr, operator, & temp_act)));
-
-            if (ret)
-            {
-                if (buf && (len > strlen(operator)))
-                {
-                    memcpy(buf, operator, strlen(operator));
-                }
-
-                if (act)
-                {
-                    *act = temp_act;
-                }
-            }
+            memcpy(buf, operator, strlen(operator) + 1);
         }
 
-        mc665_release_lock(obj);
+        if (act)
+        {
+            *act = temp_act;
+        }
     }
 
     return ret;
@@ -481,89 +537,36 @@ bool mc665_get_operator_info(mc665_drv_t *obj, void *buf, uint32_t len, int *act
 // 查询GPRS是否注册
 bool mc665_ps_is_registered(mc665_drv_t *obj)
 {
-    int temp = 0;
+    int mode = 0;
     int status = 0;
-    bool ret = false;
-
-    if (mc665_take_lock(obj))
-    {
-        if (0 == at_exec_cmd(obj->resp, "AT+CGREG?"))
-        {
-            ret = ((obj->resp->line_counts >= 2) && (2 == at_resp_parse_line_args(obj->resp, 2, "+CGREG: %d,%d", &temp, &status)));
-            ret = ret && ((1 == status) || (5 == status));
-        }
 
-        mc665_release_lock(obj);
-    }
-
-    return ret;
+    return private_mc665_query_cgreg(obj, &mode, &status) && ((1 == status) || (5 == status));
 }
 
 // 查询EPS是否注册（查询4G数据业务可用状态）
 bool mc665_lte_is_registered(mc665_drv_t *obj)
 {
-    int temp = 0;
+    int mode = 0;
     int status = 0;
-    bool ret = false;
 
-    if (mc665_take_lock(obj))
-    {
-        if (0 == at_exec_cmd(obj->resp, "AT+CEREG?"))
-        {
-            ret = ((obj->resp->line_counts >= 2) && (2 == at_resp_parse_line_args(obj->resp, 2, "+CEREG: %d,%d", &temp, &status)));
-            ret = ret && ((1 == status) || (5 == status));
-        }
-
-        mc665_release_lock(obj);
-    }
-
-    return ret;
+    return private_mc665_query_cereg(obj, &mode, &status) && ((1 == status) || (5 == status));
 }
 
 // 查询CS域是否注册 (语言业务)
 bool mc665_cs_is_registered(mc665_drv_t *obj)
 {
-    int temp = 0;
+    int mode = 0;
     int status = 0;
-    bool ret = false;
-
-    if (mc665_take_lock(obj))
-    {
-        if (0 == at_exec_cmd(obj->resp, "AT+CREG?"))
-        {
-            ret = ((obj->resp->line_counts >= 2) && (2 == at_resp_parse_line_args(obj->resp, 2, "+CREG: %d,%d", &temp, &status)));
-            ret = ret && ((1 == status) || (5 == status));
-        }
 
-        mc665_release_lock(obj);
-    }
-
-    return ret;
+    return private_mc665_query_creg(obj, &mode, &status) && ((1 == status) || (5 == status));
 }
 
 // 尝试请求运营商分配IP
 bool mc665_request_ip(mc665_drv_t *obj)
 {
-    bool ret = false;
-    char ip[20] = {0};
-    char expr[40] = {0};
-
-    if (mc665_take_lock(obj))
-    {
-        at_resp_set_info(obj->resp, MC665_RECV_BUF_SIZE, 4, 30000);
-
-        if (0 == at_exec_cmd(obj->resp, "AT+MIPCALL=1"))
-        {
-            snprintf(expr, sizeof(expr), "+MIPCALL: %%%ds", sizeof(ip) - 1);
-            ret = ((obj->resp->line_counts >= 4) && (1 == at_resp_parse_line_args(obj->resp, 4, expr, ip)));
-        }
-
-        at_resp_set_info(obj->resp, MC665_RECV_BUF_SIZE, 0, MC665_RECV_TIMEOUT);
-
-        mc665_release_lock(obj);
-    }
+    char ip[MC665_IP_LEN + 1] = {0};
 
-    return ret;
+    return private_mc665_query_mipcall_request(obj, ip);
 }
 
 // 查询当前IP
@@ -571,30 +574,13 @@ bool mc665_is_get_ip(mc665_drv_t *obj, void *buf, uint32_t len)
 {
     bool ret = false;
     int requested = 0;
-    char ip[20] = {0};
-    char expr[40] = {0};
-
-    if (mc665_take_lock(obj))
-    {
-        at_resp_set_info(obj->resp, MC665_RECV_BUF_SIZE, 0, 30000);
+    char ip[MC665_IP_LEN + 1] = {0};
 
-        if (0 == at_exec_cmd(obj->resp, "AT+MIPCALL?"))
-        {
-            snprintf(expr, sizeof(expr), "+MIPCALL: %%d,%%%ds", sizeof(ip) - 1);
-
-            if ((obj->resp->line_counts >= 2) && (2 == at_resp_parse_line_args(obj->resp, 2, expr, &requested, ip) && requested))
-            {
-                ret = true;
-
-                if (buf && len > strlen(ip))
-                {
-                    memcpy(buf, ip, strlen(ip) + 1);
-                }
-            }
-        }
+    ret = private_mc665_query_mipcall(obj, &requested, ip) && requested;
 
-        at_resp_set_info(obj->resp, MC665_RECV_BUF_SIZE, 0, 10000);
-        mc665_release_lock(obj);
+    if (ret && buf && (len > strlen(ip)))
+    {
+        memcpy(buf, ip, strlen(ip) + 1);
     }
 
     return ret;
@@ -5,6 +5,8 @@
 #include "freertos/event_groups.h"
 #include "freertos/semphr.h"
 
+#define MC665_URC_NUM 4
+
 /* access technology selected */
 typedef enum
 {
@@ -56,8 +58,30 @@ typedef struct
     void (*func)(void *param, mc665_event_def event);
 } mc665_event_cb_t;
 
+/* AT指令描述，指令在编译期预编码（含结束符），执行时无需格式化 */
+typedef struct
+{
+    const char *cmd;
+    rt_size_t cmd_len;
+    /* 应答行前缀，用于查找需要解析的行 */
+    const char *prefix;
+    /* 应答字段解析表达式 */
+    const char *expr;
+    int field_num;
+    rt_size_t line_num;
+    rt_int32_t timeout;
+    /* 执行失败后的重试次数 */
+    int retry;
+} mc665_cmd_t;
+
+#define MC665_CMD_INIT(_cmd_, _prefix_, _expr_, _field_num_, _line_num_, _timeout_, _retry_) \
+    {_cmd_ "\r\n", sizeof(_cmd_ "\r\n") - 1, _prefix_, _expr_, _field_num_, _line_num_, _timeout_, _retry_}
+
 typedef struct
 {
+    /* 模组所连接的AT客户端，为空时使用第一个AT客户端 */
+    at_client_t client;
+    struct at_urc urc_table[MC665_URC_NUM];
     at_response_t resp;
     TaskHandle_t task;
     mc665_status_def status;
@@ -65,12 +89,16 @@ typedef struct
     /* 用于保护多条AT指令执行过程不被干扰 */
     SemaphoreHandle_t  mutex;
     mc665_event_cb_t event_cb;
+    /* 模组重新检测到或重新获取IP时加1，缓存模组内部状态的子模块据此判断缓存失效 */
+    volatile uint32_t session;
 } mc665_drv_t;
 
 void mc665_register_callback(mc665_drv_t *obj, mc665_event_cb_t *cb);
 bool mc665_init(mc665_drv_t *obj);
 bool mc665_take_lock(mc665_drv_t *obj);
 void mc665_release_lock(mc665_drv_t *obj);
+bool mc665_cmd_exec(mc665_drv_t *obj, const mc665_cmd_t *cmd);
+bool mc665_cmd_query(mc665_drv_t *obj, const mc665_cmd_t *cmd, ...);
 bool mc665_detect(mc665_drv_t *obj);
 bool mc665_disable_echo(mc665_drv_t *obj);
 bool mc665_set_network_search_priority(mc665_drv_t *obj);
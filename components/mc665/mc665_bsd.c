@@ -0,0 +1,519 @@
+#include "mc665_bsd.h"
+#include "esp_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 多个模组同时等待时的轮询间隔(ms) */
+#define MC665_BSD_POLL_INTERVAL 10
+
+typedef struct
+{
+    bool used;
+    bool nonblock;
+    mc665_socket_type_def type;
+    /* 模组socket编号，未连接时为-1 */
+    int id;
+    uint32_t recv_timeout;
+} mc665_bsd_sock_t;
+
+typedef struct mc665_bsd_ctx
+{
+    mc665_socket_drv_t *drv;
+    SemaphoreHandle_t lock;
+    /* 在注册表中的序号，决定描述符的编号区间 */
+    int index;
+    mc665_bsd_sock_t sock[MC665_SOCKET_NUM];
+} mc665_bsd_ctx_t;
+
+static const char *TAG = "mc665_bsd";
+/* 只记录已注册的模组，描述符状态保存在各模组的上下文中 */
+static mc665_bsd_ctx_t *s_mc665_bsd_ctx[MC665_BSD_MODEM_MAX] = {0};
+
+static uint32_t private_mc665_bsd_timeval_to_ticks(const struct timeval *tv)
+{
+    return (tv) ? (pdMS_TO_TICKS(tv->tv_sec * 1000 + tv->tv_usec / 1000)) : (portMAX_DELAY);
+}
+
+static mc665_bsd_ctx_t *private_mc665_bsd_ctx(int s)
+{
+    return ((s >= 0) && (s < MC665_BSD_MODEM_MAX * MC665_SOCKET_NUM)) ? (s_mc665_bsd_ctx[s / MC665_SOCKET_NUM]) : (NULL);
+}
+
+static mc665_bsd_sock_t *private_mc665_bsd_find(int s, mc665_bsd_ctx_t **ctx)
+{
+    mc665_bsd_ctx_t *obj = private_mc665_bsd_ctx(s);
+
+    if (!obj || !obj->sock[s % MC665_SOCKET_NUM].used)
+    {
+        return NULL;
+    }
+
+    (ctx) ? (*ctx = obj) : (0);
+
+    return &obj->sock[s % MC665_SOCKET_NUM];
+}
+
+static mc665_bsd_sock_t *private_mc665_bsd_get(int s, mc665_bsd_ctx_t **ctx)
+{
+    mc665_bsd_sock_t *sock = private_mc665_bsd_find(s, ctx);
+
+    (!sock) ? (errno = EBADF) : (0);
+
+    return sock;
+}
+
+// 判断socket是否可读，有数据或对端已关闭时可读
+static bool private_mc665_bsd_readable(mc665_bsd_sock_t *sock, uint32_t ready)
+{
+    return (sock->id >= 0) && (ready & (1u << sock->id));
+}
+
+static bool private_mc665_bsd_writable(mc665_bsd_ctx_t *ctx, mc665_bsd_sock_t *sock)
+{
+    return mc665_socket_is_connected(ctx->drv, sock->id);
+}
+
+// 等待各模组上的socket可读，只有一个模组时直接阻塞在该模组上，否则轮询
+static void private_mc665_bsd_wait(const uint32_t *mask, uint32_t *ready, uint32_t ticks)
+{
+    int num = 0;
+    int last = -1;
+    bool any = false;
+    TickType_t start = xTaskGetTickCount();
+
+    for (int i = 0; i < MC665_BSD_MODEM_MAX; i++)
+    {
+        ready[i] = 0;
+
+        if (mask[i])
+        {
+            num++;
+            last = i;
+        }
+    }
+
+    if (!num)
+    {
+        if (ticks)
+        {
+            vTaskDelay(ticks);
+        }
+        return;
+    }
+
+    if (1 == num)
+    {
+        ready[last] = mc665_socket_poll(s_mc665_bsd_ctx[last]->drv, mask[last], ticks);
+        return;
+    }
+
+    while (1)
+    {
+        for (int i = 0; i < MC665_BSD_MODEM_MAX; i++)
+        {
+            ready[i] = (mask[i]) ? (mc665_socket_poll(s_mc665_bsd_ctx[i]->drv, mask[i], 0)) : (0);
+            (ready[i]) ? (any = true) : (0);
+        }
+
+        if (any || ((xTaskGetTickCount() - start) >= ticks))
+        {
+            break;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(MC665_BSD_POLL_INTERVAL));
+    }
+}
+
+bool mc665_bsd_init(mc665_socket_drv_t *drv)
+{
+    int slot = -1;
+    mc665_bsd_ctx_t *ctx = NULL;
+
+    if (!drv)
+    {
+        ESP_LOGE(TAG, "The MC665 socket driver is NULL!");
+        return false;
+    }
+
+    // 重复初始化时保留已打开的描述符
+    if (drv->bsd)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < MC665_BSD_MODEM_MAX; i++)
+    {
+        if (!s_mc665_bsd_ctx[i])
+        {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0)
+    {
+        ESP_LOGE(TAG, "Too many modems, at most %d", MC665_BSD_MODEM_MAX);
+        return false;
+    }
+
+    ctx = calloc(1, sizeof(mc665_bsd_ctx_t));
+
+    if (!ctx)
+    {
+        ESP_LOGE(TAG, "Create bsd context failed! memory not enough");
+        return false;
+    }
+
+    ctx->lock = xSemaphoreCreateMutex();
+
+    if (!ctx->lock)
+    {
+        ESP_LOGE(TAG, "Create mutex object failed! memory not enough");
+        free(ctx);
+        return false;
+    }
+
+    ctx->drv = drv;
+    ctx->index = slot;
+    drv->bsd = ctx;
+    s_mc665_bsd_ctx[slot] = ctx;
+
+    return true;
+}
+
+int mc665_bsd_socket(int domain, int type, int protocol)
+{
+    if (!s_mc665_bsd_ctx[0])
+    {
+        errno = ENETDOWN;
+        return -1;
+    }
+
+    return mc665_bsd_socket_on(s_mc665_bsd_ctx[0]->drv, domain, type, protocol);
+}
+
+int mc665_bsd_socket_on(mc665_socket_drv_t *drv, int domain, int type, int protocol)
+{
+    int s = -1;
+    mc665_bsd_ctx_t *ctx = (drv) ? (drv->bsd) : (NULL);
+
+    if (!ctx)
+    {
+        errno = ENETDOWN;
+        return -1;
+    }
+
+    if (AF_INET != domain)
+    {
+        errno = EAFNOSUPPORT;
+        return -1;
+    }
+
+    if ((SOCK_STREAM != type) && (SOCK_DGRAM != type))
+    {
+        errno = EPROTONOSUPPORT;
+        return -1;
+    }
+
+    xSemaphoreTake(ctx->lock, portMAX_DELAY);
+
+    for (int i = 0; i < MC665_SOCKET_NUM; i++)
+    {
+        if (!ctx->sock[i].used)
+        {
+            s = ctx->index * MC665_SOCKET_NUM + i;
+            ctx->sock[i].used = true;
+            ctx->sock[i].nonblock = false;
+            ctx->sock[i].type = (SOCK_STREAM == type) ? (MC665_SOCKET_TCP) : (MC665_SOCKET_UDP);
+            ctx->sock[i].id = -1;
+            ctx->sock[i].recv_timeout = portMAX_DELAY;
+            break;
+        }
+    }
+
+    xSemaphoreGive(ctx->lock);
+
+    (s < 0) ? (errno = ENFILE) : (0);
+
+    return s;
+}
+
+int mc665_bsd_connect(int s, const struct sockaddr *name, socklen_t namelen)
+{
+    char host[16] = {0};
+    mc665_bsd_ctx_t *ctx = NULL;
+    mc665_bsd_sock_t *sock = private_mc665_bsd_get(s, &ctx);
+    const struct sockaddr_in *addr = (const struct sockaddr_in *)name;
+
+    if (!sock)
+    {
+        return -1;
+    }
+
+    if (!name || (namelen < sizeof(struct sockaddr_in)) || (AF_INET != name->sa_family))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (sock->id >= 0)
+    {
+        errno = EISCONN;
+        return -1;
+    }
+
+    inet_ntop(AF_INET, &addr->sin_addr, host, sizeof(host));
+    sock->id = mc665_socket_open(ctx->drv, sock->type, host, ntohs(addr->sin_port), pdMS_TO_TICKS(MC665_BSD_CONNECT_TIMEOUT));
+
+    if (sock->id < 0)
+    {
+        errno = ECONNREFUSED;
+        return -1;
+    }
+
+    return 0;
+}
+
+int mc665_bsd_send(int s, const void *data, size_t size, int flags)
+{
+    int ret = 0;
+    mc665_bsd_ctx_t *ctx = NULL;
+    mc665_bsd_sock_t *sock = private_mc665_bsd_get(s, &ctx);
+
+    if (!sock)
+    {
+        return -1;
+    }
+
+    if (!private_mc665_bsd_writable(ctx, sock))
+    {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    ret = mc665_socket_send(ctx->drv, sock->id, data, size);
+    (ret < 0) ? (errno = EIO) : (0);
+
+    return ret;
+}
+
+int mc665_bsd_recv(int s, void *mem, size_t len, int flags)
+{
+    int ret = 0;
+    uint32_t timeout = 0;
+    mc665_bsd_ctx_t *ctx = NULL;
+    mc665_bsd_sock_t *sock = private_mc665_bsd_get(s, &ctx);
+
+    if (!sock)
+    {
+        return -1;
+    }
+
+    if (sock->id < 0)
+    {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    timeout = (sock->nonblock || (flags & MSG_DONTWAIT)) ? (0) : (sock->recv_timeout);
+    ret = mc665_socket_recv(ctx->drv, sock->id, mem, len, timeout);
+    (ret < 0) ? (errno = EAGAIN) : (0);
+
+    return ret;
+}
+
+int mc665_bsd_setsockopt(int s, int level, int optname, const void *optval, socklen_t optlen)
+{
+    mc665_bsd_sock_t *sock = private_mc665_bsd_get(s, NULL);
+
+    if (!sock)
+    {
+        return -1;
+    }
+
+    // 目前只支持接收超时
+    if ((SOL_SOCKET != level) || (SO_RCVTIMEO != optname))
+    {
+        errno = ENOPROTOOPT;
+        return -1;
+    }
+
+    if (!optval || (optlen < sizeof(struct timeval)))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sock->recv_timeout = private_mc665_bsd_timeval_to_ticks(optval);
+    (0 == sock->recv_timeout) ? (sock->recv_timeout = portMAX_DELAY) : (0);
+
+    return 0;
+}
+
+int mc665_bsd_fcntl(int s, int cmd, int val)
+{
+    mc665_bsd_sock_t *sock = private_mc665_bsd_get(s, NULL);
+
+    if (!sock)
+    {
+        return -1;
+    }
+
+    switch (cmd)
+    {
+    case F_GETFL:
+        return O_RDWR | ((sock->nonblock) ? (O_NONBLOCK) : (0));
+    case F_SETFL:
+        sock->nonblock = (val & O_NONBLOCK) ? (true) : (false);
+        return 0;
+    default:
+        errno = ENOSYS;
+        return -1;
+    }
+}
+
+int mc665_bsd_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset, struct timeval *timeout)
+{
+    int count = 0;
+    mc665_bsd_ctx_t *ctx = NULL;
+    mc665_bsd_sock_t *sock = NULL;
+    uint32_t mask[MC665_BSD_MODEM_MAX] = {0};
+    uint32_t ready[MC665_BSD_MODEM_MAX] = {0};
+    fd_set rset;
+    fd_set wset;
+    uint32_t ticks = private_mc665_bsd_timeval_to_ticks(timeout);
+
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    (maxfdp1 > MC665_BSD_MODEM_MAX * MC665_SOCKET_NUM) ? (maxfdp1 = MC665_BSD_MODEM_MAX * MC665_SOCKET_NUM) : (0);
+
+    for (int s = 0; s < maxfdp1; s++)
+    {
+        sock = private_mc665_bsd_find(s, &ctx);
+
+        if (!sock)
+        {
+            continue;
+        }
+
+        (readset && FD_ISSET(s, readset) && (sock->id >= 0)) ? (mask[ctx->index] |= (1u << sock->id)) : (0);
+
+        if (writeset && FD_ISSET(s, writeset) && private_mc665_bsd_writable(ctx, sock))
+        {
+            FD_SET(s, &wset);
+            count++;
+        }
+    }
+
+    // 已有可写的socket时不再等待
+    private_mc665_bsd_wait(mask, ready, (count) ? (0) : (ticks));
+
+    for (int s = 0; s < maxfdp1; s++)
+    {
+        sock = private_mc665_bsd_find(s, &ctx);
+
+        if (readset && FD_ISSET(s, readset) && sock && private_mc665_bsd_readable(sock, ready[ctx->index]))
+        {
+            FD_SET(s, &rset);
+            count++;
+        }
+    }
+
+    if (readset)
+    {
+        *readset = rset;
+    }
+
+    if (writeset)
+    {
+        *writeset = wset;
+    }
+
+    if (exceptset)
+    {
+        FD_ZERO(exceptset);
+    }
+
+    return count;
+}
+
+int mc665_bsd_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    int count = 0;
+    mc665_bsd_ctx_t *ctx = NULL;
+    mc665_bsd_sock_t *sock = NULL;
+    uint32_t mask[MC665_BSD_MODEM_MAX] = {0};
+    uint32_t ready[MC665_BSD_MODEM_MAX] = {0};
+    uint32_t ticks = (timeout < 0) ? (portMAX_DELAY) : (pdMS_TO_TICKS(timeout));
+
+    for (nfds_t i = 0; i < nfds; i++)
+    {
+        fds[i].revents = 0;
+
+        /* 负的描述符按POSIX忽略，常用于临时禁用某一项 */
+        if (fds[i].fd < 0)
+        {
+            continue;
+        }
+
+        sock = private_mc665_bsd_find(fds[i].fd, &ctx);
+
+        if (!sock)
+        {
+            fds[i].revents = POLLNVAL;
+        }
+        else
+        {
+            ((fds[i].events & POLLIN) && (sock->id >= 0)) ? (mask[ctx->index] |= (1u << sock->id)) : (0);
+            ((fds[i].events & POLLOUT) && private_mc665_bsd_writable(ctx, sock)) ? (fds[i].revents |= POLLOUT) : (0);
+        }
+
+        (fds[i].revents) ? (count++) : (0);
+    }
+
+    private_mc665_bsd_wait(mask, ready, (count) ? (0) : (ticks));
+
+    for (nfds_t i = 0; i < nfds; i++)
+    {
+        if ((fds[i].fd < 0) || (fds[i].revents & POLLNVAL) || !(fds[i].events & POLLIN))
+        {
+            continue;
+        }
+
+        sock = private_mc665_bsd_find(fds[i].fd, &ctx);
+
+        if (sock && private_mc665_bsd_readable(sock, ready[ctx->index]))
+        {
+            (!fds[i].revents) ? (count++) : (0);
+            fds[i].revents |= POLLIN;
+            (!mc665_socket_is_connected(ctx->drv, sock->id)) ? (fds[i].revents |= POLLHUP) : (0);
+        }
+    }
+
+    return count;
+}
+
+int mc665_bsd_close(int s)
+{
+    mc665_bsd_ctx_t *ctx = NULL;
+    mc665_bsd_sock_t *sock = private_mc665_bsd_get(s, &ctx);
+
+    if (!sock)
+    {
+        return -1;
+    }
+
+    if (sock->id >= 0)
+    {
+        mc665_socket_close(ctx->drv, sock->id);
+    }
+
+    xSemaphoreTake(ctx->lock, portMAX_DELAY);
+    sock->id = -1;
+    sock->used = false;
+    xSemaphoreGive(ctx->lock);
+
+    return 0;
+}
\ No newline at end of file
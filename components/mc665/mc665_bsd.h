@@ -0,0 +1,32 @@
+#pragma once
+
+#include "mc665_socket.h"
+#include "lwip/sockets.h"
+#include <sys/select.h>
+#include <poll.h>
+
+/*
+ * BSD风格的socket接口，底层使用模组内部的TCP/UDP socket
+ * 描述符只在本接口内有效，不能与lwip/VFS的描述符混用
+ * 每个模组的描述符表挂在各自的socket驱动上，描述符编号为 模组序号*MC665_SOCKET_NUM+槽位
+ */
+
+/* 可同时注册的模组数量 */
+#define MC665_BSD_MODEM_MAX 2
+
+/* 建立连接的超时时间(ms) */
+#define MC665_BSD_CONNECT_TIMEOUT 30000
+
+bool mc665_bsd_init(mc665_socket_drv_t *drv);
+/* 在第一个注册的模组上创建socket */
+int mc665_bsd_socket(int domain, int type, int protocol);
+/* 在指定模组上创建socket，drv需先经过mc665_bsd_init */
+int mc665_bsd_socket_on(mc665_socket_drv_t *drv, int domain, int type, int protocol);
+int mc665_bsd_connect(int s, const struct sockaddr *name, socklen_t namelen);
+int mc665_bsd_send(int s, const void *data, size_t size, int flags);
+int mc665_bsd_recv(int s, void *mem, size_t len, int flags);
+int mc665_bsd_setsockopt(int s, int level, int optname, const void *optval, socklen_t optlen);
+int mc665_bsd_fcntl(int s, int cmd, int val);
+int mc665_bsd_select(int maxfdp1, fd_set *readset, fd_set *writeset, fd_set *exceptset, struct timeval *timeout);
+int mc665_bsd_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int mc665_bsd_close(int s);
\ No newline at end of file
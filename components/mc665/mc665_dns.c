@@ -0,0 +1,342 @@
+#include "mc665_dns.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <string.h>
+
+#define DNS_RESOLVE_DONE_BIT BIT0
+
+#define MC665_DNS_NVS_NAMESPACE "mc665_dns"
+#define MC665_DNS_NVS_KEY "cache"
+
+static const char *TAG = "mc665_dns";
+
+static int64_t private_mc665_dns_ttl_us(mc665_dns_drv_t *obj)
+{
+    return (int64_t)((obj->ttl) ? (obj->ttl) : (MC665_DNS_DEFAULT_TTL)) * 1000000;
+}
+
+static bool private_mc665_dns_is_ip(const char *host)
+{
+    char ch = 0;
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+
+    return (4 == sscanf(host, "%u.%u.%u.%u%c", &a, &b, &c, &d, &ch)) && (a < 256) && (b < 256) && (c < 256) && (d < 256);
+}
+
+static void private_mc665_dns_load(mc665_dns_drv_t *obj)
+{
+    nvs_handle_t handle = 0;
+    size_t size = sizeof(obj->cache);
+    int64_t expire = esp_timer_get_time() + private_mc665_dns_ttl_us(obj);
+
+    if (ESP_OK != nvs_open(MC665_DNS_NVS_NAMESPACE, NVS_READONLY, &handle))
+    {
+        return;
+    }
+
+    if ((ESP_OK != nvs_get_blob(handle, MC665_DNS_NVS_KEY, obj->cache, &size)) || (sizeof(obj->cache) != size))
+    {
+        memset(obj->cache, 0, sizeof(obj->cache));
+    }
+
+    nvs_close(handle);
+
+    /* 重启后时间基准已变化，按加载时刻重新计算过期时间 */
+    for (int i = 0; i < MC665_DNS_CACHE_NUM; i++)
+    {
+        obj->cache[i].host[MC665_DNS_HOST_LEN - 1] = '\0';
+        obj->cache[i].ip[MC665_DNS_IP_LEN - 1] = '\0';
+        obj->cache[i].expire = (obj->cache[i].expire && private_mc665_dns_is_ip(obj->cache[i].ip)) ? (expire) : (0);
+    }
+}
+
+static void private_mc665_dns_save(mc665_dns_drv_t *obj)
+{
+    nvs_handle_t handle = 0;
+    mc665_dns_entry_t cache[MC665_DNS_CACHE_NUM];
+
+    if (!obj->persist)
+    {
+        return;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        memcpy(cache, obj->cache, sizeof(cache));
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (ESP_OK == nvs_open(MC665_DNS_NVS_NAMESPACE, NVS_READWRITE, &handle))
+    {
+        if ((ESP_OK != nvs_set_blob(handle, MC665_DNS_NVS_KEY, cache, sizeof(cache))) || (ESP_OK != nvs_commit(handle)))
+        {
+            ESP_LOGW(TAG, "dns cache save failed");
+        }
+
+        nvs_close(handle);
+    }
+}
+
+static void private_mc665_dns_insert(mc665_dns_drv_t *obj, const char *host, const char *ip)
+{
+    int index = 0;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        /* 优先覆盖同名的记录，否则替换最早过期的记录 */
+        for (int i = 0; i < MC665_DNS_CACHE_NUM; i++)
+        {
+            if (!strcmp(obj->cache[i].host, host))
+            {
+                index = i;
+                break;
+            }
+
+            (obj->cache[i].expire < obj->cache[index].expire) ? (index = i) : (0);
+        }
+
+        snprintf(obj->cache[index].host, sizeof(obj->cache[index].host), "%s", host);
+        snprintf(obj->cache[index].ip, sizeof(obj->cache[index].ip), "%s", ip);
+        obj->cache[index].expire = esp_timer_get_time() + private_mc665_dns_ttl_us(obj);
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
+static void private_mc665_dns_handler(struct at_client *client, const char *data, rt_size_t size, void *param)
+{
+    char *ip = NULL;
+    unsigned int a = 0, b = 0, c = 0, d = 0;
+    mc665_dns_drv_t *obj = (mc665_dns_drv_t *)param;
+
+    client->recv_line_buf[size - 1] = '\0';
+    ESP_LOGD(TAG, "%s", client->recv_line_buf);
+
+    /* +MIPDNS: "<domain>",<ip1>[,<ip2>] */
+    ip = strchr(client->recv_line_buf, ',');
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        obj->result[0] = '\0';
+
+        if (ip)
+        {
+            for (ip = ip + 1; (' ' == *ip) || ('"' == *ip); ip++)
+            {
+            }
+
+            if (4 == sscanf(ip, "%u.%u.%u.%u", &a, &b, &c, &d))
+            {
+                snprintf(obj->result, sizeof(obj->result), "%u.%u.%u.%u", a, b, c, d);
+            }
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    xEventGroupSetBits(obj->event, DNS_RESOLVE_DONE_BIT);
+}
+
+bool mc665_dns_init(mc665_dns_drv_t *obj)
+{
+    bool ret = false;
+
+    if (!obj->drv)
+    {
+        ESP_LOGE(TAG, "The MC665 driver is NULL! please pass the mc665_drv_t pointer and retry!");
+        goto __exit;
+    }
+
+    obj->event = xEventGroupCreate();
+    if (!obj->event)
+    {
+        ESP_LOGE(TAG, "Create event_group object failed! memory not enough");
+        goto __exit;
+    }
+
+    obj->mutex = xSemaphoreCreateMutex();
+    if (!obj->mutex)
+    {
+        ESP_LOGE(TAG, "Create mutex object failed! memory not enough");
+        goto __exit;
+    }
+
+    obj->resolve_lock = xSemaphoreCreateMutex();
+    if (!obj->resolve_lock)
+    {
+        ESP_LOGE(TAG, "Create mutex object failed! memory not enough");
+        goto __exit;
+    }
+
+    memset(obj->cache, 0, sizeof(obj->cache));
+
+    if (obj->persist)
+    {
+        private_mc665_dns_load(obj);
+    }
+
+    /* 初始化URC */
+    obj->urc_table[0].cmd_prefix = "+MIPDNS:";
+    obj->urc_table[0].cmd_suffix = "\r\n";
+    obj->urc_table[0].func = private_mc665_dns_handler;
+    obj->urc_table[0].param = obj;
+    if (at_obj_set_urc_table(obj->drv->client, obj->urc_table, 1))
+    {
+        ESP_LOGE(TAG, "at client urc_table initial fail");
+        goto __exit;
+    }
+
+    ret = true;
+    ESP_LOGI(TAG, "MC665 dns resource alloc success");
+
+__exit:
+
+    if (!ret)
+    {
+        if (obj->event)
+        {
+            vEventGroupDelete(obj->event);
+            obj->event = NULL;
+        }
+
+        if (obj->mutex)
+        {
+            vSemaphoreDelete(obj->mutex);
+            obj->mutex = NULL;
+        }
+
+        if (obj->resolve_lock)
+        {
+            vSemaphoreDelete(obj->resolve_lock);
+            obj->resolve_lock = NULL;
+        }
+
+        ESP_LOGE(TAG, "MC665 dns resource alloc fail");
+    }
+
+    return ret;
+}
+
+// 只查询缓存，不向模组发起解析
+bool mc665_dns_lookup(mc665_dns_drv_t *obj, const char *host, char *ip, uint32_t len)
+{
+    bool ret = false;
+    int64_t now = esp_timer_get_time();
+
+    if (!obj || !obj->mutex || !host)
+    {
+        return false;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        for (int i = 0; i < MC665_DNS_CACHE_NUM; i++)
+        {
+            if ((obj->cache[i].expire > now) && !strcmp(obj->cache[i].host, host))
+            {
+                snprintf(ip, len, "%s", obj->cache[i].ip);
+                ret = true;
+                break;
+            }
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+bool mc665_dns_resolve(mc665_dns_drv_t *obj, const char *host, char *ip, uint32_t len, uint32_t timeout)
+{
+    bool ret = false;
+    char result[MC665_DNS_IP_LEN] = {0};
+
+    if (!obj || !obj->mutex || !host || (strlen(host) >= MC665_DNS_HOST_LEN))
+    {
+        return false;
+    }
+
+    if (private_mc665_dns_is_ip(host))
+    {
+        snprintf(ip, len, "%s", host);
+        return true;
+    }
+
+    if (mc665_dns_lookup(obj, host, ip, len))
+    {
+        ESP_LOGD(TAG, "%s cache hit: %s", host, ip);
+        return true;
+    }
+
+    // 解析结果通过URC返回，模组锁只在发送指令期间持有，等待URC时由resolve_lock保证只有一个解析
+    if (pdTRUE == xSemaphoreTake(obj->resolve_lock, portMAX_DELAY))
+    {
+        xEventGroupClearBits(obj->event, DNS_RESOLVE_DONE_BIT);
+
+        if (mc665_take_lock(obj->drv))
+        {
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MIPDNS=\"%s\"", host));
+            mc665_release_lock(obj->drv);
+        }
+
+        if (ret)
+        {
+            ret = false;
+
+            if ((DNS_RESOLVE_DONE_BIT & xEventGroupWaitBits(obj->event, DNS_RESOLVE_DONE_BIT, pdTRUE, pdFALSE, timeout)) &&
+                (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+            {
+                memcpy(result, obj->result, sizeof(result));
+                xSemaphoreGive(obj->mutex);
+                ret = ('\0' != result[0]);
+            }
+        }
+
+        xSemaphoreGive(obj->resolve_lock);
+    }
+
+    if (ret)
+    {
+        ESP_LOGI(TAG, "%s resolved: %s", host, result);
+        private_mc665_dns_insert(obj, host, result);
+        private_mc665_dns_save(obj);
+        snprintf(ip, len, "%s", result);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "%s resolve failed!", host);
+    }
+
+    return ret;
+}
+
+// 使用缓存地址连接失败时调用，下次连接将重新解析
+void mc665_dns_invalidate(mc665_dns_drv_t *obj, const char *host)
+{
+    bool found = false;
+
+    if (!obj || !obj->mutex || !host)
+    {
+        return;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        for (int i = 0; i < MC665_DNS_CACHE_NUM; i++)
+        {
+            if (!strcmp(obj->cache[i].host, host))
+            {
+                memset(&obj->cache[i], 0, sizeof(obj->cache[i]));
+                found = true;
+            }
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (found)
+    {
+        private_mc665_dns_save(obj);
+    }
+}
\ No newline at end of file
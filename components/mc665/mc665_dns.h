@@ -0,0 +1,43 @@
+#pragma once
+
+#include "mc665.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+/* 缓存的域名数量 */
+#define MC665_DNS_CACHE_NUM 4
+#define MC665_DNS_HOST_LEN 64
+#define MC665_DNS_IP_LEN 16
+/* 模组不返回TTL，缓存默认有效期(s) */
+#define MC665_DNS_DEFAULT_TTL 600
+
+typedef struct
+{
+    char host[MC665_DNS_HOST_LEN];
+    char ip[MC665_DNS_IP_LEN];
+    /* 过期时间(us)，0代表空闲 */
+    int64_t expire;
+} mc665_dns_entry_t;
+
+typedef struct
+{
+    mc665_drv_t *drv;
+    /* 缓存有效期(s)，为0时使用MC665_DNS_DEFAULT_TTL */
+    uint32_t ttl;
+    /* 将解析结果保存到NVS，重启后可直接使用 */
+    bool persist;
+    SemaphoreHandle_t mutex;
+    /* 同一时刻只允许一个解析等待URC，不占用模组锁 */
+    SemaphoreHandle_t resolve_lock;
+    EventGroupHandle_t event;
+    /* 最近一次解析的结果 */
+    char result[MC665_DNS_IP_LEN];
+    mc665_dns_entry_t cache[MC665_DNS_CACHE_NUM];
+    struct at_urc urc_table[1];
+} mc665_dns_drv_t;
+
+bool mc665_dns_init(mc665_dns_drv_t *obj);
+bool mc665_dns_lookup(mc665_dns_drv_t *obj, const char *host, char *ip, uint32_t len);
+bool mc665_dns_resolve(mc665_dns_drv_t *obj, const char *host, char *ip, uint32_t len, uint32_t timeout);
+void mc665_dns_invalidate(mc665_dns_drv_t *obj, const char *host);
\ No newline at end of file
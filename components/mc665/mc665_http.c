@@ -1,14 +1,21 @@
 #include "mc665_http.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #define HTTP_CONNECT_SUCCESS_BIT BIT0
 #define HTTP_CONNECT_FAIL_BIT BIT1
 #define HTTP_RECV_RESP_BIT BIT2
 #define HTTP_RECV_DATA_BIT BIT3
 
+#define MC665_HTTP_NVS_NAMESPACE "mc665_http"
+#define MC665_HTTP_NVS_KEY "validator"
+
 static const char *TAG = "mc665_http";
-static struct at_urc s_urc_table[1] = {0};
 static const char *s_http_param_table[MC665_HTTP_PARAM_NUM] = {
     "URL",
     "UAGENT",
@@ -28,6 +35,57 @@ static void private_mc665_http_set_event_bits(mc665_http_drv_t *obj, uint32_t bi
     }
 }
 
+// 将HTTPREAD的数据分段读入缓冲并交给sink，未设置流式读取时返回false
+static bool private_mc665_http_stream_data(mc665_http_drv_t *obj, struct at_client *client, int data_len)
+{
+    int seg_len = 0;
+    int recv_len = 0;
+    bool ret = false;
+    char tail[sizeof("\r\n\r\nOK\r\n")] = {0};
+    mc665_http_stream_t *stream = NULL;
+
+    if (pdTRUE != xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        return false;
+    }
+
+    stream = obj->stream;
+    ret = (NULL != stream);
+
+    /* sink拒绝数据或读取不完整后仍需读完剩余数据，保持串口数据同步，串口不再有数据时才放弃 */
+    while (stream && (data_len > 0))
+    {
+        seg_len = (data_len > MC665_HTTP_SEGMENT_SIZE) ? (MC665_HTTP_SEGMENT_SIZE) : (data_len);
+        recv_len = at_client_obj_recv(client, stream->buf, seg_len, 100);
+
+        if (recv_len <= 0)
+        {
+            stream->abort = true;
+            ESP_LOGE(TAG, "http stream read failed!");
+            break;
+        }
+
+        data_len -= recv_len;
+
+        if ((recv_len != seg_len) && !stream->abort)
+        {
+            stream->abort = true;
+            ESP_LOGE(TAG, "http stream read short, drop remaining %d bytes", data_len);
+        }
+
+        if (!stream->abort)
+        {
+            stream->abort = !stream->sink(stream->param, stream->buf, recv_len);
+            (!stream->abort) ? (stream->read_len += recv_len) : (0);
+        }
+    }
+
+    (stream && (data_len <= 0)) ? (at_client_obj_recv(client, tail, sizeof(tail) - 1, 20)) : (0);
+    xSemaphoreGive(obj->mutex);
+
+    return ret;
+}
+
 void mc665_http_handler(struct at_client *client, const char *data, rt_size_t size, void *param)
 {
     char expr[40] = {0};
@@ -58,7 +116,11 @@ void mc665_http_handler(struct at_client *client, const char *data, rt_size_t si
             /* 计算总共需要接收的长度 */
             total_len = data_len + sizeof("\r\n\r\nOK\r\n") - 1;
 
-            if (total_len > client->recv_bufsz)
+            if (private_mc665_http_stream_data(obj, client, data_len))
+            {
+                private_mc665_http_set_event_bits(obj, HTTP_RECV_DATA_BIT);
+            }
+            else if (total_len > client->recv_bufsz)
             {
                 ESP_LOGE(TAG, "Payload is too long, please readjust receive buf size(current:%d, actual:%d)!", client->recv_bufsz, total_len);
             }
@@ -131,102 +193,169 @@ void mc665_http_handler(struct at_client *client, const char *data, rt_size_t si
     }
 }
 
-static int private_mc665_http_parse_line(char *data, int length)
+typedef struct
 {
-    for (int i = 0; i < length; i++)
+    mc665_http_header_t *header;
+    char line[MC665_HTTP_HEADER_LINE_LEN];
+    int line_len;
+    int offset;
+    bool skip;
+    bool done;
+} mc665_http_header_parser_t;
+
+static const char *s_http_header_table[MC665_HTTP_HEADER_NUM] = {
+    "content-length",
+    "etag",
+    "content-range",
+    "content-encoding",
+    "location",
+    "last-modified"};
+
+static void private_mc665_http_parse_header_line(mc665_http_header_t *header, char *line)
+{
+    int name_len = 0;
+    char *value = strchr(line, ':');
+
+    /* 状态行: HTTP/1.1 200 OK */
+    if (!strncmp(line, "HTTP/", sizeof("HTTP/") - 1))
     {
-        if ('\n' == data[i])
-        {
-            data[i] = 0;
-            return i;
-        }
+        sscanf(line, "%*s %d", &header->status);
+        return;
     }
 
-    return length;
-}
-
-int mc665_read_content_length(mc665_http_drv_t *obj, int max_length)
-{
-    int temp = 0;
-    int ret = -1;
-    char *data = NULL;
-    int read_offset = 0;
-    int line_offset = 0;
-    char *line_buf = NULL;
-
-    line_buf = malloc(max_length);
-    data = malloc(max_length);
+    if (!value)
+    {
+        return;
+    }
 
-    if (!line_buf || !data)
+    name_len = value - line;
+    for (value = value + 1; (' ' == *value) || ('\t' == *value); value++)
     {
-        ESP_LOGE(TAG, "No memory to parse http line");
-        goto __exit;
     }
 
-    while ((read_offset < 2048) && (mc665_http_read_data(obj, read_offset, max_length, data, 5000) == max_length))
+    /* 头部名称不区分大小写 */
+    for (int i = 0; i < MC665_HTTP_HEADER_NUM; i++)
     {
-        temp = private_mc665_http_parse_line(data, max_length);
+        if ((strlen(s_http_header_table[i]) == name_len) && !strncasecmp(line, s_http_header_table[i], name_len))
+        {
+            snprintf(header->value[i], sizeof(header->value[i]), "%s", value);
+            (MC665_HTTP_HEADER_CONTENT_LENGTH == i) ? (header->content_length = atoi(value)) : (0);
+            break;
+        }
+    }
+}
+
+// 逐字节解析响应头，读到空行时返回false结束读取
+static bool private_mc665_http_header_sink(void *param, const void *data, int len)
+{
+    char ch = 0;
+    mc665_http_header_parser_t *parser = (mc665_http_header_parser_t *)param;
 
-        /* 根据是否查找到换行符，设置下一次读取的位置 */
-        read_offset = read_offset + temp;
-        (temp != max_length) ? (read_offset = read_offset + 1) : (0);
+    for (int i = 0; (i < len) && !parser->done; i++)
+    {
+        ch = ((const char *)data)[i];
+        parser->offset++;
 
-        if (-1 != line_offset)
+        if ('\n' == ch)
         {
-            if ((line_offset + temp) < max_length)
+            (parser->line_len && ('\r' == parser->line[parser->line_len - 1])) ? (parser->line_len--) : (0);
+            parser->line[parser->line_len] = '\0';
+
+            if (0 == parser->line_len)
             {
-                memcpy(line_buf + line_offset, data, temp);
-                line_offset += temp;
-                line_buf[line_offset] = 0;
+                parser->done = true;
+                parser->header->body_offset = parser->offset;
             }
-            else
+            else if (!parser->skip)
             {
-                line_offset = -1;
-                ESP_LOGW(TAG, "http data is overflow");
+                private_mc665_http_parse_header_line(parser->header, parser->line);
             }
+
+            parser->line_len = 0;
+            parser->skip = false;
         }
-        /* -1代表出现较长的单行数据，在接收到新的一行之前，该行数据将被忽略 */
-        else if (temp != max_length)
+        else if (parser->line_len < sizeof(parser->line) - 1)
         {
-            line_offset = 0;
+            parser->line[parser->line_len++] = ch;
         }
-
-        if ((max_length != temp) && line_offset)
+        else if (!parser->skip)
         {
-            /* 将header转换成小写（HTTP不区分大小写） */
-            for (int i = 0; (i < line_offset) && (':' != line_buf[i]); i++)
-            {
-                if (('A' <= line_buf[i]) && ('Z' >= line_buf[i]))
-                {
-                    line_buf[i] += 32;
-                }
-            }
+            parser->skip = true;
+            ESP_LOGW(TAG, "http header line is too long, ignored");
+        }
+    }
 
-            if (!memcmp(line_buf, "content-length:", sizeof("content-length:") - 1))
-            {
-                sscanf(line_buf, "content-length: %d", &ret);
-                break;
-            }
+    return !parser->done;
+}
 
-            line_offset = 0;
-        }
+// 按段读取响应头并解析到header表中，同时计算响应体的偏移
+// 只读取模组报告的长度，读到空行即停止，读完仍未找到空行时认为响应头被截断
+bool mc665_http_read_header(mc665_http_drv_t *obj, uint32_t timeout)
+{
+    bool ret = false;
+    int total = 0;
+    int read_len = 0;
+    int length = 0;
+    mc665_http_header_parser_t *parser = NULL;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        total = obj->resp.length;
+        xSemaphoreGive(obj->mutex);
     }
 
-__exit:
+    if (total <= 0)
+    {
+        ESP_LOGE(TAG, "http response length %d invalid", total);
+        return false;
+    }
+
+    parser = calloc(1, sizeof(mc665_http_header_parser_t));
+    if (!parser)
+    {
+        ESP_LOGE(TAG, "No memory to parse http header");
+        return false;
+    }
+
+    memset(&obj->header, 0, sizeof(obj->header));
+    obj->header.content_length = -1;
+    parser->header = &obj->header;
+    (total > MC665_HTTP_HEADER_MAX_LEN) ? (total = MC665_HTTP_HEADER_MAX_LEN) : (0);
 
-    if (line_buf)
+    while (!parser->done && (parser->offset < total))
     {
-        free(line_buf);
+        length = total - parser->offset;
+        (length > MC665_HTTP_SEGMENT_SIZE) ? (length = MC665_HTTP_SEGMENT_SIZE) : (0);
+        read_len = mc665_http_read_stream(obj, parser->offset, length, private_mc665_http_header_sink, parser, timeout);
+
+        if (!parser->done && (read_len != length))
+        {
+            break;
+        }
     }
 
-    if (data)
+    ret = parser->done;
+
+    if (!ret)
     {
-        free(data);
+        ESP_LOGE(TAG, "http header truncated at %d/%d", parser->offset, total);
     }
 
+    free(parser);
+
     return ret;
 }
 
+const char *mc665_http_get_header(mc665_http_drv_t *obj, mc665_http_header_def header)
+{
+    if ((header >= MC665_HTTP_HEADER_NUM) || ('\0' == obj->header.value[header][0]))
+    {
+        return NULL;
+    }
+
+    return obj->header.value[header];
+}
+
 bool mc665_http_init(mc665_http_drv_t *obj)
 {
     bool ret = false;
@@ -238,11 +367,11 @@ bool mc665_http_init(mc665_http_drv_t *obj)
     }
 
     /* 初始化URC */
-    s_urc_table[0].cmd_prefix = "+HTTP";
-    s_urc_table[0].cmd_suffix = "\r\n";
-    s_urc_table[0].func = mc665_http_handler;
-    s_urc_table[0].param = obj;
-    if (at_set_urc_table(s_urc_table, 1))
+    obj->urc_table[0].cmd_prefix = "+HTTP";
+    obj->urc_table[0].cmd_suffix = "\r\n";
+    obj->urc_table[0].func = mc665_http_handler;
+    obj->urc_table[0].param = obj;
+    if (at_obj_set_urc_table(obj->drv->client, obj->urc_table, 1))
     {
         ESP_LOGE(TAG, "at client urc_table initial fail");
         goto __exit;
@@ -287,16 +416,133 @@ __exit:
     return ret;
 }
 
+// 将http://地址中的域名替换为解析得到的IP，无需替换时返回NULL
+static char *private_mc665_http_resolve_url(mc665_http_drv_t *obj, const char *url, char *host, uint32_t host_len)
+{
+    int len = 0;
+    char *ret = NULL;
+    const char *path = NULL;
+    char ip[MC665_DNS_IP_LEN] = {0};
+    const char *scheme = "http://";
+
+    if (strncmp(url, scheme, strlen(scheme)))
+    {
+        return NULL;
+    }
+
+    url += strlen(scheme);
+    path = url + strcspn(url, ":/?");
+    len = path - url;
+
+    if ((len <= 0) || (len >= host_len))
+    {
+        return NULL;
+    }
+
+    memcpy(host, url, len);
+    host[len] = '\0';
+
+    if (mc665_dns_resolve(obj->dns, host, ip, sizeof(ip), pdMS_TO_TICKS(10000)) && strcmp(ip, host))
+    {
+        len = strlen(scheme) + strlen(ip) + strlen(path) + 1;
+        ret = malloc(len);
+        (ret) ? (snprintf(ret, len, "%s%s%s", scheme, ip, path)) : (0);
+    }
+
+    return ret;
+}
+
+// 记录模块中已设置的参数，value为NULL时代表参数状态未知，调用时需持有mutex
+static void private_mc665_http_cache_param(mc665_http_drv_t *obj, mc665_http_param_def header, const char *value)
+{
+    free(obj->param[header]);
+    obj->param[header] = (value) ? (strdup(value)) : (NULL);
+}
+
+static void private_mc665_http_reset_param(mc665_http_drv_t *obj)
+{
+    for (int i = 0; i < MC665_HTTP_PARAM_NUM; i++)
+    {
+        private_mc665_http_cache_param(obj, i, NULL);
+    }
+
+    obj->param_session = obj->drv->session;
+}
+
+// 判断参数是否已设置，模组重启或重新附着后清空缓存
+static bool private_mc665_http_param_cached(mc665_http_drv_t *obj, mc665_http_param_def header, const char *value)
+{
+    bool ret = false;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        if (obj->param_session != obj->drv->session)
+        {
+            private_mc665_http_reset_param(obj);
+        }
+
+        ret = obj->param[header] && !strcmp(obj->param[header], value);
+        (ret) ? (obj->stats.param_skip_num++) : (0);
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+// 模块重启或会话失效后调用，下一次设置参数时重新发送
+void mc665_http_reset_param(mc665_http_drv_t *obj)
+{
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        private_mc665_http_reset_param(obj);
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
 bool mc665_http_set_param(mc665_http_drv_t *obj, mc665_http_param_def header, const char *value)
 {
     bool ret = false;
+    char *url = NULL;
+    const char *param = NULL;
+    char host[MC665_DNS_HOST_LEN] = {0};
+
+    if (!value || (header >= MC665_HTTP_PARAM_NUM))
+    {
+        return false;
+    }
 
-    if ((header < MC665_HTTP_PARAM_NUM) && (mc665_take_lock(obj->drv)))
+    if ((MC665_HTTP_PARAM_URL == header) && (value != obj->url))
     {
-        ret = (0 == at_exec_cmd(obj->drv->resp, "AT+HTTPSET=\"%s\",\"%s\"", s_http_param_table[header], value));
+        free(obj->url);
+        obj->url = strdup(value);
+    }
+
+    if ((MC665_HTTP_PARAM_URL == header) && obj->dns)
+    {
+        url = private_mc665_http_resolve_url(obj, value, host, sizeof(host));
+    }
+
+    param = (url) ? (url) : (value);
+
+    if (private_mc665_http_param_cached(obj, header, param))
+    {
+        ret = true;
+    }
+    else if (mc665_take_lock(obj->drv))
+    {
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+HTTPSET=\"%s\",\"%s\"", s_http_param_table[header], param));
         mc665_release_lock(obj->drv);
+
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            private_mc665_http_cache_param(obj, header, (ret) ? (param) : (NULL));
+            xSemaphoreGive(obj->mutex);
+        }
     }
 
+    (MC665_HTTP_PARAM_URL == header) ? (obj->url_resolved = (ret && url)) : (0);
+    free(url);
+
     return ret;
 }
 
@@ -320,6 +566,8 @@ bool mc665_http_read_resp(mc665_http_drv_t *obj, mc665_http_resp_t *resp, uint32
 mc665_http_connect_status_def mc665_http_read_status(mc665_http_drv_t *obj, uint32_t timeout)
 {
     EventBits_t event = 0;
+    bool url_set = false;
+    char host[MC665_DNS_HOST_LEN] = {0};
     mc665_http_connect_status_def ret = MC665_HTTP_CONNECT_TIMEOUT;
 
     event = xEventGroupWaitBits(obj->event, HTTP_CONNECT_SUCCESS_BIT | HTTP_CONNECT_FAIL_BIT, pdTRUE, pdFALSE, timeout);
@@ -327,17 +575,54 @@ mc665_http_connect_status_def mc665_http_read_status(mc665_http_drv_t *obj, uint
     if (HTTP_CONNECT_SUCCESS_BIT & event)
     {
         ret = MC665_HTTP_CONNECT_SUCCESS;
+        obj->stats.connect_ms = (esp_timer_get_time() - obj->start_time) / 1000;
+        obj->stats.connect_total_ms += obj->stats.connect_ms;
     }
     else if (HTTP_CONNECT_FAIL_BIT & event)
     {
         ret = MC665_HTTP_CONNECT_FAIL;
     }
 
+    /* 使用缓存的IP连接失败，清除缓存后使用原始URL重试一次 */
+    if ((MC665_HTTP_CONNECT_SUCCESS != ret) && obj->url_resolved && obj->url)
+    {
+        ESP_LOGW(TAG, "http connect by cached ip failed, retry with host name");
+        obj->url_resolved = false;
+        sscanf(obj->url, "http://%63[^:/?]", host);
+        mc665_dns_invalidate(obj->dns, host);
+
+        /* 直接设置原始URL，避免再次被替换为IP */
+        if (mc665_take_lock(obj->drv))
+        {
+            url_set = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+HTTPSET=\"URL\",\"%s\"", obj->url));
+            mc665_release_lock(obj->drv);
+
+            if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+            {
+                private_mc665_http_cache_param(obj, MC665_HTTP_PARAM_URL, (url_set) ? (obj->url) : (NULL));
+                xSemaphoreGive(obj->mutex);
+            }
+
+            if (url_set && mc665_http_start(obj, obj->mode, obj->timeout))
+            {
+                return mc665_http_read_status(obj, timeout);
+            }
+        }
+    }
+
     return ret;
 }
 
+// 累计HTTPREAD的传输时间和数据量
+static void private_mc665_http_count_transfer(mc665_http_drv_t *obj, int64_t start, int len)
+{
+    obj->stats.transfer_ms += (esp_timer_get_time() - start) / 1000;
+    obj->stats.transfer_bytes += len;
+}
+
 int mc665_http_read_data(mc665_http_drv_t *obj, int offset, int length, void *buf, uint32_t timeout)
 {
+    int64_t start = 0;
     int expr_len = 0;
     char expr[40] = {0};
     mc665_http_data_t msg = {
@@ -356,7 +641,8 @@ int mc665_http_read_data(mc665_http_drv_t *obj, int offset, int length, void *bu
             xSemaphoreGive(obj->mutex);
         }
 
-        at_client_send(expr, expr_len);
+        start = esp_timer_get_time();
+        at_client_obj_send(obj->drv->client, expr, expr_len);
         xEventGroupWaitBits(obj->event, HTTP_RECV_DATA_BIT, pdTRUE, pdFALSE, timeout);
 
         /* 清除接收缓冲 */
@@ -367,25 +653,78 @@ int mc665_http_read_data(mc665_http_drv_t *obj, int offset, int length, void *bu
         }
 
         mc665_release_lock(obj->drv);
+        private_mc665_http_count_transfer(obj, start, msg.read_len);
     }
 
     return msg.read_len;
 }
 
+// 读取数据并分段交给sink，长度不受AT客户端行缓存限制，返回sink接收的长度
+int mc665_http_read_stream(mc665_http_drv_t *obj, int offset, int length, mc665_http_sink_t sink, void *param, uint32_t timeout)
+{
+    int64_t start = 0;
+    int expr_len = 0;
+    char expr[40] = {0};
+    mc665_http_stream_t stream = {
+        .sink = sink,
+        .param = param,
+        .buf = NULL,
+        .read_len = 0,
+        .abort = false};
+
+    stream.buf = malloc(MC665_HTTP_SEGMENT_SIZE);
+    if (!stream.buf)
+    {
+        ESP_LOGE(TAG, "No memory to recv http stream");
+        return 0;
+    }
+
+    expr_len = snprintf(expr, sizeof(expr), "AT+HTTPREAD=%d,%d\r\n", offset, length);
+
+    if (mc665_take_lock(obj->drv))
+    {
+        /* 设置流式读取 */
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            obj->stream = &stream;
+            xEventGroupClearBits(obj->event, HTTP_RECV_DATA_BIT);
+            xSemaphoreGive(obj->mutex);
+        }
+
+        start = esp_timer_get_time();
+        at_client_obj_send(obj->drv->client, expr, expr_len);
+        xEventGroupWaitBits(obj->event, HTTP_RECV_DATA_BIT, pdTRUE, pdFALSE, timeout);
+
+        /* 等待handler结束后清除流式读取 */
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            obj->stream = NULL;
+            xSemaphoreGive(obj->mutex);
+        }
+
+        mc665_release_lock(obj->drv);
+        private_mc665_http_count_transfer(obj, start, stream.read_len);
+    }
+
+    free(stream.buf);
+
+    return stream.read_len;
+}
+
 bool mc665_http_post(mc665_http_drv_t *obj, char *data, int len)
 {
     bool ret = false;
 
     if (mc665_take_lock(obj->drv))
     {
-        at_set_end_sign('>');
-        ret = (0 == at_exec_cmd(obj->drv->resp, "AT+HTTPDATA=%d", len));
-        at_set_end_sign(0);
+        at_obj_set_end_sign(obj->drv->client, '>');
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+HTTPDATA=%d", len));
+        at_obj_set_end_sign(obj->drv->client, 0);
 
         if (ret)
         {
-            at_client_send(data, len);
-            ret = (0 == at_exec_cmd(obj->drv->resp, ""));
+            at_client_obj_send(obj->drv->client, data, len);
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, ""));
         }
 
         mc665_release_lock(obj->drv);
@@ -394,15 +733,310 @@ bool mc665_http_post(mc665_http_drv_t *obj, char *data, int len)
     return ret;
 }
 
+// 分段读取数据源并在'>'提示后连续发送，内存占用为一个分段
+// 各分段之间没有应答确认，由串口RTS/CTS流控限速(at_uart_cfg_t.flow_ctrl)，未开启流控时len不宜超过模组的接收缓冲
+bool mc665_http_post_stream(mc665_http_drv_t *obj, int len, const mc665_http_source_t *source)
+{
+    bool ret = false;
+    int sent = 0;
+    int seg_len = 0;
+    int read_len = 0;
+    char *buf = NULL;
+
+    buf = malloc(MC665_HTTP_SEGMENT_SIZE);
+    if (!buf)
+    {
+        ESP_LOGE(TAG, "No memory to send http stream");
+        return false;
+    }
+
+    if (mc665_take_lock(obj->drv))
+    {
+        at_obj_set_end_sign(obj->drv->client, '>');
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+HTTPDATA=%d", len));
+        at_obj_set_end_sign(obj->drv->client, 0);
+
+        while (ret && (sent < len))
+        {
+            seg_len = (len - sent > MC665_HTTP_SEGMENT_SIZE) ? (MC665_HTTP_SEGMENT_SIZE) : (len - sent);
+            read_len = source->read(source->param, sent, buf, seg_len);
+
+            if (read_len <= 0)
+            {
+                ESP_LOGE(TAG, "http post source read failed at %d/%d", sent, len);
+                break;
+            }
+
+            (read_len > seg_len) ? (read_len = seg_len) : (0);
+            at_client_obj_send(obj->drv->client, buf, read_len);
+            sent += read_len;
+
+            if (source->progress)
+            {
+                source->progress(source->param, sent, len);
+            }
+        }
+
+        /* 数据源出错时用0补齐剩余长度，使模块结束接收，此次数据不再发起请求 */
+        if (ret && (sent < len))
+        {
+            ret = false;
+            memset(buf, 0, MC665_HTTP_SEGMENT_SIZE);
+
+            for (; sent < len; sent += seg_len)
+            {
+                seg_len = (len - sent > MC665_HTTP_SEGMENT_SIZE) ? (MC665_HTTP_SEGMENT_SIZE) : (len - sent);
+                at_client_obj_send(obj->drv->client, buf, seg_len);
+            }
+
+            at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "");
+        }
+        else if (ret)
+        {
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, ""));
+        }
+
+        mc665_release_lock(obj->drv);
+    }
+
+    free(buf);
+
+    return ret;
+}
+
+// 以文件为数据源，param为fopen打开的FILE指针
+int mc665_http_file_read(void *param, int offset, void *buf, int len)
+{
+    FILE *fp = (FILE *)param;
+
+    if (fseek(fp, offset, SEEK_SET))
+    {
+        return -1;
+    }
+
+    return fread(buf, 1, len, fp);
+}
+
 bool mc665_http_start(mc665_http_drv_t *obj, mc665_http_mode_def mode, int timeout)
 {
     bool ret = false;
 
     if (mc665_take_lock(obj->drv))
     {
-        ret = (0 == at_exec_cmd(obj->drv->resp, "AT+HTTPACT=%d,%d", mode, timeout));
+        obj->start_time = esp_timer_get_time();
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+HTTPACT=%d,%d", mode, timeout));
         mc665_release_lock(obj->drv);
     }
 
+    /* 请求被拒绝时模块中的会话可能已失效，下次重新设置全部参数 */
+    if (ret)
+    {
+        obj->stats.request_num++;
+    }
+    else
+    {
+        mc665_http_reset_param(obj);
+    }
+
+    obj->mode = mode;
+    obj->timeout = timeout;
+
     return ret;
+}
+
+static uint32_t private_mc665_http_hash(const char *str)
+{
+    uint32_t hash = 5381;
+
+    while (*str)
+    {
+        hash = hash * 33 + (uint8_t)(*str++);
+    }
+
+    return hash;
+}
+
+static void private_mc665_http_load_validator(mc665_http_drv_t *obj)
+{
+    nvs_handle_t handle = 0;
+    size_t size = sizeof(obj->validator);
+
+    obj->validator_loaded = true;
+
+    if (ESP_OK != nvs_open(MC665_HTTP_NVS_NAMESPACE, NVS_READONLY, &handle))
+    {
+        return;
+    }
+
+    if ((ESP_OK != nvs_get_blob(handle, MC665_HTTP_NVS_KEY, obj->validator, &size)) || (sizeof(obj->validator) != size))
+    {
+        memset(obj->validator, 0, sizeof(obj->validator));
+    }
+
+    nvs_close(handle);
+
+    for (int i = 0; i < MC665_HTTP_VALIDATOR_NUM; i++)
+    {
+        obj->validator[i].etag[MC665_HTTP_ETAG_LEN - 1] = '\0';
+        obj->validator[i].last_modified[MC665_HTTP_LAST_MODIFIED_LEN - 1] = '\0';
+    }
+}
+
+static void private_mc665_http_save_validator(mc665_http_drv_t *obj)
+{
+    nvs_handle_t handle = 0;
+
+    if (ESP_OK == nvs_open(MC665_HTTP_NVS_NAMESPACE, NVS_READWRITE, &handle))
+    {
+        if ((ESP_OK != nvs_set_blob(handle, MC665_HTTP_NVS_KEY, obj->validator, sizeof(obj->validator))) || (ESP_OK != nvs_commit(handle)))
+        {
+            ESP_LOGW(TAG, "http validator save failed");
+        }
+
+        nvs_close(handle);
+    }
+}
+
+static mc665_http_validator_t *private_mc665_http_find_validator(mc665_http_drv_t *obj, uint32_t url_hash)
+{
+    for (int i = 0; i < MC665_HTTP_VALIDATOR_NUM; i++)
+    {
+        if (obj->validator[i].stamp && (obj->validator[i].url_hash == url_hash))
+        {
+            return &obj->validator[i];
+        }
+    }
+
+    return NULL;
+}
+
+// 记录响应头中的校验信息，优先覆盖同一URL的记录，否则替换最久未使用的记录
+static void private_mc665_http_update_validator(mc665_http_drv_t *obj, uint32_t url_hash)
+{
+    bool found = false;
+    uint32_t stamp = 0;
+    mc665_http_validator_t *validator = NULL;
+    const char *etag = mc665_http_get_header(obj, MC665_HTTP_HEADER_ETAG);
+    const char *last_modified = mc665_http_get_header(obj, MC665_HTTP_HEADER_LAST_MODIFIED);
+
+    /* 超出长度的值无法完整比较，不缓存 */
+    (etag && (strlen(etag) >= MC665_HTTP_ETAG_LEN)) ? (etag = NULL) : (0);
+    (last_modified && (strlen(last_modified) >= MC665_HTTP_LAST_MODIFIED_LEN)) ? (last_modified = NULL) : (0);
+
+    validator = private_mc665_http_find_validator(obj, url_hash);
+
+    /* 资源不再提供校验信息，删除旧的记录 */
+    if (!etag && !last_modified)
+    {
+        if (validator)
+        {
+            memset(validator, 0, sizeof(mc665_http_validator_t));
+            private_mc665_http_save_validator(obj);
+        }
+
+        return;
+    }
+
+    found = (NULL != validator);
+
+    for (int i = 0; i < MC665_HTTP_VALIDATOR_NUM; i++)
+    {
+        (obj->validator[i].stamp > stamp) ? (stamp = obj->validator[i].stamp) : (0);
+
+        if (!found && (!validator || (obj->validator[i].stamp < validator->stamp)))
+        {
+            validator = &obj->validator[i];
+        }
+    }
+
+    /* 内容未变化时不重复写入NVS */
+    if (found &&
+        !strcmp((etag) ? (etag) : (""), validator->etag) &&
+        !strcmp((last_modified) ? (last_modified) : (""), validator->last_modified))
+    {
+        return;
+    }
+
+    memset(validator, 0, sizeof(mc665_http_validator_t));
+    validator->url_hash = url_hash;
+    validator->stamp = stamp + 1;
+    snprintf(validator->etag, sizeof(validator->etag), "%s", (etag) ? (etag) : (""));
+    snprintf(validator->last_modified, sizeof(validator->last_modified), "%s", (last_modified) ? (last_modified) : (""));
+    private_mc665_http_save_validator(obj);
+}
+
+// 发起请求并读取响应头，成功时返回响应状态码
+static int private_mc665_http_request_header(mc665_http_drv_t *obj, mc665_http_mode_def mode, mc665_http_resp_t *resp, uint32_t timeout)
+{
+    int timeout_s = pdTICKS_TO_MS(timeout) / 1000;
+
+    if (!mc665_http_start(obj, mode, (timeout_s > 0) ? (timeout_s) : (1)) ||
+        (MC665_HTTP_CONNECT_SUCCESS != mc665_http_read_status(obj, timeout)) ||
+        !mc665_http_read_resp(obj, resp, timeout) ||
+        !mc665_http_read_header(obj, timeout))
+    {
+        return 0;
+    }
+
+    return obj->header.status;
+}
+
+// 模组不支持自定义请求头，先用HEAD请求取得ETag/Last-Modified，与缓存一致时不再下载响应体，
+// 资源变化时发起GET，响应体从header.body_offset开始读取
+bool mc665_http_get_conditional(mc665_http_drv_t *obj, mc665_http_resp_t *resp, uint32_t timeout)
+{
+    int status = 0;
+    uint32_t url_hash = 0;
+    const char *etag = NULL;
+    const char *last_modified = NULL;
+    mc665_http_validator_t *validator = NULL;
+
+    resp->cached = false;
+
+    if (!obj->url)
+    {
+        ESP_LOGE(TAG, "http url is not set");
+        return false;
+    }
+
+    if (!obj->validator_loaded)
+    {
+        private_mc665_http_load_validator(obj);
+    }
+
+    url_hash = private_mc665_http_hash(obj->url);
+    validator = private_mc665_http_find_validator(obj, url_hash);
+
+    /* 校验信息包含在HTTPREAD读取的响应头中 */
+    if (!mc665_http_set_param(obj, MC665_HTTP_PARAM_RESPONSEHEADER, "0"))
+    {
+        return false;
+    }
+
+    if (validator)
+    {
+        status = private_mc665_http_request_header(obj, MC665_HTTP_MODE_HEAD, resp, timeout);
+        etag = mc665_http_get_header(obj, MC665_HTTP_HEADER_ETAG);
+        last_modified = mc665_http_get_header(obj, MC665_HTTP_HEADER_LAST_MODIFIED);
+
+        if ((MC665_HTTP_REPLY_NOT_MODIFIED == status) ||
+            ((MC665_HTTP_REPLY_OK == status) && (etag || last_modified) &&
+             !strcmp((etag) ? (etag) : (""), validator->etag) &&
+             !strcmp((last_modified) ? (last_modified) : (""), validator->last_modified)))
+        {
+            ESP_LOGI(TAG, "http resource not modified");
+            resp->cached = true;
+            obj->stats.cache_hit_num++;
+            return true;
+        }
+    }
+
+    status = private_mc665_http_request_header(obj, MC665_HTTP_MODE_GET, resp, timeout);
+
+    if (MC665_HTTP_REPLY_OK == status)
+    {
+        private_mc665_http_update_validator(obj, url_hash);
+    }
+
+    return (0 != status);
 }
\ No newline at end of file
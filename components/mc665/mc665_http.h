@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mc665.h"
+#include "mc665_dns.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
@@ -31,6 +32,7 @@ typedef enum
 typedef enum 
 {
     MC665_HTTP_REPLY_OK = 200,
+    MC665_HTTP_REPLY_NOT_MODIFIED = 304,
     MC665_HTTP_REPLY_NOT_FOUND = 404
 } mc665_http_reply_def;
 
@@ -57,27 +59,139 @@ typedef struct
     int read_len;
 } mc665_http_data_t;
 
+typedef enum
+{
+    MC665_HTTP_HEADER_CONTENT_LENGTH,
+    MC665_HTTP_HEADER_ETAG,
+    MC665_HTTP_HEADER_CONTENT_RANGE,
+    MC665_HTTP_HEADER_CONTENT_ENCODING,
+    MC665_HTTP_HEADER_LOCATION,
+    MC665_HTTP_HEADER_LAST_MODIFIED,
+    MC665_HTTP_HEADER_NUM
+} mc665_http_header_def;
+
+/* 响应头的最大长度，超出时读取失败 */
+#define MC665_HTTP_HEADER_MAX_LEN 2048
+/* 单行响应头的最大长度，超出的行将被忽略 */
+#define MC665_HTTP_HEADER_LINE_LEN 256
+/* 保存的响应头值的最大长度，超出部分将被截断 */
+#define MC665_HTTP_HEADER_VALUE_LEN 128
+
+typedef struct
+{
+    int status;
+    /* 没有Content-Length时为-1 */
+    int content_length;
+    /* 响应体在HTTPREAD数据中的偏移 */
+    int body_offset;
+    char value[MC665_HTTP_HEADER_NUM][MC665_HTTP_HEADER_VALUE_LEN];
+} mc665_http_header_t;
+
+/* 流式读取时sink每次接收的最大长度 */
+#define MC665_HTTP_SEGMENT_SIZE 512
+
+/* 返回false时终止向sink传递数据 */
+typedef bool (*mc665_http_sink_t)(void *param, const void *data, int len);
+
+typedef struct
+{
+    mc665_http_sink_t sink;
+    void *param;
+    char *buf;
+    int read_len;
+    bool abort;
+} mc665_http_stream_t;
+
+/* 流式POST的数据源，每次读取不超过MC665_HTTP_SEGMENT_SIZE */
+typedef struct
+{
+    void *param;
+    /* 读取offset处的数据，返回读取的长度，小于等于0时终止发送 */
+    int (*read)(void *param, int offset, void *buf, int len);
+    /* 可为NULL，每发送一段数据后调用 */
+    void (*progress)(void *param, int sent, int total);
+} mc665_http_source_t;
+
 typedef struct 
 {
     int mode;
     int reply;
     int length;
+    /* 条件请求时资源未变化，不需要读取响应体 */
+    bool cached;
 } mc665_http_resp_t;
 
+/* 保存校验信息的URL数量 */
+#define MC665_HTTP_VALIDATOR_NUM 4
+#define MC665_HTTP_ETAG_LEN 64
+#define MC665_HTTP_LAST_MODIFIED_LEN 32
+
+typedef struct
+{
+    uint32_t url_hash;
+    /* 最近使用的顺序，0代表空闲 */
+    uint32_t stamp;
+    char etag[MC665_HTTP_ETAG_LEN];
+    char last_modified[MC665_HTTP_LAST_MODIFIED_LEN];
+} mc665_http_validator_t;
+
+/* 连接和传输耗时统计，时间单位为ms */
+typedef struct
+{
+    uint32_t request_num;
+    /* 参数未变化而跳过的AT+HTTPSET次数 */
+    uint32_t param_skip_num;
+    /* 最近一次从AT+HTTPACT到连接成功的时间 */
+    uint32_t connect_ms;
+    uint32_t connect_total_ms;
+    /* AT+HTTPREAD的累计时间和数据量 */
+    uint32_t transfer_ms;
+    uint32_t transfer_bytes;
+    /* 条件请求命中缓存的次数 */
+    uint32_t cache_hit_num;
+} mc665_http_stats_t;
+
 typedef struct
 {
     mc665_drv_t *drv;
+    /* 域名缓存，不为空时http://地址中的域名将替换为缓存的IP，
+       Host头也会变为IP，仅用于不依赖虚拟主机的服务器 */
+    mc665_dns_drv_t *dns;
+    /* 原始URL及是否已替换为IP，用于连接失败后使用域名重试，
+       同时作为条件请求缓存的索引 */
+    char *url;
+    bool url_resolved;
+    mc665_http_mode_def mode;
+    int timeout;
+    /* 模块中已设置的参数，相同的参数不再重复发送，由mutex保护 */
+    char *param[MC665_HTTP_PARAM_NUM];
+    /* 缓存参数时模组的session，模组重启或重新附着后缓存失效 */
+    uint32_t param_session;
+    int64_t start_time;
+    mc665_http_stats_t stats;
+    /* 条件请求的校验信息，首次使用时从NVS加载 */
+    bool validator_loaded;
+    mc665_http_validator_t validator[MC665_HTTP_VALIDATOR_NUM];
     mc665_http_data_t *msg;
+    mc665_http_stream_t *stream;
     SemaphoreHandle_t mutex;
     mc665_http_resp_t resp;
+    mc665_http_header_t header;
     EventGroupHandle_t event;
+    struct at_urc urc_table[1];
 } mc665_http_drv_t;
 
 bool mc665_http_init(mc665_http_drv_t *obj);
-int mc665_read_content_length(mc665_http_drv_t *obj, int max_length);
+bool mc665_http_read_header(mc665_http_drv_t *obj, uint32_t timeout);
+const char *mc665_http_get_header(mc665_http_drv_t *obj, mc665_http_header_def header);
 bool mc665_http_set_param(mc665_http_drv_t *obj, mc665_http_param_def header, const char *value);
+void mc665_http_reset_param(mc665_http_drv_t *obj);
 mc665_http_connect_status_def mc665_http_read_status(mc665_http_drv_t *obj, uint32_t timeout);
 bool mc665_http_read_resp(mc665_http_drv_t *obj, mc665_http_resp_t *resp, uint32_t timeout);
 int mc665_http_read_data(mc665_http_drv_t *obj, int offset, int length, void *buf, uint32_t timeout);
+int mc665_http_read_stream(mc665_http_drv_t *obj, int offset, int length, mc665_http_sink_t sink, void *param, uint32_t timeout);
 bool mc665_http_post(mc665_http_drv_t *obj, char *data, int len);
-bool mc665_http_start(mc665_http_drv_t *obj, mc665_http_mode_def mode, int timeout);
\ No newline at end of file
+bool mc665_http_post_stream(mc665_http_drv_t *obj, int len, const mc665_http_source_t *source);
+int mc665_http_file_read(void *param, int offset, void *buf, int len);
+bool mc665_http_start(mc665_http_drv_t *obj, mc665_http_mode_def mode, int timeout);
+bool mc665_http_get_conditional(mc665_http_drv_t *obj, mc665_http_resp_t *resp, uint32_t timeout);
\ No newline at end of file
@@ -1,50 +1,413 @@
 #include "mc665.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_system.h"
 #include "freertos/event_groups.h"
 #include "freertos/queue.h"
 #include "mc665_mqtt.h"
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define MQTT_CLIENT_ID 1
 #define MQTT_CONNECTED_BIT BIT0
 #define MQTT_DISCONNECTED_BIT BIT1
 #define MQTT_SUBSCRIBE_BIT BIT2
-#define MQTT_PUBLISH_BIT BIT3
+#define MQTT_SUBSCRIBE_FAIL_BIT BIT3
 #define MQTT_UNSUBSCRIBE_BIT BIT4
 #define MQTT_CLOSE_BIT BIT5
 
+/* 事件任务空闲时检查发送超时的间隔(ms) */
+#define MC665_MQTT_EXPIRE_INTERVAL 1000
+/* 超时的消息保留位置等待迟到应答的时间(ms)，超过后认为应答已丢失 */
+#define MC665_MQTT_TOMBSTONE_TIMEOUT (2 * MC665_MQTT_PUBLISH_TIMEOUT)
+
 typedef struct
 {
     mqtt_msg_t msg;
+    /* MQTT_EVT_DATA的消息，来自消息池 */
+    mqtt_msg_t *data;
     mqtt_event_def event;
     struct at_client *client;
 } mc665_mqtt_msg_t;
 
-typedef struct
+static const char *TAG = "mc665_mqtt";
+/* 已初始化的连接，URC按AT客户端和client id分发到对应连接 */
+static mc665_mqtt_drv_t *s_mc665_mqtt_client[MC665_MQTT_CLIENT_MAX] = {0};
+/* 每个AT客户端一张+MQTT URC表，不属于任何连接，ref为使用它的连接数 */
+static struct
 {
-    mc665_drv_t *drv;
-    mqtt_cfg_t cfg;
-    mqtt_event_cb_t event_cb;
-    EventGroupHandle_t event;
-    TaskHandle_t task;
-    QueueHandle_t queue;
-} mc665_mqtt_drv_t;
+    at_client_t client;
+    int ref;
+    struct at_urc urc_table[1];
+} s_mc665_mqtt_urc[MC665_MQTT_CLIENT_MAX] = {0};
 
-static const char *TAG = "mc665_mqtt";
-static struct at_urc s_urc_table[1] = {0};
-static mc665_mqtt_drv_t s_mqtt_drv = {NULL};
+static mc665_mqtt_drv_t *private_mc665_mqtt_find(at_client_t client, int client_id)
+{
+    mc665_mqtt_drv_t *obj = NULL;
+
+    for (int i = 0; i < MC665_MQTT_CLIENT_MAX; i++)
+    {
+        obj = s_mc665_mqtt_client[i];
+
+        if (obj && (obj->drv->client == client) && (obj->client_id == client_id))
+        {
+            return obj;
+        }
+    }
+
+    return NULL;
+}
+
+// 加入连接表，client id在同一AT客户端上不能重复
+static bool private_mc665_mqtt_attach(mc665_mqtt_drv_t *obj)
+{
+    int slot = -1;
+
+    if (private_mc665_mqtt_find(obj->drv->client, obj->client_id))
+    {
+        ESP_LOGE(TAG, "MC665 mqtt client id %d is already in use", obj->client_id);
+        return false;
+    }
+
+    for (int i = 0; i < MC665_MQTT_CLIENT_MAX; i++)
+    {
+        (!s_mc665_mqtt_client[i] && (slot < 0)) ? (slot = i) : (0);
+    }
+
+    if (slot < 0)
+    {
+        ESP_LOGE(TAG, "Too many MC665 mqtt clients, please readjust MC665_MQTT_CLIENT_MAX");
+        return false;
+    }
+
+    s_mc665_mqtt_client[slot] = obj;
+
+    return true;
+}
+
+static void private_mc665_mqtt_set_event_bits(mc665_mqtt_drv_t *obj, uint32_t bits)
+{
+    if (obj->event)
+    {
+        xEventGroupSetBits(obj->event, bits);
+    }
+}
+
+static bool private_mc665_mqtt_is_priority(mc665_mqtt_drv_t *obj, mc665_mqtt_msg_t *urc)
+{
+    for (int i = 0; (MQTT_EVT_DATA == urc->event) && (i < obj->priority_num); i++)
+    {
+        if (!strncmp(urc->data->topic, obj->priority_topic[i], strlen(obj->priority_topic[i])))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 按策略放入接收队列，解析线程最多等待MC665_MQTT_QUEUE_BLOCK_TIME
+static void private_mc665_mqtt_post(mc665_mqtt_drv_t *obj, mc665_mqtt_msg_t *urc)
+{
+    bool ret = false;
+    bool evicted = false;
+    bool timeout = false;
+    mc665_mqtt_msg_t old = {0};
+    bool front = (MC665_MQTT_QUEUE_PRIORITY == obj->policy) && private_mc665_mqtt_is_priority(obj, urc);
+    /* 事件和优先消息满时挤掉最早的消息 */
+    bool evict = (MQTT_EVT_DATA != urc->event) || front || (MC665_MQTT_QUEUE_DROP_OLDEST == obj->policy);
+
+    if (!obj->queue)
+    {
+        if (MQTT_EVT_DATA == urc->event)
+        {
+            mc665_mqtt_msg_unref(urc->data);
+        }
+
+        return;
+    }
+
+    ret = (front) ? (pdTRUE == xQueueSendToFront(obj->queue, urc, 0))
+                  : (pdTRUE == xQueueSend(obj->queue, urc, (MC665_MQTT_QUEUE_BLOCK == obj->policy) ? (pdMS_TO_TICKS(MC665_MQTT_QUEUE_BLOCK_TIME)) : (0)));
+    timeout = !ret && (MC665_MQTT_QUEUE_BLOCK == obj->policy) && !front;
+
+    /* 只挤掉接收的消息，取出的是事件时放回队首 */
+    if (!ret && evict && (pdTRUE == xQueueReceive(obj->queue, &old, 0)))
+    {
+        if (MQTT_EVT_DATA == old.event)
+        {
+            evicted = true;
+            mc665_mqtt_msg_unref(old.data);
+            ret = (front) ? (pdTRUE == xQueueSendToFront(obj->queue, urc, 0)) : (pdTRUE == xQueueSend(obj->queue, urc, 0));
+        }
+        else if (pdTRUE != xQueueSendToFront(obj->queue, &old, 0))
+        {
+            ESP_LOGE(TAG, "MC665 mqtt event %d lost", old.event);
+        }
+    }
+
+    if (!ret)
+    {
+        ESP_LOGW(TAG, "MC665 mqtt queue is full, drop event %d", urc->event);
+
+        if (MQTT_EVT_DATA == urc->event)
+        {
+            mc665_mqtt_msg_unref(urc->data);
+        }
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        obj->queue_stats.post_num++;
+        obj->queue_stats.depth = uxQueueMessagesWaiting(obj->queue);
+        (obj->queue_stats.depth > obj->queue_stats.high_water) ? (obj->queue_stats.high_water = obj->queue_stats.depth) : (0);
+        (timeout) ? (obj->queue_stats.block_timeout_num++) : (0);
+        (evicted) ? (obj->queue_stats.drop_oldest_num++) : (0);
+        (!ret && (MQTT_EVT_DATA == urc->event)) ? (obj->queue_stats.drop_newest_num++) : (0);
+        (!ret && (MQTT_EVT_DATA != urc->event)) ? (obj->queue_stats.event_drop_num++) : (0);
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
+void mc665_mqtt_get_queue_stats(mc665_mqtt_drv_t *obj, mc665_mqtt_queue_stats_t *stats)
+{
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        *stats = obj->queue_stats;
+        stats->depth = (obj->queue) ? (uxQueueMessagesWaiting(obj->queue)) : (0);
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
+// 通知阻塞发送的等待者，调用时需持有mutex
+static void private_mc665_mqtt_inflight_notify(mc665_mqtt_inflight_t *inflight, bool ok)
+{
+    if (inflight->waiter)
+    {
+        inflight->waiter->ok = ok;
+        xSemaphoreGive(inflight->waiter->done);
+        inflight->waiter = NULL;
+    }
+}
+
+// 一条消息发送完成或被丢弃，释放窗口并通知应用
+static void private_mc665_mqtt_publish_done(mc665_mqtt_drv_t *obj, int msg_id, bool ok)
+{
+    mc665_mqtt_msg_t urc = {.event = (ok) ? (MQTT_EVT_PUBLISHED) : (MQTT_EVT_DELETED)};
+
+    urc.msg.msg_id = msg_id;
+    xSemaphoreGive(obj->window);
+    private_mc665_mqtt_post(obj, &urc);
+}
+
+// 移除队首等待过久的超时位置，模组丢失一条+MQTTPUB时避免之后的应答全部错位，调用时需持有mutex
+static void private_mc665_mqtt_inflight_purge(mc665_mqtt_drv_t *obj)
+{
+    int64_t now = esp_timer_get_time();
+    mc665_mqtt_inflight_t *item = NULL;
+
+    while (obj->inflight_num)
+    {
+        item = &obj->inflight_list[obj->inflight_head];
+
+        if (!item->expired || (now - item->time <= MC665_MQTT_TOMBSTONE_TIMEOUT * 1000LL))
+        {
+            break;
+        }
+
+        ESP_LOGW(TAG, "mqtt message %d ack lost", item->msg_id);
+        obj->inflight_head = (obj->inflight_head + 1) % MC665_MQTT_INFLIGHT_MAX;
+        obj->inflight_num--;
+    }
+}
+
+// 收到+MQTTPUB，按顺序对应队首的消息，队首已超时时只移除该位置
+static void private_mc665_mqtt_inflight_ack(mc665_mqtt_drv_t *obj, bool ok)
+{
+    bool found = false;
+    mc665_mqtt_inflight_t inflight = {0};
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        private_mc665_mqtt_inflight_purge(obj);
+
+        if (obj->inflight_num)
+        {
+            found = true;
+            inflight = obj->inflight_list[obj->inflight_head];
+            private_mc665_mqtt_inflight_notify(&obj->inflight_list[obj->inflight_head], ok);
+            obj->inflight_head = (obj->inflight_head + 1) % MC665_MQTT_INFLIGHT_MAX;
+            obj->inflight_num--;
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (!found)
+    {
+        ESP_LOGW(TAG, "Unexpected mqtt publish ack");
+    }
+    else if (inflight.expired)
+    {
+        ESP_LOGW(TAG, "mqtt message %d acknowledged after timeout", inflight.msg_id);
+    }
+    else
+    {
+        private_mc665_mqtt_publish_done(obj, inflight.msg_id, ok);
+    }
+}
+
+// 找出最早一条超时的消息，all为true时取出全部消息（连接已断开，不会再有应答）
+static bool private_mc665_mqtt_inflight_timeout(mc665_mqtt_drv_t *obj, bool all, mc665_mqtt_inflight_t *inflight)
+{
+    bool ret = false;
+    mc665_mqtt_inflight_t *item = NULL;
+    int64_t now = esp_timer_get_time();
 
-static void private_mc665_mqtt_set_event_bits(uint32_t bits)
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        private_mc665_mqtt_inflight_purge(obj);
+
+        for (int i = 0; (i < obj->inflight_num) && !ret; i++)
+        {
+            item = &obj->inflight_list[(obj->inflight_head + i) % MC665_MQTT_INFLIGHT_MAX];
+
+            /* 超时的消息总在队首，之后的消息发送得更晚 */
+            if (item->expired)
+            {
+                continue;
+            }
+
+            if (!all && (now - item->time <= MC665_MQTT_PUBLISH_TIMEOUT * 1000LL))
+            {
+                break;
+            }
+
+            ret = true;
+            item->expired = true;
+            *inflight = *item;
+            private_mc665_mqtt_inflight_notify(item, false);
+        }
+
+        /* 全部通知后再清空，超时的位置一并移除 */
+        if (all && !ret)
+        {
+            obj->inflight_head = (obj->inflight_head + obj->inflight_num) % MC665_MQTT_INFLIGHT_MAX;
+            obj->inflight_num = 0;
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+// 丢弃超时未确认的消息，断开连接时丢弃全部消息
+static void private_mc665_mqtt_inflight_expire(mc665_mqtt_drv_t *obj, bool all)
+{
+    mc665_mqtt_inflight_t inflight = {0};
+
+    while (private_mc665_mqtt_inflight_timeout(obj, all, &inflight))
+    {
+        ESP_LOGW(TAG, "mqtt message %d is not acknowledged", inflight.msg_id);
+        private_mc665_mqtt_publish_done(obj, inflight.msg_id, false);
+    }
+}
+
+// 在解析线程中分配接收消息，topic和payload与消息头放在同一块内存中
+static mqtt_msg_t *private_mc665_mqtt_msg_alloc(mc665_mqtt_drv_t *obj, int topic_len, int data_len)
+{
+    uint32_t cost = 0;
+    int64_t start = esp_timer_get_time();
+    mc665_mqtt_block_t *block = NULL;
+    size_t size = sizeof(mc665_mqtt_block_t) + topic_len + 1 + data_len + 1;
+
+    if (obj->pool_free && (size <= obj->pool_size) && (pdTRUE == xQueueReceive(obj->pool_free, &block, 0)))
+    {
+        block->pooled = true;
+    }
+    else if ((block = malloc(size)) != NULL)
+    {
+        block->pooled = false;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        cost = esp_timer_get_time() - start;
+        obj->pool_stats.alloc_num++;
+        obj->pool_stats.alloc_total_us += cost;
+        (cost > obj->pool_stats.alloc_max_us) ? (obj->pool_stats.alloc_max_us = cost) : (0);
+        (block && !block->pooled) ? (obj->pool_stats.fallback_num++) : (0);
+        (block) ? (obj->pool_stats.used++) : (obj->pool_stats.fail_num++);
+        (obj->pool_stats.used > obj->pool_stats.used_peak) ? (obj->pool_stats.used_peak = obj->pool_stats.used) : (0);
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (!block)
+    {
+        return NULL;
+    }
+
+    block->owner = obj;
+    block->ref = 1;
+    memset(&block->msg, 0, sizeof(block->msg));
+    block->msg.topic = block->buf;
+    block->msg.topic_len = topic_len;
+    block->msg.data = block->buf + topic_len + 1;
+    block->msg.data_len = data_len;
+
+    return &block->msg;
+}
+
+mqtt_msg_t *mc665_mqtt_msg_ref(mqtt_msg_t *msg)
 {
-    if (s_mqtt_drv.event)
+    mc665_mqtt_block_t *block = (mc665_mqtt_block_t *)((char *)msg - offsetof(mc665_mqtt_block_t, msg));
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)block->owner;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        block->ref++;
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return msg;
+}
+
+void mc665_mqtt_msg_unref(mqtt_msg_t *msg)
+{
+    bool release = false;
+    mc665_mqtt_block_t *block = NULL;
+    mc665_mqtt_drv_t *obj = NULL;
+
+    if (!msg)
+    {
+        return;
+    }
+
+    block = (mc665_mqtt_block_t *)((char *)msg - offsetof(mc665_mqtt_block_t, msg));
+    obj = (mc665_mqtt_drv_t *)block->owner;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        release = (0 == --block->ref);
+        (release) ? (obj->pool_stats.used--) : (0);
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (release && block->pooled)
+    {
+        xQueueSend(obj->pool_free, &block, 0);
+    }
+    else if (release)
     {
-        xEventGroupSetBits(s_mqtt_drv.event, bits);
+        free(block);
     }
 }
 
 static void private_mc665_mqtt_handler(struct at_client *client, const char *data, rt_size_t size, void *param)
 {
-    (void)param;
+    int client_id = 0;
+    mc665_mqtt_drv_t *obj = NULL;
     char expr[40] = {0};
     char temp[40] = {0};
     mc665_mqtt_msg_t urc = {.event = MQTT_EVT_NONE};
@@ -56,6 +419,15 @@ static void private_mc665_mqtt_handler(struct at_client *client, const char *dat
     snprintf(expr, sizeof(expr), "%%%d[^:]", sizeof(temp) - 1);
     sscanf(client->recv_line_buf, expr, temp);
 
+    /* +MQTTxxx: <Client id>,... 按client id找到对应的连接 */
+    sscanf(client->recv_line_buf, "%*[^:]:%d", &client_id);
+    obj = private_mc665_mqtt_find(client, client_id);
+    if (!obj)
+    {
+        ESP_LOGW(TAG, "Unhandled mqtt urc of client %d", client_id);
+        return;
+    }
+
     /* +MQTTMSGI: <Client id>,<Qos>,<tlength/Topicid>,<plength>
            +MQTTREAD=<Client id>
            接收到该指令后通过 at_client_send 发送 MQTTREAD 读取payload
@@ -70,8 +442,8 @@ static void private_mc665_mqtt_handler(struct at_client *client, const char *dat
             int payload_pos = 0;
 
             /* +MQTTREAD: <Client id>,<Qos>,<tlength>,<plength>,<Topic/Topic id>,<Payload> */
-            topic_pos = snprintf(client->recv_line_buf, client->recv_bufsz, "+MQTTREAD: 1,0,%d,%d,\"", urc.msg.topic_len, urc.msg.data_len);
-            cmd_len = snprintf(client->recv_line_buf, client->recv_bufsz, "AT+MQTTREAD=%d\r\n", MQTT_CLIENT_ID);
+            topic_pos = snprintf(client->recv_line_buf, client->recv_bufsz, "+MQTTREAD: %d,0,%d,%d,\"", obj->client_id, urc.msg.topic_len, urc.msg.data_len);
+            cmd_len = snprintf(client->recv_line_buf, client->recv_bufsz, "AT+MQTTREAD=%d\r\n", obj->client_id);
             topic_pos = topic_pos + cmd_len;
             payload_pos = topic_pos + urc.msg.topic_len + sizeof("\",\"") - 1;
             total_len = payload_pos + urc.msg.data_len + sizeof("\"\r\n\r\nOK\r\n") - 1;
@@ -91,32 +463,20 @@ static void private_mc665_mqtt_handler(struct at_client *client, const char *dat
 
                     if (3 == sscanf(client->recv_line_buf + cmd_len, "%*s%*d,%d,%d,%d", &urc.msg.qos, &urc.msg.topic_len, &urc.msg.data_len))
                     {
-                        if (urc.msg.topic || urc.msg.data)
-                        {
-                            free(urc.msg.topic);
-                            free(urc.msg.data);
-                            urc.msg.topic = NULL;
-                            urc.msg.data = NULL;
-                            ESP_LOGE(TAG, "Unhandled mqtt msg");
-                        }
+                        urc.data = private_mc665_mqtt_msg_alloc(obj, urc.msg.topic_len, urc.msg.data_len);
 
-                        urc.msg.topic = malloc(urc.msg.topic_len + 1);
-                        urc.msg.data = malloc(urc.msg.data_len + 1);
-
-                        if (urc.msg.topic && urc.msg.data)
+                        if (urc.data)
                         {
                             urc.event = MQTT_EVT_DATA;
-                            client->recv_line_buf[topic_pos + urc.msg.topic_len] = 0;
-                            memcpy(urc.msg.topic, &client->recv_line_buf[topic_pos], urc.msg.topic_len + 1);
-                            client->recv_line_buf[payload_pos + urc.msg.data_len] = 0;
-                            memcpy(urc.msg.data, &client->recv_line_buf[payload_pos], urc.msg.data_len + 1);
+                            urc.data->qos = urc.msg.qos;
+                            memcpy(urc.data->topic, &client->recv_line_buf[topic_pos], urc.msg.topic_len);
+                            urc.data->topic[urc.msg.topic_len] = 0;
+                            memcpy(urc.data->data, &client->recv_line_buf[payload_pos], urc.msg.data_len);
+                            urc.data->data[urc.msg.data_len] = 0;
                         }
                         else
                         {
-                            free(urc.msg.topic);
-                            free(urc.msg.data);
-                            urc.msg.topic = NULL;
-                            urc.msg.data = NULL;
+                            ESP_LOGE(TAG, "No memory for mqtt msg(%d)", urc.msg.topic_len + urc.msg.data_len);
                         }
                     }
                 }
@@ -132,48 +492,144 @@ static void private_mc665_mqtt_handler(struct at_client *client, const char *dat
     /* +MQTTPUB: <Client id>,<Status> */
     else if (!strncmp(temp, "+MQTTPUB", sizeof("+MQTTPUB")))
     {
-        urc.event = MQTT_EVT_PUBLISHED;
-        private_mc665_mqtt_set_event_bits(MQTT_PUBLISH_BIT);
+        int status = 0;
+
+        sscanf(client->recv_line_buf, "%*s%*d,%d", &status);
+        private_mc665_mqtt_inflight_ack(obj, (0 == status));
     }
     /* +MQTTSUB: <Client id>,<Status> */
     else if (!strncmp(temp, "+MQTTSUB", sizeof("+MQTTSUB")))
     {
-        urc.event = MQTT_EVT_SUBSCRIBED;
-        private_mc665_mqtt_set_event_bits(MQTT_SUBSCRIBE_BIT);
+        int status = -1;
+
+        sscanf(client->recv_line_buf, "%*s%*d,%d", &status);
+
+        if (0 == status)
+        {
+            urc.event = MQTT_EVT_SUBSCRIBED;
+            obj->sub_ack++;
+            private_mc665_mqtt_set_event_bits(obj, MQTT_SUBSCRIBE_BIT);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "MC665 mqtt subscribe rejected (%d)", status);
+            private_mc665_mqtt_set_event_bits(obj, MQTT_SUBSCRIBE_FAIL_BIT);
+        }
     }
     /* +MQTTOPEN: <Client id>,<Status> */
     else if (!strncmp(temp, "+MQTTOPEN", sizeof("+MQTTOPEN")))
     {
-        urc.event = MQTT_EVT_CONNECTED;
-        private_mc665_mqtt_set_event_bits(MQTT_CONNECTED_BIT);
+        int status = -1;
+
+        sscanf(client->recv_line_buf, "%*s%*d,%d", &status);
+
+        /* 连接被拒绝或失败时不通知连接成功 */
+        if (0 == status)
+        {
+            urc.event = MQTT_EVT_CONNECTED;
+            private_mc665_mqtt_set_event_bits(obj, MQTT_CONNECTED_BIT);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "MC665 mqtt open refused (%d)", status);
+            private_mc665_mqtt_set_event_bits(obj, MQTT_DISCONNECTED_BIT);
+        }
     }
     /* +MQTTUNSUB: <Client id>,<Status> */
     else if (!strncmp(temp, "+MQTTUNSUB", sizeof("+MQTTUNSUB")))
     {
         urc.event = MQTT_EVT_UNSUBSCRIBED;
-        private_mc665_mqtt_set_event_bits(MQTT_UNSUBSCRIBE_BIT);
+        private_mc665_mqtt_set_event_bits(obj, MQTT_UNSUBSCRIBE_BIT);
     }
     /* +MQTTBREAK: <Client id>,<cause> */
     else if (!strncmp(temp, "+MQTTBREAK", sizeof("+MQTTBREAK")))
     {
         urc.event = MQTT_EVT_DISCONNECTED;
-        private_mc665_mqtt_set_event_bits(MQTT_DISCONNECTED_BIT);
+        private_mc665_mqtt_set_event_bits(obj, MQTT_DISCONNECTED_BIT);
+        private_mc665_mqtt_inflight_expire(obj, true);
+
+        /* 由重连任务恢复连接 */
+        if (obj->connected && obj->active && obj->reconnect_task)
+        {
+            obj->connected = false;
+            obj->break_time = esp_timer_get_time();
+            obj->reconnect_stats.break_num++;
+            xTaskNotifyGive(obj->reconnect_task);
+        }
+
+        obj->connected = false;
     }
     /* +MQTTCLOSE: <Client id>,<Status> */
     else if (!strncmp(temp, "+MQTTCLOSE", sizeof("+MQTTCLOSE")))
     {
-        private_mc665_mqtt_set_event_bits(MQTT_CLOSE_BIT);
+        private_mc665_mqtt_set_event_bits(obj, MQTT_CLOSE_BIT);
+    }
+
+    if (MQTT_EVT_NONE != urc.event)
+    {
+        private_mc665_mqtt_post(obj, &urc);
+    }
+}
+
+// 第一个连接为AT客户端注册URC表，之后的连接只增加引用
+static bool private_mc665_mqtt_urc_attach(at_client_t client)
+{
+    int slot = -1;
+
+    for (int i = 0; i < MC665_MQTT_CLIENT_MAX; i++)
+    {
+        if (s_mc665_mqtt_urc[i].client == client)
+        {
+            s_mc665_mqtt_urc[i].ref++;
+            return true;
+        }
+
+        (!s_mc665_mqtt_urc[i].client && (slot < 0)) ? (slot = i) : (0);
+    }
+
+    if (slot < 0)
+    {
+        ESP_LOGE(TAG, "Too many at clients for mqtt, please readjust MC665_MQTT_CLIENT_MAX");
+        return false;
     }
 
-    if (s_mqtt_drv.queue && MQTT_EVT_NONE != urc.event)
+    s_mc665_mqtt_urc[slot].urc_table[0].cmd_prefix = "+MQTT";
+    s_mc665_mqtt_urc[slot].urc_table[0].cmd_suffix = "\r\n";
+    s_mc665_mqtt_urc[slot].urc_table[0].func = private_mc665_mqtt_handler;
+    s_mc665_mqtt_urc[slot].urc_table[0].param = NULL;
+    if (at_obj_set_urc_table(client, s_mc665_mqtt_urc[slot].urc_table, 1))
+    {
+        ESP_LOGE(TAG, "at client urc_table initial fail");
+        return false;
+    }
+
+    s_mc665_mqtt_urc[slot].client = client;
+    s_mc665_mqtt_urc[slot].ref = 1;
+
+    return true;
+}
+
+// AT客户端不支持注销URC表，引用为0时表仍保留，没有连接时URC由处理函数忽略
+static void private_mc665_mqtt_urc_detach(at_client_t client)
+{
+    for (int i = 0; i < MC665_MQTT_CLIENT_MAX; i++)
+    {
+        if ((s_mc665_mqtt_urc[i].client == client) && (s_mc665_mqtt_urc[i].ref > 0))
+        {
+            s_mc665_mqtt_urc[i].ref--;
+        }
+    }
+}
+
+// 移出连接表并释放对URC表的引用
+static void private_mc665_mqtt_detach(mc665_mqtt_drv_t *obj)
+{
+    for (int i = 0; i < MC665_MQTT_CLIENT_MAX; i++)
     {
-        if (xQueueSend(s_mqtt_drv.queue, &urc, portMAX_DELAY) != pdTRUE)
+        if (s_mc665_mqtt_client[i] == obj)
         {
-            ESP_LOGE(TAG, "MC665 mqtt queue is full, please readjust the queue size");
-            free(urc.msg.topic);
-            free(urc.msg.data);
-            urc.msg.topic = NULL;
-            urc.msg.data = NULL;
+            s_mc665_mqtt_client[i] = NULL;
+            private_mc665_mqtt_urc_detach(obj->drv->client);
         }
     }
 }
@@ -181,127 +637,244 @@ static void private_mc665_mqtt_handler(struct at_client *client, const char *dat
 static void private_mc665_mqtt_task(void *argument)
 {
     mc665_mqtt_msg_t urc = {0};
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)argument;
 
     for (;;)
     {
-        /* 等待URC消息 */
-        xQueueReceive(s_mqtt_drv.queue, &urc, portMAX_DELAY);
+        /* 等待URC消息，空闲时检查发送超时，不需要再次发送就能得到MQTT_EVT_DELETED */
+        if (pdTRUE != xQueueReceive(obj->queue, &urc, pdMS_TO_TICKS(MC665_MQTT_EXPIRE_INTERVAL)))
+        {
+            private_mc665_mqtt_inflight_expire(obj, false);
+            continue;
+        }
 
         /* 通知应用程序进行处理 */
-        if (s_mqtt_drv.event_cb.func)
+        if (obj->event_cb.func)
         {
-            s_mqtt_drv.event_cb.func(s_mqtt_drv.event_cb.param, urc.event, (MQTT_EVT_DATA == urc.event) ? (&urc.msg) : (NULL));
+            obj->event_cb.func(obj->event_cb.param, urc.event,
+                               (MQTT_EVT_DATA == urc.event) ? (urc.data) : (((MQTT_EVT_PUBLISHED == urc.event) || (MQTT_EVT_DELETED == urc.event)) ? (&urc.msg) : (NULL)));
         }
 
-        /* 垃圾回收 */
+        /* 释放回调持有的引用 */
         if (MQTT_EVT_DATA == urc.event)
         {
-            free(urc.msg.topic);
-            free(urc.msg.data);
-            urc.msg.topic = NULL;
-            urc.msg.data = NULL;
+            mc665_mqtt_msg_unref(urc.data);
+            urc.data = NULL;
         }
     }
 }
 
-static bool private_mc665_mqtt_close(void)
+// 关闭模组中的连接，不影响自动重连
+static bool private_mc665_mqtt_disconnect(mc665_mqtt_drv_t *obj)
 {
     bool ret = false;
 
-    if (mc665_take_lock(s_mqtt_drv.drv))
+    obj->connected = false;
+
+    if (mc665_take_lock(obj->drv))
     {
-        ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTCLOSE=%d\"", MQTT_CLIENT_ID));
-        mc665_release_lock(s_mqtt_drv.drv);
-        ret = ret && (MQTT_CLOSE_BIT & xEventGroupWaitBits(s_mqtt_drv.event,
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTCLOSE=%d", obj->client_id));
+        mc665_release_lock(obj->drv);
+        ret = ret && (MQTT_CLOSE_BIT & xEventGroupWaitBits(obj->event,
                                                  MQTT_CLOSE_BIT | MQTT_DISCONNECTED_BIT,
                                                  pdTRUE, pdFALSE, pdMS_TO_TICKS(5000)));
     }
 
+    /* 连接关闭后不会再收到+MQTTPUB */
+    if (obj->mutex)
+    {
+        private_mc665_mqtt_inflight_expire(obj, true);
+    }
+
     return ret;
 }
 
-static void private_mc665_mqtt_delete(void)
+static bool private_mc665_mqtt_close(void *user_data)
 {
-    private_mc665_mqtt_close();
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
+
+    /* 主动关闭后不再重连 */
+    obj->active = false;
+
+    return private_mc665_mqtt_disconnect(obj);
+}
+
+static void private_mc665_mqtt_delete(void *user_data)
+{
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
+
+    /* 初始化失败时不能关闭其他连接使用的client id */
+    if (obj->event)
+    {
+        private_mc665_mqtt_close(obj);
+    }
+
+    private_mc665_mqtt_detach(obj);
+
+    /* 重连任务可能正持有模组锁，等待其在重连间隙退出 */
+    if (obj->reconnect_task)
+    {
+        obj->reconnect_stop = true;
+        xTaskNotifyGive(obj->reconnect_task);
+        xSemaphoreTake(obj->reconnect_exit, portMAX_DELAY);
+        obj->reconnect_task = NULL;
+    }
+
+    if (obj->reconnect_exit)
+    {
+        vSemaphoreDelete(obj->reconnect_exit);
+        obj->reconnect_exit = NULL;
+    }
+
+    if (obj->task)
+    {
+        vTaskDelete(obj->task);
+        obj->task = NULL;
+    }
+
+    for (int i = 0; i < obj->sub_num; i++)
+    {
+        free(obj->sub_list[i].topic);
+        obj->sub_list[i].topic = NULL;
+    }
 
-    if (s_mqtt_drv.task)
+    obj->sub_num = 0;
+
+    if (obj->event)
+    {
+        vEventGroupDelete(obj->event);
+        obj->event = NULL;
+    }
+
+    if (obj->queue)
+    {
+        vQueueDelete(obj->queue);
+        obj->queue = NULL;
+    }
+
+    if (obj->window)
     {
-        vTaskDelete(s_mqtt_drv.task);
-        s_mqtt_drv.task = NULL;
+        vSemaphoreDelete(obj->window);
+        obj->window = NULL;
     }
 
-    if (s_mqtt_drv.event)
+    if (obj->pool_free)
     {
-        vEventGroupDelete(s_mqtt_drv.event);
-        s_mqtt_drv.event = NULL;
+        vQueueDelete(obj->pool_free);
+        obj->pool_free = NULL;
     }
 
-    if (s_mqtt_drv.queue)
+    if (obj->pool)
     {
-        vQueueDelete(s_mqtt_drv.queue);
-        s_mqtt_drv.queue = NULL;
+        free(obj->pool);
+        obj->pool = NULL;
     }
 
-    if (s_mqtt_drv.cfg.uri)
+    if (obj->mutex)
     {
-        free((void *)s_mqtt_drv.cfg.uri);
-        s_mqtt_drv.cfg.uri = NULL;
+        vSemaphoreDelete(obj->mutex);
+        obj->mutex = NULL;
     }
 
-    if (s_mqtt_drv.cfg.client_id)
+    if (obj->cfg.uri)
     {
-        free((void *)s_mqtt_drv.cfg.client_id);
-        s_mqtt_drv.cfg.client_id = NULL;
+        free((void *)obj->cfg.uri);
+        obj->cfg.uri = NULL;
+    }
+
+    if (obj->cfg.client_id)
+    {
+        free((void *)obj->cfg.client_id);
+        obj->cfg.client_id = NULL;
     }
 }
 
-static bool private_mc665_mqtt_init(mqtt_cfg_t *cfg)
+static bool private_mc665_mqtt_init(void *user_data, mqtt_cfg_t *cfg)
 {
     bool ret = false;
-    mc665_drv_t *obj = s_mqtt_drv.drv;
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
 
-    if (!obj)
+    if (!obj->drv)
     {
         ESP_LOGE(TAG, "The MC665 driver is NULL! please pass the mc665_drv_t pointer and retry!");
         goto __exit;
     }
 
-    /* 初始化URC */
-    s_urc_table[0].cmd_prefix = "+MQTT";
-    s_urc_table[0].cmd_suffix = "\r\n";
-    s_urc_table[0].func = private_mc665_mqtt_handler;
-    if (at_set_urc_table(s_urc_table, 1))
+    /* 初始化URC，同一AT客户端上的连接共用一张表，按client id分发 */
+    if (!private_mc665_mqtt_urc_attach(obj->drv->client))
     {
-        ESP_LOGE(TAG, "at client urc_table initial fail");
         goto __exit;
     }
 
-    s_mqtt_drv.event = xEventGroupCreate();
-    if (!s_mqtt_drv.event)
+    obj->client_id = (obj->client_id > 0) ? (obj->client_id) : (MC665_MQTT_CLIENT_DEFAULT);
+    if (!private_mc665_mqtt_attach(obj))
+    {
+        private_mc665_mqtt_urc_detach(obj->drv->client);
+        goto __exit;
+    }
+
+    obj->event = xEventGroupCreate();
+    if (!obj->event)
     {
         ESP_LOGE(TAG, "Create event_group object failed! memory not enough");
         goto __exit;
     }
 
-    s_mqtt_drv.cfg.port = (0 == cfg->port) ? (1883) : (cfg->port);
-    s_mqtt_drv.cfg.client_id = (cfg->client_id) ? (strdup(cfg->client_id)) : (NULL);
-    s_mqtt_drv.cfg.uri = (cfg->uri) ? (strdup(cfg->uri)) : (NULL);
-    (!s_mqtt_drv.cfg.uri && cfg->host) ? (s_mqtt_drv.cfg.uri = strdup(cfg->host)) : (0);
-    if (!s_mqtt_drv.cfg.uri)
+    obj->mutex = xSemaphoreCreateMutex();
+    if (!obj->mutex)
+    {
+        ESP_LOGE(TAG, "Create mutex object failed! memory not enough");
+        goto __exit;
+    }
+
+    /* 发送窗口，每条消息占用一个位置直到收到+MQTTPUB */
+    obj->inflight = (obj->inflight > 0) ? (obj->inflight) : (MC665_MQTT_INFLIGHT_DEFAULT);
+    (obj->inflight > MC665_MQTT_INFLIGHT_MAX) ? (obj->inflight = MC665_MQTT_INFLIGHT_MAX) : (0);
+    obj->window = xSemaphoreCreateCounting(obj->inflight, obj->inflight);
+    if (!obj->window)
+    {
+        ESP_LOGE(TAG, "Create semaphore object failed! memory not enough");
+        goto __exit;
+    }
+
+    /* 消息池，块大小按4字节对齐 */
+    obj->pool_num = (obj->pool_num > 0) ? (obj->pool_num) : (MC665_MQTT_POOL_NUM);
+    obj->pool_size = (obj->pool_size > 0) ? (obj->pool_size) : (MC665_MQTT_POOL_SIZE);
+    obj->pool_size = (obj->pool_size + 3) & ~3;
+    obj->pool = malloc(obj->pool_num * obj->pool_size);
+    obj->pool_free = xQueueCreate(obj->pool_num, sizeof(mc665_mqtt_block_t *));
+    if (!obj->pool || !obj->pool_free)
+    {
+        ESP_LOGE(TAG, "Create mqtt message pool failed! memory not enough");
+        goto __exit;
+    }
+
+    for (int i = 0; i < obj->pool_num; i++)
+    {
+        mc665_mqtt_block_t *block = (mc665_mqtt_block_t *)(obj->pool + i * obj->pool_size);
+        xQueueSend(obj->pool_free, &block, 0);
+    }
+
+    obj->cfg.port = (0 == cfg->port) ? (1883) : (cfg->port);
+    obj->cfg.client_id = (cfg->client_id) ? (strdup(cfg->client_id)) : (NULL);
+    obj->cfg.uri = (cfg->uri) ? (strdup(cfg->uri)) : (NULL);
+    (!obj->cfg.uri && cfg->host) ? (obj->cfg.uri = strdup(cfg->host)) : (0);
+    if (!obj->cfg.uri)
     {
         ESP_LOGE(TAG, "URL duplicate failed!");
         goto __exit;
     }
 
-    s_mqtt_drv.queue = xQueueCreate(10, sizeof(mc665_mqtt_msg_t));
-    if (!s_mqtt_drv.queue)
+    obj->queue_len = (obj->queue_len > 0) ? (obj->queue_len) : (MC665_MQTT_QUEUE_LEN);
+    obj->queue = xQueueCreate(obj->queue_len, sizeof(mc665_mqtt_msg_t));
+    if (!obj->queue)
     {
         ESP_LOGE(TAG, "mc665_urc_queue create failed! memory not enough");
         goto __exit;
     }
 
-    xTaskCreate(private_mc665_mqtt_task, "mc665_mqtt_task", 1024 * 4, NULL, 6, &s_mqtt_drv.task);
-    if (!s_mqtt_drv.task)
+    xTaskCreate(private_mc665_mqtt_task, "mc665_mqtt_task", 1024 * 4, obj, 6, &obj->task);
+    if (!obj->task)
     {
         ESP_LOGE(TAG, "mc665_mqtt_task create failed! memory not enough");
         goto __exit;
@@ -314,120 +887,445 @@ __exit:
 
     if (!ret)
     {
-        private_mc665_mqtt_delete();
+        private_mc665_mqtt_delete(obj);
     }
 
     return ret;
 }
 
-static bool private_mc665_mqtt_open(void)
+static bool private_mc665_mqtt_connect(mc665_mqtt_drv_t *obj, const char *host)
 {
     bool ret = false;
 
-    if (s_mqtt_drv.cfg.uri)
+    if (mc665_take_lock(obj->drv))
     {
-        if (mc665_take_lock(s_mqtt_drv.drv))
+        if (obj->cfg.client_id)
+        {
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTUSER=%d,\"\",\"\",\"%s\"", obj->client_id, obj->cfg.client_id));
+        }
+        else
+        {
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTUSER=%d,\"\",\"\"", obj->client_id));
+        }
+
+        /* 0: Default value. Report the content of the topic and payload directly by the MQTTMSG command.
+        1: Report the length of the topic and payload by the MQTTMSGI command */
+        ret = ret && (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTCONF=1"));
+        /* 清除上次断开留下的事件，避免本次连接立即判定为失败 */
+        xEventGroupClearBits(obj->event, MQTT_CONNECTED_BIT | MQTT_DISCONNECTED_BIT);
+        ret = ret && (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTOPEN=%d,\"%s\",%d,0,60", obj->client_id, host, obj->cfg.port));
+        mc665_release_lock(obj->drv);
+
+        if (ret)
         {
-            if (s_mqtt_drv.cfg.client_id)
+            if (MQTT_CONNECTED_BIT & xEventGroupWaitBits(obj->event,
+                                                         MQTT_CONNECTED_BIT | MQTT_DISCONNECTED_BIT,
+                                                         pdTRUE, pdFALSE, pdMS_TO_TICKS(30000)))
             {
-                ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTUSER=%d,\"\",\"\",\"%s\"", MQTT_CLIENT_ID, s_mqtt_drv.cfg.client_id));
+                obj->connected = true;
+                ESP_LOGI(TAG, "MC665 mqtt connect success!");
             }
             else
             {
-                ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTUSER=%d,\"\",\"\"", MQTT_CLIENT_ID));
+                ret = false;
+                ESP_LOGE(TAG, "MC665 mqtt connect failed!");
             }
+        }
+    }
+
+    return ret;
+}
 
-            /* 0: Default value. Report the content of the topic and payload directly by the MQTTMSG command.
-            1: Report the length of the topic and payload by the MQTTMSGI command */
-            ret = ret && (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTCONF=1"));
-            ret = ret && (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTOPEN=%d,\"%s\",%d,0,60", MQTT_CLIENT_ID, s_mqtt_drv.cfg.uri, s_mqtt_drv.cfg.port));
-            mc665_release_lock(s_mqtt_drv.drv);
+static bool private_mc665_mqtt_establish(mc665_mqtt_drv_t *obj)
+{
+    bool ret = false;
+    char ip[MC665_DNS_IP_LEN] = {0};
+    int64_t start = esp_timer_get_time();
 
-            if (ret)
+    if (obj->cfg.uri)
+    {
+        /* 优先使用缓存的IP连接，失败后清除缓存并使用域名重试 */
+        if (obj->dns && mc665_dns_resolve(obj->dns, obj->cfg.uri, ip, sizeof(ip), pdMS_TO_TICKS(10000)))
+        {
+            ret = private_mc665_mqtt_connect(obj, ip);
+
+            if (!ret)
             {
-                if (MQTT_CONNECTED_BIT & xEventGroupWaitBits(s_mqtt_drv.event,
-                                                             MQTT_CONNECTED_BIT | MQTT_DISCONNECTED_BIT,
-                                                             pdTRUE, pdFALSE, pdMS_TO_TICKS(30000)))
-                {
-                    ESP_LOGI(TAG, "MC665 mqtt connect success!");
-                }
-                else
-                {
-                    ret = false;
-                    ESP_LOGE(TAG, "MC665 mqtt connect failed!");
-                }
+                mc665_dns_invalidate(obj->dns, obj->cfg.uri);
+            }
+        }
+
+        ret = ret || (strcmp(ip, obj->cfg.uri) && private_mc665_mqtt_connect(obj, obj->cfg.uri));
+        ESP_LOGI(TAG, "MC665 mqtt open took %d ms", (int)((esp_timer_get_time() - start) / 1000));
+    }
+
+    return ret;
+}
+
+// 记录或移除订阅，调用前需持有模组锁
+static void private_mc665_mqtt_sub_track(mc665_mqtt_drv_t *obj, const char *topic, int qos, bool add)
+{
+    int i = 0;
+
+    for (i = 0; (i < obj->sub_num) && strcmp(obj->sub_list[i].topic, topic); i++)
+    {
+    }
+
+    if ((i < obj->sub_num) && !add)
+    {
+        free(obj->sub_list[i].topic);
+        obj->sub_list[i] = obj->sub_list[--obj->sub_num];
+    }
+    else if (i < obj->sub_num)
+    {
+        obj->sub_list[i].qos = qos;
+    }
+    else if (add && (obj->sub_num < MC665_MQTT_SUB_MAX) && (obj->sub_list[i].topic = strdup(topic)))
+    {
+        obj->sub_list[i].qos = qos;
+        obj->sub_num++;
+    }
+    else if (add)
+    {
+        ESP_LOGW(TAG, "%s will not be restored after reconnect", topic);
+    }
+}
+
+// 连续发送全部订阅指令后统一等待+MQTTSUB
+static bool private_mc665_mqtt_resubscribe(mc665_mqtt_drv_t *obj)
+{
+    int sent = 0;
+    bool ret = true;
+
+    if (!mc665_take_lock(obj->drv))
+    {
+        return false;
+    }
+
+    obj->sub_ack = 0;
+    xEventGroupClearBits(obj->event, MQTT_SUBSCRIBE_BIT | MQTT_SUBSCRIBE_FAIL_BIT);
+
+    for (int i = 0; ret && (i < obj->sub_num); i++)
+    {
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTSUB=%d,\"%s\",%d", obj->client_id, obj->sub_list[i].topic, obj->sub_list[i].qos));
+        (ret) ? (sent++) : (0);
+    }
+
+    mc665_release_lock(obj->drv);
+
+    while (ret && (obj->sub_ack < sent))
+    {
+        ret = (MQTT_SUBSCRIBE_BIT == (xEventGroupWaitBits(obj->event,
+                                                          MQTT_SUBSCRIBE_BIT | MQTT_SUBSCRIBE_FAIL_BIT | MQTT_DISCONNECTED_BIT,
+                                                          pdTRUE, pdFALSE, pdMS_TO_TICKS(5000)) &
+                                      (MQTT_SUBSCRIBE_BIT | MQTT_SUBSCRIBE_FAIL_BIT | MQTT_DISCONNECTED_BIT)));
+    }
+
+    if (!ret)
+    {
+        ESP_LOGE(TAG, "MC665 mqtt resubscribe failed (%d/%d)", obj->sub_ack, sent);
+    }
+
+    return ret;
+}
+
+// 断开后按指数退避重连，网络未就绪时等待mqtt_open在获取IP后唤醒
+static void private_mc665_mqtt_reconnect_task(void *argument)
+{
+    uint32_t cost = 0;
+    uint32_t delay = 0;
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)argument;
+
+    while (!obj->reconnect_stop)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (!obj->reconnect_stop && obj->active && !obj->connected && (MC665_STATUS_READY == obj->drv->status))
+        {
+            /* 随机等待，避免大量设备同时重连 */
+            delay = obj->backoff / 2 + esp_random() % (obj->backoff / 2 + 1);
+            ESP_LOGI(TAG, "MC665 mqtt reconnect in %u ms", (unsigned int)delay);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(delay));
+
+            if (obj->reconnect_stop || !obj->active || obj->connected)
+            {
+                break;
+            }
+
+            if (private_mc665_mqtt_establish(obj) && private_mc665_mqtt_resubscribe(obj))
+            {
+                cost = (esp_timer_get_time() - obj->break_time) / 1000;
+                obj->backoff = MC665_MQTT_BACKOFF_MIN;
+                obj->reconnect_stats.reconnect_num++;
+                obj->reconnect_stats.last_ms = cost;
+                obj->reconnect_stats.total_ms += cost;
+                (cost > obj->reconnect_stats.max_ms) ? (obj->reconnect_stats.max_ms = cost) : (0);
+                ESP_LOGI(TAG, "MC665 mqtt reconnected after %u ms", (unsigned int)cost);
+            }
+            else
+            {
+                /* 订阅未能恢复时断开重来 */
+                (obj->connected) ? (private_mc665_mqtt_disconnect(obj)) : (0);
+                obj->reconnect_stats.attempt_num++;
+                obj->backoff = (obj->backoff * 2 > MC665_MQTT_BACKOFF_MAX) ? (MC665_MQTT_BACKOFF_MAX) : (obj->backoff * 2);
             }
         }
     }
 
+    /* 不在持有模组锁时退出 */
+    xSemaphoreGive(obj->reconnect_exit);
+    vTaskDelete(NULL);
+}
+
+// 打开后断线由驱动自动重连，重复调用时立即唤醒重连任务
+static bool private_mc665_mqtt_open(void *user_data)
+{
+    bool ret = false;
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
+
+    if (!obj->reconnect_task)
+    {
+        obj->reconnect_stop = false;
+        (!obj->reconnect_exit) ? (obj->reconnect_exit = xSemaphoreCreateBinary()) : (0);
+
+        if (obj->reconnect_exit)
+        {
+            xTaskCreate(private_mc665_mqtt_reconnect_task, "mc665_mqtt_reconnect", 1024 * 3, obj, 5, &obj->reconnect_task);
+        }
+
+        if (!obj->reconnect_task)
+        {
+            ESP_LOGE(TAG, "mc665_mqtt_reconnect create failed! memory not enough");
+        }
+    }
+
+    if (obj->active)
+    {
+        obj->backoff = MC665_MQTT_BACKOFF_MIN;
+
+        if (!obj->connected && obj->reconnect_task)
+        {
+            xTaskNotifyGive(obj->reconnect_task);
+        }
+
+        return obj->connected;
+    }
+
+    obj->active = true;
+    obj->backoff = MC665_MQTT_BACKOFF_MIN;
+    ret = private_mc665_mqtt_establish(obj);
+
+    if (!ret && obj->reconnect_task)
+    {
+        obj->break_time = esp_timer_get_time();
+        xTaskNotifyGive(obj->reconnect_task);
+    }
+
     return ret;
 }
 
-static bool private_mc665_mqtt_subscribe(const char *topic, int qos)
+static bool private_mc665_mqtt_subscribe(void *user_data, const char *topic, int qos)
 {
     bool ret = false;
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
 
-    if (mc665_take_lock(s_mqtt_drv.drv))
+    if (mc665_take_lock(obj->drv))
     {
-        ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTSUB=%d,\"%s\",%d", MQTT_CLIENT_ID, topic, qos));
-        mc665_release_lock(s_mqtt_drv.drv);
-        ret = ret && (MQTT_SUBSCRIBE_BIT & xEventGroupWaitBits(s_mqtt_drv.event,
-                                                               MQTT_SUBSCRIBE_BIT | MQTT_DISCONNECTED_BIT,
-                                                               pdTRUE, pdFALSE, pdMS_TO_TICKS(5000)));
+        xEventGroupClearBits(obj->event, MQTT_SUBSCRIBE_BIT | MQTT_SUBSCRIBE_FAIL_BIT);
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTSUB=%d,\"%s\",%d", obj->client_id, topic, qos));
+        mc665_release_lock(obj->drv);
+
+        /* 订阅被拒绝时返回失败，不记录到重连后恢复的订阅中 */
+        ret = ret && (MQTT_SUBSCRIBE_BIT == (xEventGroupWaitBits(obj->event,
+                                                                 MQTT_SUBSCRIBE_BIT | MQTT_SUBSCRIBE_FAIL_BIT | MQTT_DISCONNECTED_BIT,
+                                                                 pdTRUE, pdFALSE, pdMS_TO_TICKS(5000)) &
+                                             (MQTT_SUBSCRIBE_BIT | MQTT_SUBSCRIBE_FAIL_BIT | MQTT_DISCONNECTED_BIT)));
+    }
+
+    if (ret && mc665_take_lock(obj->drv))
+    {
+        private_mc665_mqtt_sub_track(obj, topic, qos, true);
+        mc665_release_lock(obj->drv);
     }
 
     return ret;
 }
 
-static bool private_mc665_mqtt_unsubscribe(const char *topic)
+static bool private_mc665_mqtt_unsubscribe(void *user_data, const char *topic)
 {
     bool ret = false;
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
 
-    if (mc665_take_lock(s_mqtt_drv.drv))
+    if (mc665_take_lock(obj->drv))
     {
-        ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTUNSUB=%d,\"%s\"", MQTT_CLIENT_ID, topic));
-        mc665_release_lock(s_mqtt_drv.drv);
-        ret = ret && (MQTT_UNSUBSCRIBE_BIT & xEventGroupWaitBits(s_mqtt_drv.event,
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTUNSUB=%d,\"%s\"", obj->client_id, topic));
+        mc665_release_lock(obj->drv);
+        ret = ret && (MQTT_UNSUBSCRIBE_BIT & xEventGroupWaitBits(obj->event,
                                                                  MQTT_UNSUBSCRIBE_BIT | MQTT_DISCONNECTED_BIT,
                                                                  pdTRUE, pdFALSE, pdMS_TO_TICKS(5000)));
     }
 
+    /* 取消失败时也不再恢复该订阅 */
+    if (mc665_take_lock(obj->drv))
+    {
+        private_mc665_mqtt_sub_track(obj, topic, 0, false);
+        mc665_release_lock(obj->drv);
+    }
+
     return ret;
 }
 
-static bool private_mc665_mqtt_publish(const char *topic, const char *data, int len, int qos, int retain)
+// 发送一条消息但不等待+MQTTPUB，waiter不为空时在完成或超时时通知，失败时返回-1
+static int private_mc665_mqtt_send(mc665_mqtt_drv_t *obj, const char *topic, const char *data, int len, int qos, int retain, mc665_mqtt_waiter_t *waiter)
 {
     bool ret = false;
+    int msg_id = -1;
+    int slot = 0;
+    bool removed = false;
+
+    /* 窗口已满时等待最早的消息完成或超时 */
+    private_mc665_mqtt_inflight_expire(obj, false);
+    if (pdTRUE != xSemaphoreTake(obj->window, pdMS_TO_TICKS(MC665_MQTT_PUBLISH_TIMEOUT)))
+    {
+        private_mc665_mqtt_inflight_expire(obj, false);
+
+        if (pdTRUE != xSemaphoreTake(obj->window, 0))
+        {
+            ESP_LOGE(TAG, "MC665 mqtt publish window is full");
+            return -1;
+        }
+    }
 
-    if (mc665_take_lock(s_mqtt_drv.drv))
+    if (mc665_take_lock(obj->drv))
     {
-        at_set_end_sign('>');
-        ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, "AT+MQTTPUB=%d,\"%s\",%d,%d,%d", MQTT_CLIENT_ID, topic, qos, retain, len));
-        at_set_end_sign(0);
+        /* 先加入FIFO再发送，+MQTTPUB可能在发送命令返回前到达 */
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            /* 已持有窗口，FIFO满时队首一定是超时的位置，应答丢失时在此重新同步 */
+            if ((MC665_MQTT_INFLIGHT_MAX == obj->inflight_num) && obj->inflight_list[obj->inflight_head].expired)
+            {
+                ESP_LOGW(TAG, "mqtt message %d ack lost, drop it", obj->inflight_list[obj->inflight_head].msg_id);
+                obj->inflight_head = (obj->inflight_head + 1) % MC665_MQTT_INFLIGHT_MAX;
+                obj->inflight_num--;
+            }
+
+            obj->next_id = (obj->next_id % 0xFFFF) + 1;
+            msg_id = obj->next_id;
+            slot = (obj->inflight_head + obj->inflight_num) % MC665_MQTT_INFLIGHT_MAX;
+            obj->inflight_list[slot].msg_id = msg_id;
+            obj->inflight_list[slot].time = esp_timer_get_time();
+            obj->inflight_list[slot].expired = false;
+            obj->inflight_list[slot].waiter = waiter;
+            obj->inflight_num++;
+            xSemaphoreGive(obj->mutex);
+        }
+
+        at_obj_set_end_sign(obj->drv->client, '>');
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MQTTPUB=%d,\"%s\",%d,%d,%d", obj->client_id, topic, qos, retain, len));
+        at_obj_set_end_sign(obj->drv->client, 0);
 
         if (ret)
         {
-            at_client_send(data, len);
-            ret = (0 == at_exec_cmd(s_mqtt_drv.drv->resp, ""));
+            at_client_obj_send(obj->drv->client, data, len);
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, ""));
+        }
+
+        /* 发送失败时移除队尾，持有模组锁期间队尾只能是本条消息 */
+        if (!ret && (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+        {
+            if (obj->inflight_num && (obj->inflight_list[slot].msg_id == msg_id) && !obj->inflight_list[slot].expired &&
+                (slot == (obj->inflight_head + obj->inflight_num - 1) % MC665_MQTT_INFLIGHT_MAX))
+            {
+                removed = true;
+                obj->inflight_list[slot].waiter = NULL;
+                obj->inflight_num--;
+            }
+
+            xSemaphoreGive(obj->mutex);
+        }
+
+        mc665_release_lock(obj->drv);
+    }
+    else
+    {
+        removed = true;
+    }
+
+    if (!ret)
+    {
+        if (removed)
+        {
+            xSemaphoreGive(obj->window);
         }
 
-        mc665_release_lock(s_mqtt_drv.drv);
-        ret = ret && (MQTT_PUBLISH_BIT & xEventGroupWaitBits(s_mqtt_drv.event,
-                                                             MQTT_PUBLISH_BIT | MQTT_DISCONNECTED_BIT,
-                                                             pdTRUE, pdFALSE, pdMS_TO_TICKS(5000)));
+        msg_id = -1;
     }
 
+    return msg_id;
+}
+
+// 异步发送，结果以MQTT_EVT_PUBLISHED/MQTT_EVT_DELETED和返回的消息ID通知
+static int private_mc665_mqtt_publish_async(void *user_data, const char *topic, const char *data, int len, int qos, int retain)
+{
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
+
+    return private_mc665_mqtt_send(obj, topic, data, len, qos, retain, NULL);
+}
+
+// 每次调用使用栈上的信号量等待本条消息的结果，不与其他发送共用事件位
+static bool private_mc665_mqtt_publish(void *user_data, const char *topic, const char *data, int len, int qos, int retain)
+{
+    bool ret = false;
+    mc665_mqtt_waiter_t waiter = {0};
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
+
+    waiter.done = xSemaphoreCreateBinaryStatic(&waiter.buf);
+
+    if (private_mc665_mqtt_send(obj, topic, data, len, qos, retain, &waiter) < 0)
+    {
+        vSemaphoreDelete(waiter.done);
+        return false;
+    }
+
+    if (pdTRUE == xSemaphoreTake(waiter.done, pdMS_TO_TICKS(MC665_MQTT_PUBLISH_TIMEOUT)))
+    {
+        ret = waiter.ok;
+    }
+    else
+    {
+        /* 在等待路径中处理超时，消息被丢弃时立即通知 */
+        private_mc665_mqtt_inflight_expire(obj, false);
+
+        /* 返回后waiter失效，仍未完成时从FIFO中解除 */
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            for (int i = 0; i < obj->inflight_num; i++)
+            {
+                mc665_mqtt_inflight_t *item = &obj->inflight_list[(obj->inflight_head + i) % MC665_MQTT_INFLIGHT_MAX];
+                (item->waiter == &waiter) ? (item->waiter = NULL) : (0);
+            }
+
+            xSemaphoreGive(obj->mutex);
+        }
+
+        ret = (pdTRUE == xSemaphoreTake(waiter.done, 0)) && waiter.ok;
+    }
+
+    vSemaphoreDelete(waiter.done);
+
     return ret;
 }
 
-static mqtt_err_def private_mc665_mqtt_error_code(void)
+static mqtt_err_def private_mc665_mqtt_error_code(void *user_data)
 {
     return MQTT_ERR_NONE;
 }
 
-static void private_mc665_mqtt_register_callback(mqtt_event_cb_t *cb)
+static void private_mc665_mqtt_register_callback(void *user_data, mqtt_event_cb_t *cb)
 {
-    s_mqtt_drv.event_cb = *cb;
+    mc665_mqtt_drv_t *obj = (mc665_mqtt_drv_t *)user_data;
+
+    obj->event_cb = *cb;
 }
 
 void mc665_mqtt_drv_get(mqtt_drv_t *drv)
@@ -439,6 +1337,7 @@ void mc665_mqtt_drv_get(mqtt_drv_t *drv)
         drv->init = private_mc665_mqtt_init;
         drv->open = private_mc665_mqtt_open;
         drv->publish = private_mc665_mqtt_publish;
+        drv->publish_async = private_mc665_mqtt_publish_async;
         drv->subscribe = private_mc665_mqtt_subscribe;
         drv->unsubscribe = private_mc665_mqtt_unsubscribe;
         drv->error_code = private_mc665_mqtt_error_code;
@@ -446,9 +1345,7 @@ void mc665_mqtt_drv_get(mqtt_drv_t *drv)
 
         if (!drv->user_data)
         {
-            ESP_LOGE(TAG, "The user_data is NULL! please pass the mc665_drv_t pointer and retry!");
+            ESP_LOGE(TAG, "The user_data is NULL! please pass the mc665_mqtt_drv_t pointer and retry!");
         }
-
-        s_mqtt_drv.drv = drv->user_data;
     }
 }
\ No newline at end of file
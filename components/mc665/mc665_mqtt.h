@@ -1,5 +1,172 @@
 #pragma once
 
+#include "mc665.h"
+#include "mc665_dns.h"
 #include "mqtt_interface.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
-void mc665_mqtt_drv_get(mqtt_drv_t *drv);
\ No newline at end of file
+/* 一个模组上同时使用的最大连接数，每个连接使用不同的模组MQTT client id */
+#define MC665_MQTT_CLIENT_MAX 4
+#define MC665_MQTT_CLIENT_DEFAULT 1
+/* 同时等待+MQTTPUB的最大消息数，每条占用两个事件位 */
+#define MC665_MQTT_INFLIGHT_MAX 8
+#define MC665_MQTT_INFLIGHT_DEFAULT 4
+/* 等待+MQTTPUB的超时时间(ms)，超时的消息以MQTT_EVT_DELETED通知 */
+#define MC665_MQTT_PUBLISH_TIMEOUT 5000
+
+/* 自动重连的等待时间(ms)，每次失败加倍，实际等待时间在其一半到全部之间随机 */
+#define MC665_MQTT_BACKOFF_MIN 1000
+#define MC665_MQTT_BACKOFF_MAX 60000
+/* 重连后恢复的最大订阅数 */
+#define MC665_MQTT_SUB_MAX 16
+
+/* 接收队列长度，以及BLOCK策略下解析线程最多等待的时间(ms) */
+#define MC665_MQTT_QUEUE_LEN 10
+#define MC665_MQTT_QUEUE_BLOCK_TIME 100
+
+/* 接收队列已满时的处理策略，解析线程不会无限等待 */
+typedef enum
+{
+    /* 等待MC665_MQTT_QUEUE_BLOCK_TIME后丢弃新消息 */
+    MC665_MQTT_QUEUE_BLOCK,
+    MC665_MQTT_QUEUE_DROP_OLDEST,
+    MC665_MQTT_QUEUE_DROP_NEWEST,
+    /* 优先主题插入队首，满时丢弃最早的消息，其他主题丢弃新消息 */
+    MC665_MQTT_QUEUE_PRIORITY
+} mc665_mqtt_queue_policy_def;
+
+/* 接收消息池，每块连续存放消息头、topic和payload，
+   超出块大小或池已用完时单独分配一块 */
+#define MC665_MQTT_POOL_NUM 8
+#define MC665_MQTT_POOL_SIZE 512
+
+/* 阻塞发送的等待者，位于发送任务的栈上 */
+typedef struct
+{
+    StaticSemaphore_t buf;
+    SemaphoreHandle_t done;
+    bool ok;
+} mc665_mqtt_waiter_t;
+
+typedef struct
+{
+    int msg_id;
+    int64_t time;
+    /* 已超时并通知MQTT_EVT_DELETED，仍保留位置一段时间等待迟到的+MQTTPUB */
+    bool expired;
+    mc665_mqtt_waiter_t *waiter;
+} mc665_mqtt_inflight_t;
+
+typedef struct
+{
+    void *owner;
+    /* 引用计数，回调返回后释放一次，为0时归还 */
+    int ref;
+    bool pooled;
+    mqtt_msg_t msg;
+    char buf[];
+} mc665_mqtt_block_t;
+
+typedef struct
+{
+    uint32_t alloc_num;
+    /* 池外分配和分配失败的次数 */
+    uint32_t fallback_num;
+    uint32_t fail_num;
+    uint32_t used;
+    uint32_t used_peak;
+    /* 解析线程中分配消息的耗时 */
+    uint32_t alloc_max_us;
+    uint64_t alloc_total_us;
+} mc665_mqtt_pool_stats_t;
+
+typedef struct
+{
+    uint32_t post_num;
+    /* 队列中消息数的最大值 */
+    uint32_t high_water;
+    uint32_t depth;
+    /* BLOCK策略下等待超时的次数 */
+    uint32_t block_timeout_num;
+    uint32_t drop_newest_num;
+    uint32_t drop_oldest_num;
+    /* 丢失的连接、订阅和发送结果事件 */
+    uint32_t event_drop_num;
+} mc665_mqtt_queue_stats_t;
+
+typedef struct
+{
+    char *topic;
+    int qos;
+} mc665_mqtt_sub_t;
+
+typedef struct
+{
+    uint32_t break_num;
+    uint32_t reconnect_num;
+    /* 失败的重连次数 */
+    uint32_t attempt_num;
+    /* 从断开到重连成功的时间 */
+    uint32_t last_ms;
+    uint32_t max_ms;
+    uint32_t total_ms;
+} mc665_mqtt_reconnect_stats_t;
+
+typedef struct
+{
+    mc665_drv_t *drv;
+    /* 域名缓存，为空时由模组解析域名 */
+    mc665_dns_drv_t *dns;
+    /* 模组中的MQTT client id，为0时使用MC665_MQTT_CLIENT_DEFAULT，URC按此分发 */
+    int client_id;
+    mqtt_cfg_t cfg;
+    /* 发送窗口大小，为0时使用MC665_MQTT_INFLIGHT_DEFAULT */
+    int inflight;
+    /* 消息池块数和每块大小，为0时使用默认值 */
+    int pool_num;
+    int pool_size;
+    uint8_t *pool;
+    QueueHandle_t pool_free;
+    mc665_mqtt_pool_stats_t pool_stats;
+    /* 接收队列长度和满时的策略，长度为0时使用MC665_MQTT_QUEUE_LEN */
+    int queue_len;
+    mc665_mqtt_queue_policy_def policy;
+    /* PRIORITY策略下的优先主题前缀 */
+    const char *const *priority_topic;
+    int priority_num;
+    mc665_mqtt_queue_stats_t queue_stats;
+    mqtt_event_cb_t event_cb;
+    EventGroupHandle_t event;
+    TaskHandle_t task;
+    QueueHandle_t queue;
+    /* 模组按发送顺序返回+MQTTPUB，以FIFO对应消息ID，超时的消息留在队首等待迟到的应答，
+       超过MC665_MQTT_TOMBSTONE_TIMEOUT后移除 */
+    SemaphoreHandle_t mutex;
+    SemaphoreHandle_t window;
+    uint16_t next_id;
+    int inflight_head;
+    int inflight_num;
+    mc665_mqtt_inflight_t inflight_list[MC665_MQTT_INFLIGHT_MAX];
+    /* mqtt_open后由驱动自动重连，mqtt_close后停止 */
+    bool active;
+    bool connected;
+    TaskHandle_t reconnect_task;
+    /* 重连任务收到stop后在重连间隙退出，并通过reconnect_exit应答 */
+    volatile bool reconnect_stop;
+    SemaphoreHandle_t reconnect_exit;
+    uint32_t backoff;
+    int64_t break_time;
+    mc665_mqtt_reconnect_stats_t reconnect_stats;
+    /* 已订阅的主题，由模组锁保护，重连后一次性恢复 */
+    int sub_num;
+    int sub_ack;
+    mc665_mqtt_sub_t sub_list[MC665_MQTT_SUB_MAX];
+} mc665_mqtt_drv_t;
+
+void mc665_mqtt_drv_get(mqtt_drv_t *drv);
+/* 在MQTT_EVT_DATA回调中增加引用以便在回调返回后继续使用消息，用完后释放 */
+mqtt_msg_t *mc665_mqtt_msg_ref(mqtt_msg_t *msg);
+void mc665_mqtt_msg_unref(mqtt_msg_t *msg);
+void mc665_mqtt_get_queue_stats(mc665_mqtt_drv_t *obj, mc665_mqtt_queue_stats_t *stats);
\ No newline at end of file
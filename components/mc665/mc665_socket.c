@@ -0,0 +1,640 @@
+#include "mc665_socket.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOCKET_CONNECTED_BIT BIT0
+#define SOCKET_CLOSED_BIT BIT1
+#define SOCKET_RECV_DATA_BIT BIT2
+#define SOCKET_ALL_BITS (SOCKET_CONNECTED_BIT | SOCKET_CLOSED_BIT | SOCKET_RECV_DATA_BIT)
+
+/* UDP数据报在接收缓冲中的长度前缀 */
+#define SOCKET_DGRAM_HEAD 2
+
+/* 每个socket占用事件组中的4位 */
+#define SOCKET_EVENT_BITS(id, bits) ((EventBits_t)(bits) << ((id) * 4))
+
+static const char *TAG = "mc665_socket";
+
+static bool private_mc665_socket_id_is_valid(int id)
+{
+    return (id >= 0) && (id < MC665_SOCKET_NUM);
+}
+
+static void private_mc665_socket_reset(mc665_socket_t *sock)
+{
+    sock->head = 0;
+    sock->tail = 0;
+    sock->count = 0;
+    sock->overflow = 0;
+}
+
+/* 逐个字符读取数据前的字段，直到读取到指定数量的',' */
+static int private_mc665_socket_read_fields(struct at_client *client, char *buf, int size, int fields)
+{
+    char ch = 0;
+    int len = 0;
+
+    while ((fields > 0) && (len < size - 1))
+    {
+        if (1 != at_client_obj_recv(client, &ch, 1, 20))
+        {
+            break;
+        }
+
+        buf[len++] = ch;
+        (',' == ch) ? (fields--) : (0);
+    }
+
+    buf[len] = '\0';
+
+    return (fields) ? (-1) : (len);
+}
+
+/* 将串口中的数据直接读入socket的环形缓冲，缓冲区满时丢弃剩余数据 */
+static void private_mc665_socket_fill(mc665_socket_drv_t *obj, struct at_client *client, int id, int len)
+{
+    int head = 0;
+    int space = 0;
+    int seg_len = 0;
+    int recv_len = 0;
+    char discard[32] = {0};
+    mc665_socket_t *sock = private_mc665_socket_id_is_valid(id) ? (&obj->socket[id]) : (NULL);
+
+    while (len > 0)
+    {
+        space = 0;
+
+        if (sock && (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+        {
+            space = MC665_SOCKET_RX_BUF_SIZE - sock->count;
+            head = sock->head;
+            xSemaphoreGive(obj->mutex);
+        }
+
+        if (space > 0)
+        {
+            /* 只有URC线程会写入，空闲区间在读取过程中只会增大，因此无需持有锁 */
+            seg_len = MC665_SOCKET_RX_BUF_SIZE - head;
+            (seg_len > space) ? (seg_len = space) : (0);
+            (seg_len > len) ? (seg_len = len) : (0);
+            recv_len = at_client_obj_recv(client, (char *)sock->buf + head, seg_len, 20);
+
+            if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+            {
+                sock->head = (sock->head + recv_len) % MC665_SOCKET_RX_BUF_SIZE;
+                sock->count += recv_len;
+                (recv_len > 0) ? (xEventGroupSetBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_RECV_DATA_BIT))) : (0);
+                xSemaphoreGive(obj->mutex);
+            }
+        }
+        else
+        {
+            seg_len = (len > sizeof(discard)) ? (sizeof(discard)) : (len);
+            recv_len = at_client_obj_recv(client, discard, seg_len, 20);
+            (sock) ? (sock->overflow += recv_len) : (0);
+        }
+
+        if (recv_len != seg_len)
+        {
+            ESP_LOGE(TAG, "socket %d data read failed!", id + 1);
+            break;
+        }
+
+        len -= recv_len;
+    }
+
+    if (sock && sock->overflow)
+    {
+        ESP_LOGW(TAG, "socket %d receive buffer is full, %d bytes dropped", id + 1, sock->overflow);
+    }
+}
+
+/* 丢弃串口中的数据，返回实际读取的长度 */
+static int private_mc665_socket_discard(struct at_client *client, int len)
+{
+    int seg_len = 0;
+    int recv_len = 0;
+    int total = 0;
+    char discard[32] = {0};
+
+    while (total < len)
+    {
+        seg_len = (len - total > sizeof(discard)) ? (sizeof(discard)) : (len - total);
+        recv_len = at_client_obj_recv(client, discard, seg_len, 20);
+        total += (recv_len > 0) ? (recv_len) : (0);
+
+        if (recv_len != seg_len)
+        {
+            break;
+        }
+    }
+
+    return total;
+}
+
+/* UDP数据报加上长度前缀写入环形缓冲，整包写完后才可读，放不下时丢弃整包以保持边界 */
+static void private_mc665_socket_fill_dgram(mc665_socket_drv_t *obj, struct at_client *client, int id, int len)
+{
+    int pos = 0;
+    int done = 0;
+    int seg_len = 0;
+    int recv_len = 0;
+    bool fit = false;
+    mc665_socket_t *sock = &obj->socket[id];
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        fit = (len <= 0xFFFF) && (len + SOCKET_DGRAM_HEAD <= MC665_SOCKET_RX_BUF_SIZE - sock->count);
+        pos = sock->head;
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (!fit)
+    {
+        sock->overflow += private_mc665_socket_discard(client, len);
+        ESP_LOGW(TAG, "socket %d receive buffer is full, %d bytes dropped", id + 1, sock->overflow);
+        return;
+    }
+
+    /* 只有URC线程会写入，提交前读取者看不到这些数据 */
+    sock->buf[pos] = (len >> 8) & 0xFF;
+    pos = (pos + 1) % MC665_SOCKET_RX_BUF_SIZE;
+    sock->buf[pos] = len & 0xFF;
+    pos = (pos + 1) % MC665_SOCKET_RX_BUF_SIZE;
+
+    while (done < len)
+    {
+        seg_len = MC665_SOCKET_RX_BUF_SIZE - pos;
+        (seg_len > len - done) ? (seg_len = len - done) : (0);
+        recv_len = at_client_obj_recv(client, (char *)sock->buf + pos, seg_len, 20);
+
+        if (recv_len != seg_len)
+        {
+            ESP_LOGE(TAG, "socket %d data read failed!", id + 1);
+            return;
+        }
+
+        pos = (pos + recv_len) % MC665_SOCKET_RX_BUF_SIZE;
+        done += recv_len;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        sock->head = pos;
+        sock->count += len + SOCKET_DGRAM_HEAD;
+        xEventGroupSetBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_RECV_DATA_BIT));
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
+static void private_mc665_socket_data_handler(struct at_client *client, const char *data, rt_size_t size, void *param)
+{
+    int id = 0;
+    int len = 0;
+    int parsed = 0;
+    char head[48] = {0};
+    mc665_socket_drv_t *obj = (mc665_socket_drv_t *)param;
+    bool is_udp = !strncmp(data, "+MIPRUDP", sizeof("+MIPRUDP") - 1);
+
+    /* +MIPRTCP: <socket_id>,<length>,<data>\r\n
+       +MIPRUDP: <remote_ip>,<remote_port>,<socket_id>,<length>,<data>\r\n
+       URC在前缀处即被触发，剩余字段和数据在此处直接从串口读取 */
+    if (private_mc665_socket_read_fields(client, head, sizeof(head), (is_udp) ? (4) : (2)) < 0)
+    {
+        ESP_LOGE(TAG, "socket data head read failed: %s", head);
+        return;
+    }
+
+    parsed = (is_udp) ? (sscanf(head, "%*[^,],%*d,%d,%d,", &id, &len)) : (sscanf(head, "%d,%d,", &id, &len));
+    if ((2 != parsed) || (len < 0))
+    {
+        ESP_LOGE(TAG, "socket data head parse failed: %s", head);
+        return;
+    }
+
+    if (is_udp && private_mc665_socket_id_is_valid(id - 1) && (MC665_SOCKET_UDP == obj->socket[id - 1].type))
+    {
+        private_mc665_socket_fill_dgram(obj, client, id - 1, len);
+    }
+    else
+    {
+        private_mc665_socket_fill(obj, client, id - 1, len);
+    }
+
+    /* 丢弃数据后的\r\n */
+    at_client_obj_recv(client, head, 2, 20);
+}
+
+static void private_mc665_socket_status_handler(struct at_client *client, const char *data, rt_size_t size, void *param)
+{
+    int id = 0;
+    int state = 0;
+    mc665_socket_drv_t *obj = (mc665_socket_drv_t *)param;
+
+    client->recv_line_buf[size - 1] = '\0';
+    ESP_LOGD(TAG, "%s", client->recv_line_buf);
+
+    /* +MIPOPEN: <socket_id>,<state>
+       +MIPCLOSE: <socket_id>[,<...>]
+       +MIPSTAT: <socket_id>,<err> */
+    if ((sscanf(client->recv_line_buf, "%*s%d,%d", &id, &state) < 1) || !private_mc665_socket_id_is_valid(id - 1))
+    {
+        return;
+    }
+
+    id = id - 1;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        if (!strncmp(data, "+MIPOPEN", sizeof("+MIPOPEN") - 1) && (1 == state))
+        {
+            obj->socket[id].status = MC665_SOCKET_STATUS_CONNECTED;
+            xEventGroupSetBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_CONNECTED_BIT));
+        }
+        else
+        {
+            /* 仍由使用者持有，不能分配给新的连接 */
+            (MC665_SOCKET_STATUS_CLOSED != obj->socket[id].status) ? (obj->socket[id].status = MC665_SOCKET_STATUS_PEER_CLOSED) : (0);
+            xEventGroupClearBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_CONNECTED_BIT));
+            xEventGroupSetBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_CLOSED_BIT));
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
+bool mc665_socket_init(mc665_socket_drv_t *obj)
+{
+    bool ret = false;
+
+    if (!obj->drv)
+    {
+        ESP_LOGE(TAG, "The MC665 driver is NULL! please pass the mc665_drv_t pointer and retry!");
+        goto __exit;
+    }
+
+    obj->event = xEventGroupCreate();
+    if (!obj->event)
+    {
+        ESP_LOGE(TAG, "Create event_group object failed! memory not enough");
+        goto __exit;
+    }
+
+    obj->mutex = xSemaphoreCreateMutex();
+    if (!obj->mutex)
+    {
+        ESP_LOGE(TAG, "Create mutex object failed! memory not enough");
+        goto __exit;
+    }
+
+    for (int i = 0; i < MC665_SOCKET_NUM; i++)
+    {
+        obj->socket[i].status = MC665_SOCKET_STATUS_CLOSED;
+        obj->socket[i].buf = malloc(MC665_SOCKET_RX_BUF_SIZE);
+        private_mc665_socket_reset(&obj->socket[i]);
+
+        if (!obj->socket[i].buf)
+        {
+            ESP_LOGE(TAG, "No memory for socket receive buffer");
+            goto __exit;
+        }
+    }
+
+    /* 初始化URC，数据URC后缀为空，匹配到前缀后立即读取数据 */
+    obj->urc_table[0].cmd_prefix = "+MIPRTCP:";
+    obj->urc_table[0].cmd_suffix = "";
+    obj->urc_table[0].func = private_mc665_socket_data_handler;
+    obj->urc_table[0].param = obj;
+    obj->urc_table[1].cmd_prefix = "+MIPRUDP:";
+    obj->urc_table[1].cmd_suffix = "";
+    obj->urc_table[1].func = private_mc665_socket_data_handler;
+    obj->urc_table[1].param = obj;
+    obj->urc_table[2].cmd_prefix = "+MIPOPEN:";
+    obj->urc_table[2].cmd_suffix = "\r\n";
+    obj->urc_table[2].func = private_mc665_socket_status_handler;
+    obj->urc_table[2].param = obj;
+    obj->urc_table[3].cmd_prefix = "+MIPCLOSE:";
+    obj->urc_table[3].cmd_suffix = "\r\n";
+    obj->urc_table[3].func = private_mc665_socket_status_handler;
+    obj->urc_table[3].param = obj;
+    obj->urc_table[4].cmd_prefix = "+MIPSTAT:";
+    obj->urc_table[4].cmd_suffix = "\r\n";
+    obj->urc_table[4].func = private_mc665_socket_status_handler;
+    obj->urc_table[4].param = obj;
+    if (at_obj_set_urc_table(obj->drv->client, obj->urc_table, 5))
+    {
+        ESP_LOGE(TAG, "at client urc_table initial fail");
+        goto __exit;
+    }
+
+    ret = true;
+    ESP_LOGI(TAG, "MC665 socket resource alloc success");
+
+__exit:
+
+    if (!ret)
+    {
+        for (int i = 0; i < MC665_SOCKET_NUM; i++)
+        {
+            free(obj->socket[i].buf);
+            obj->socket[i].buf = NULL;
+        }
+
+        if (obj->event)
+        {
+            vEventGroupDelete(obj->event);
+            obj->event = NULL;
+        }
+
+        if (obj->mutex)
+        {
+            vSemaphoreDelete(obj->mutex);
+            obj->mutex = NULL;
+        }
+
+        ESP_LOGE(TAG, "MC665 socket resource alloc fail");
+    }
+
+    return ret;
+}
+
+// 打开socket，成功时返回socket编号，失败返回-1
+int mc665_socket_open(mc665_socket_drv_t *obj, mc665_socket_type_def type, const char *host, uint16_t port, uint32_t timeout)
+{
+    int id = -1;
+    bool ret = false;
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        for (int i = 0; i < MC665_SOCKET_NUM; i++)
+        {
+            if (MC665_SOCKET_STATUS_CLOSED == obj->socket[i].status)
+            {
+                id = i;
+                obj->socket[i].type = type;
+                obj->socket[i].status = MC665_SOCKET_STATUS_CONNECTING;
+                private_mc665_socket_reset(&obj->socket[i]);
+                xEventGroupClearBits(obj->event, SOCKET_EVENT_BITS(i, SOCKET_ALL_BITS));
+                break;
+            }
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (id < 0)
+    {
+        ESP_LOGE(TAG, "No free socket");
+        return -1;
+    }
+
+    /* AT+MIPOPEN=<socket_id>,<source_port>,"<remote_ip>",<remote_port>,<protocol> */
+    if (mc665_take_lock(obj->drv))
+    {
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MIPOPEN=%d,0,\"%s\",%d,%d", id + 1, host, port, type));
+        mc665_release_lock(obj->drv);
+    }
+
+    ret = ret && (SOCKET_EVENT_BITS(id, SOCKET_CONNECTED_BIT) & xEventGroupWaitBits(obj->event,
+                                                                                   SOCKET_EVENT_BITS(id, SOCKET_CONNECTED_BIT | SOCKET_CLOSED_BIT),
+                                                                                   pdFALSE, pdFALSE, timeout));
+
+    if (!ret)
+    {
+        ESP_LOGE(TAG, "socket %d connect to %s:%d failed!", id + 1, host, port);
+
+        if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+        {
+            obj->socket[id].status = MC665_SOCKET_STATUS_CLOSED;
+            xSemaphoreGive(obj->mutex);
+        }
+
+        return -1;
+    }
+
+    return id;
+}
+
+// 发送数据，数据在提示符后直接从调用者的缓冲发出，返回已发送的长度
+int mc665_socket_send(mc665_socket_drv_t *obj, int id, const void *data, int len)
+{
+    int sent = 0;
+    int chunk = 0;
+    bool ret = true;
+
+    if (!mc665_socket_is_connected(obj, id))
+    {
+        return -1;
+    }
+
+    if (mc665_take_lock(obj->drv))
+    {
+        while (ret && (sent < len))
+        {
+            chunk = len - sent;
+            (chunk > MC665_SOCKET_SEND_MAX_LEN) ? (chunk = MC665_SOCKET_SEND_MAX_LEN) : (0);
+
+            at_obj_set_end_sign(obj->drv->client, '>');
+            ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MIPSEND=%d,%d", id + 1, chunk));
+            at_obj_set_end_sign(obj->drv->client, 0);
+
+            if (ret)
+            {
+                at_client_obj_send(obj->drv->client, (const char *)data + sent, chunk);
+                ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, ""));
+            }
+
+            (ret) ? (sent += chunk) : (0);
+        }
+
+        mc665_release_lock(obj->drv);
+    }
+
+    return (sent || ret) ? (sent) : (-1);
+}
+
+// 获取环形缓冲中连续可读数据的地址和长度，读取后需调用mc665_socket_recv_release释放，只用于TCP
+int mc665_socket_recv_ptr(mc665_socket_drv_t *obj, int id, const uint8_t **data)
+{
+    int len = 0;
+
+    if (private_mc665_socket_id_is_valid(id) && (MC665_SOCKET_TCP == obj->socket[id].type) && data &&
+        (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+    {
+        len = MC665_SOCKET_RX_BUF_SIZE - obj->socket[id].tail;
+        (len > obj->socket[id].count) ? (len = obj->socket[id].count) : (0);
+        *data = obj->socket[id].buf + obj->socket[id].tail;
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return len;
+}
+
+void mc665_socket_recv_release(mc665_socket_drv_t *obj, int id, int len)
+{
+    if (private_mc665_socket_id_is_valid(id) && (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+    {
+        (len > obj->socket[id].count) ? (len = obj->socket[id].count) : (0);
+        obj->socket[id].tail = (obj->socket[id].tail + len) % MC665_SOCKET_RX_BUF_SIZE;
+        obj->socket[id].count -= len;
+
+        if (0 == obj->socket[id].count)
+        {
+            xEventGroupClearBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_RECV_DATA_BIT));
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+}
+
+// 取出一个UDP数据报，超出len的部分被丢弃，没有数据报时返回-1
+static int private_mc665_socket_recv_dgram(mc665_socket_drv_t *obj, int id, void *buf, int len)
+{
+    int ret = -1;
+    int size = 0;
+    int seg_len = 0;
+    mc665_socket_t *sock = &obj->socket[id];
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        if (sock->count >= SOCKET_DGRAM_HEAD)
+        {
+            size = (sock->buf[sock->tail] << 8) | sock->buf[(sock->tail + 1) % MC665_SOCKET_RX_BUF_SIZE];
+            sock->tail = (sock->tail + SOCKET_DGRAM_HEAD) % MC665_SOCKET_RX_BUF_SIZE;
+            ret = (size > len) ? (len) : (size);
+
+            /* 数据报可能跨越缓冲区末尾 */
+            seg_len = MC665_SOCKET_RX_BUF_SIZE - sock->tail;
+            (seg_len > ret) ? (seg_len = ret) : (0);
+            memcpy(buf, sock->buf + sock->tail, seg_len);
+            memcpy((uint8_t *)buf + seg_len, sock->buf, ret - seg_len);
+
+            sock->tail = (sock->tail + size) % MC665_SOCKET_RX_BUF_SIZE;
+            sock->count -= size + SOCKET_DGRAM_HEAD;
+
+            if (0 == sock->count)
+            {
+                xEventGroupClearBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_RECV_DATA_BIT));
+            }
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+// 接收数据，UDP每次返回一个数据报，返回值 >=0:接收的长度（TCP为0时连接已关闭） -1:超时或参数错误
+int mc665_socket_recv(mc665_socket_drv_t *obj, int id, void *buf, int len, uint32_t timeout)
+{
+    int seg_len = 0;
+    int recv_len = 0;
+    const uint8_t *data = NULL;
+
+    if (!private_mc665_socket_id_is_valid(id))
+    {
+        return -1;
+    }
+
+    xEventGroupWaitBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_RECV_DATA_BIT | SOCKET_CLOSED_BIT), pdFALSE, pdFALSE, timeout);
+
+    if (MC665_SOCKET_UDP == obj->socket[id].type)
+    {
+        return private_mc665_socket_recv_dgram(obj, id, buf, len);
+    }
+
+    while ((recv_len < len) && ((seg_len = mc665_socket_recv_ptr(obj, id, &data)) > 0))
+    {
+        (seg_len > len - recv_len) ? (seg_len = len - recv_len) : (0);
+        memcpy((uint8_t *)buf + recv_len, data, seg_len);
+        mc665_socket_recv_release(obj, id, seg_len);
+        recv_len += seg_len;
+    }
+
+    if (recv_len)
+    {
+        return recv_len;
+    }
+
+    return ((MC665_SOCKET_STATUS_CLOSED == obj->socket[id].status) || (MC665_SOCKET_STATUS_PEER_CLOSED == obj->socket[id].status)) ? (0) : (-1);
+}
+
+int mc665_socket_available(mc665_socket_drv_t *obj, int id)
+{
+    int ret = -1;
+
+    if (private_mc665_socket_id_is_valid(id) && (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY)))
+    {
+        ret = obj->socket[id].count;
+
+        /* UDP返回下一个数据报的长度 */
+        if ((MC665_SOCKET_UDP == obj->socket[id].type) && (ret >= SOCKET_DGRAM_HEAD))
+        {
+            ret = (obj->socket[id].buf[obj->socket[id].tail] << 8) | obj->socket[id].buf[(obj->socket[id].tail + 1) % MC665_SOCKET_RX_BUF_SIZE];
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
+
+// 等待mask中任意socket可读（有数据或对端已关闭），返回可读socket的位掩码
+uint32_t mc665_socket_poll(mc665_socket_drv_t *obj, uint32_t mask, uint32_t timeout)
+{
+    uint32_t ready = 0;
+    EventBits_t bits = 0;
+
+    for (int i = 0; i < MC665_SOCKET_NUM; i++)
+    {
+        (mask & (1u << i)) ? (bits |= SOCKET_EVENT_BITS(i, SOCKET_RECV_DATA_BIT | SOCKET_CLOSED_BIT)) : (0);
+    }
+
+    if (bits && timeout)
+    {
+        xEventGroupWaitBits(obj->event, bits, pdFALSE, pdFALSE, timeout);
+    }
+
+    bits &= xEventGroupGetBits(obj->event);
+
+    for (int i = 0; i < MC665_SOCKET_NUM; i++)
+    {
+        (bits & SOCKET_EVENT_BITS(i, SOCKET_RECV_DATA_BIT | SOCKET_CLOSED_BIT)) ? (ready |= (1u << i)) : (0);
+    }
+
+    return ready;
+}
+
+bool mc665_socket_is_connected(mc665_socket_drv_t *obj, int id)
+{
+    return private_mc665_socket_id_is_valid(id) && (MC665_SOCKET_STATUS_CONNECTED == obj->socket[id].status);
+}
+
+// 释放socket，之后才能被mc665_socket_open再次分配
+bool mc665_socket_close(mc665_socket_drv_t *obj, int id)
+{
+    bool ret = false;
+
+    if (!private_mc665_socket_id_is_valid(id))
+    {
+        return false;
+    }
+
+    if (mc665_take_lock(obj->drv))
+    {
+        ret = (0 == at_obj_exec_cmd(obj->drv->client, obj->drv->resp, "AT+MIPCLOSE=%d", id + 1));
+        mc665_release_lock(obj->drv);
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        obj->socket[id].status = MC665_SOCKET_STATUS_CLOSED;
+        private_mc665_socket_reset(&obj->socket[id]);
+        xEventGroupClearBits(obj->event, SOCKET_EVENT_BITS(id, SOCKET_ALL_BITS));
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return ret;
+}
\ No newline at end of file
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mc665.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+/* 同时打开的socket数量（模组socket id从1开始） */
+#define MC665_SOCKET_NUM 4
+/* 每个socket的接收环形缓冲大小 */
+#define MC665_SOCKET_RX_BUF_SIZE 2048
+/* 单条AT+MIPSEND指令最多发送的数据长度 */
+#define MC665_SOCKET_SEND_MAX_LEN 1024
+
+typedef enum
+{
+    MC665_SOCKET_TCP,
+    MC665_SOCKET_UDP
+} mc665_socket_type_def;
+
+/* 只有CLOSED的socket可以被分配，对端关闭后保持PEER_CLOSED直到mc665_socket_close释放 */
+typedef enum
+{
+    MC665_SOCKET_STATUS_CLOSED,
+    MC665_SOCKET_STATUS_CONNECTING,
+    MC665_SOCKET_STATUS_CONNECTED,
+    MC665_SOCKET_STATUS_PEER_CLOSED
+} mc665_socket_status_def;
+
+typedef struct
+{
+    mc665_socket_type_def type;
+    mc665_socket_status_def status;
+    /* 接收环形缓冲，由URC直接从串口写入 */
+    uint8_t *buf;
+    int head;
+    int tail;
+    int count;
+    /* 缓冲区满时丢弃的字节数 */
+    int overflow;
+} mc665_socket_t;
+
+struct mc665_bsd_ctx;
+
+typedef struct
+{
+    mc665_drv_t *drv;
+    SemaphoreHandle_t mutex;
+    EventGroupHandle_t event;
+    mc665_socket_t socket[MC665_SOCKET_NUM];
+    struct at_urc urc_table[5];
+    /* BSD接口的描述符表，由mc665_bsd_init创建 */
+    struct mc665_bsd_ctx *bsd;
+} mc665_socket_drv_t;
+
+bool mc665_socket_init(mc665_socket_drv_t *obj);
+int mc665_socket_open(mc665_socket_drv_t *obj, mc665_socket_type_def type, const char *host, uint16_t port, uint32_t timeout);
+int mc665_socket_send(mc665_socket_drv_t *obj, int id, const void *data, int len);
+int mc665_socket_recv(mc665_socket_drv_t *obj, int id, void *buf, int len, uint32_t timeout);
+int mc665_socket_recv_ptr(mc665_socket_drv_t *obj, int id, const uint8_t **data);
+void mc665_socket_recv_release(mc665_socket_drv_t *obj, int id, int len);
+int mc665_socket_available(mc665_socket_drv_t *obj, int id);
+uint32_t mc665_socket_poll(mc665_socket_drv_t *obj, uint32_t mask, uint32_t timeout);
+bool mc665_socket_is_connected(mc665_socket_drv_t *obj, int id);
+bool mc665_socket_close(mc665_socket_drv_t *obj, int id);
\ No newline at end of file
@@ -16,9 +16,12 @@
 #include "at_uart_drv.h"
 
 #include "mc665.h"
+#include "mc665_dns.h"
 #include "mc665_mqtt.h"
 #include "mc665_http.h"
 #include "mc665_ota.h"
+#include "mqtt_outbox.h"
+#include "mqtt_router.h"
 
 #define MC665_PWR_PIN (GPIO_NUM_21)
 #define MC665_RST_PIN (GPIO_NUM_19)
@@ -28,6 +31,11 @@ static com_drv_t   at_uart_drv = {0};
 static mc665_drv_t mc665_drv = {0};
 static mqtt_drv_t   mqtt_drv = {0};
 static ota_drv_t   ota_drv = {0};
+static mc665_dns_drv_t mc665_dns_drv = {.drv = &mc665_drv, .persist = true};
+static mc665_mqtt_drv_t mc665_mqtt_drv = {.drv = &mc665_drv, .dns = &mc665_dns_drv};
+static mc665_ota_drv_t mc665_ota_drv = {.drv = &mc665_drv};
+static mqtt_outbox_t mqtt_outbox = {0};
+static mqtt_router_t mqtt_router = {0};
 
 
 void mc665_event_callback(void *param, mc665_event_def event)
@@ -63,18 +71,26 @@ static void mqtt_event_callback(void *args, mqtt_event_def event, mqtt_msg_t *pm
     switch(event)
     {
     case MQTT_EVT_CONNECTED:
+        mqtt_outbox_set_connected(&mqtt_outbox, true);
         break;
     case MQTT_EVT_DISCONNECTED:
+        mqtt_outbox_set_connected(&mqtt_outbox, false);
         ESP_LOGW(TAG, "mqtt disconnected");
         break;
+    case MQTT_EVT_PUBLISHED:
+        mqtt_outbox_published(&mqtt_outbox, pmsg->msg_id, true);
+        break;
     case MQTT_EVT_SUBSCRIBED:
     case MQTT_EVT_UNSUBSCRIBED:
-    case MQTT_EVT_PUBLISHED:
     case MQTT_EVT_BEFORE_CONNECT:
         break;
     case MQTT_EVT_DATA:
         ESP_LOGE(TAG, "mqtt data");
         break;
+    case MQTT_EVT_DELETED:
+        mqtt_outbox_published(&mqtt_outbox, pmsg->msg_id, false);
+        ESP_LOGW(TAG, "mqtt message %d dropped", pmsg->msg_id);
+        break;
     case MQTT_EVT_ERROR:
         ESP_LOGW(TAG, "mqtt error");
         break;
@@ -103,8 +119,9 @@ void at_modbule_init(void)
 		.param = &mqtt_drv
         };
 
-	at_uart_drv_get(&at_uart_drv);
+	at_uart_drv_get(&at_uart_drv, NULL);
 	at_client_init(&at_uart_drv, 128);
+	mc665_drv.client = at_client_get(com_device_name(&at_uart_drv));
 
 	/* 复位模组 */
     gpio_reset_pin(MC665_PWR_PIN);
@@ -120,16 +137,18 @@ void at_modbule_init(void)
 
 	mc665_register_callback(&mc665_drv, &mc665_cb);
     mc665_init(&mc665_drv);
+	mc665_dns_init(&mc665_dns_drv);
 	
-	ota_drv.user_data = &mc665_drv;
+	ota_drv.user_data = &mc665_ota_drv;
 	mc665_ota_drv_get(&ota_drv);
 	ota_register_callback(&ota_drv, &ota_cb);
 	ota_init(&ota_drv);
 
-	mqtt_drv.user_data = &mc665_drv;
+	mqtt_drv.user_data = &mc665_mqtt_drv;
 	mc665_mqtt_drv_get(&mqtt_drv);
-	mqtt_register_callback(&mqtt_drv, &mqtt_cb);
+	mqtt_router_init(&mqtt_router, &mqtt_drv, &mqtt_cb);
 	mqtt_init(&mqtt_drv, &mqtt_cfg);
+	mqtt_outbox_init(&mqtt_outbox, &mqtt_drv);
 }
 
 void app_main()
@@ -1,52 +1,60 @@
 #include "mc665.h"
 #include "mc665_ota.h"
 #include "mc665_http.h"
+#include "mc665_ota_pipe.h"
+#include "mc665_ota_delta.h"
+#include "mc665_ota_inflate.h"
+#include "mc665_ota_verify.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 #include "esp_ota_ops.h"
+#include "esp_image_format.h"
 #include "esp_http_client.h"
 #include "esp_https_ota.h"
+#include "esp_timer.h"
+#include "nvs.h"
 
 #include <string.h>
 #include <stdlib.h>
 
-/* 单次接收OTA数据包的长度（小于AT客户端行缓存） */
-#define MC665_OTA_PACKT_SIZE 512
+/* 单条AT+HTTPREAD请求的长度，数据由http驱动分段流式写入flash */
+#define MC665_OTA_READ_WINDOW (16 * 1024)
+/* 下载进度写入NVS的间隔 */
+#define MC665_OTA_CHECKPOINT_SIZE (64 * 1024)
+/* 下载中断后的重试次数 */
+#define MC665_OTA_RETRY_NUM 5
 
-typedef struct
-{
-    /* 忽略软件版本检查 */
-    bool ignore_version_check;
-    mc665_drv_t *drv;
-    mc665_http_drv_t http;
-    ota_event_cb_t event_cb;
-    ota_status_def status;
-} private_mc665_ota_drv_t;
+/* flash擦除扇区大小 */
+#define MC665_OTA_SECTOR_SIZE 4096
+
+#define MC665_OTA_NVS_NAMESPACE "mc665_ota"
+#define MC665_OTA_NVS_KEY "progress"
 
 static const char *TAG = "mc665_ota_drv";
-static private_mc665_ota_drv_t s_ota_drv = {
-    .status = OTA_STATUS_UNINITIALIZED};
 
-static void private_mc665_ota_register_callback(ota_event_cb_t *cb)
+static void private_mc665_ota_register_callback(void *user_data, ota_event_cb_t *cb)
 {
-    s_ota_drv.event_cb = *cb;
+    mc665_ota_drv_t *obj = (mc665_ota_drv_t *)user_data;
+
+    obj->event_cb = *cb;
 }
 
-static bool private_mc665_ota_init(void)
+static bool private_mc665_ota_init(void *user_data)
 {
     bool ret = false;
+    mc665_ota_drv_t *obj = (mc665_ota_drv_t *)user_data;
 
-    if (!s_ota_drv.drv)
+    if (!obj->drv)
     {
         ESP_LOGE(TAG, "The MC665 driver is NULL! please pass the mc665_drv_t pointer and retry!");
         goto __exit;
     }
 
-    s_ota_drv.http.drv = s_ota_drv.drv;
-    if (!mc665_http_init(&s_ota_drv.http))
+    obj->http.drv = obj->drv;
+    if (!mc665_http_init(&obj->http))
     {
         ESP_LOGE(TAG, "The MC665 http resource init fail");
         goto __exit;
@@ -54,193 +62,532 @@ static bool private_mc665_ota_init(void)
 
     ret = true;
     ESP_LOGI(TAG, "MC665 ota init success!");
-    s_ota_drv.status = OTA_STATUS_IDLE;
+    obj->status = OTA_STATUS_IDLE;
 
 __exit:
 
     return ret;
 }
 
-static bool private_mc665_ota_validate_image_header(int file_offset)
+typedef enum
+{
+    MC665_OTA_RESULT_OK,
+    /* 可重试的错误，下次从检查点继续 */
+    MC665_OTA_RESULT_RETRY,
+    MC665_OTA_RESULT_FAIL
+} mc665_ota_result_def;
+
+/* 下载文件的类型，由文件开头的数据区分 */
+typedef enum
+{
+    MC665_OTA_IMAGE_FULL,
+    MC665_OTA_IMAGE_PATCH,
+    MC665_OTA_IMAGE_ZLIB
+} mc665_ota_image_def;
+
+/* 保存在NVS中的下载进度 */
+typedef struct
+{
+    uint32_t url_hash;
+    /* 目标分区地址 */
+    uint32_t address;
+    uint32_t size;
+    /* 已写入flash的长度 */
+    uint32_t offset;
+    char etag[MC665_HTTP_HEADER_VALUE_LEN];
+} mc665_ota_progress_t;
+
+typedef struct
+{
+    const esp_partition_t *partition;
+    uint32_t offset;
+    /* 已擦除区域的结束地址 */
+    uint32_t erased;
+} mc665_ota_writer_t;
+
+/* 写入flash前依次经过的处理，未使用的为NULL */
+typedef struct
+{
+    mc665_ota_verify_t *verify;
+    mc665_ota_delta_t *delta;
+    mc665_ota_inflate_t *inflate;
+    /* 第一级处理，收到文件开头的数据后确定 */
+    mc665_ota_sink_t sink;
+    mc665_ota_image_def image;
+    bool probed;
+    /* 完整固件超出分区大小，不再重试 */
+    bool rejected;
+    uint32_t image_size;
+    const esp_partition_t *partition;
+    uint8_t head[sizeof(MC665_OTA_DELTA_MAGIC) - 1];
+    int head_len;
+} mc665_ota_chain_t;
+
+static bool private_mc665_ota_load_progress(mc665_ota_progress_t *progress)
 {
     bool ret = false;
-    char *data = NULL;
-    esp_app_desc_t new_app_info = {0};
-    esp_app_desc_t running_app_info = {0};
-    const int header_size = sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t);
-    
-    data = (char *)malloc(header_size);
-    if (!data)
-    {
-        ESP_LOGE(TAG, "No memory to recv http data");
-        goto __exit;
+    nvs_handle_t handle = 0;
+    size_t size = sizeof(mc665_ota_progress_t);
+
+    if (ESP_OK == nvs_open(MC665_OTA_NVS_NAMESPACE, NVS_READONLY, &handle))
+    {
+        ret = (ESP_OK == nvs_get_blob(handle, MC665_OTA_NVS_KEY, progress, &size)) && (sizeof(mc665_ota_progress_t) == size);
+        progress->etag[sizeof(progress->etag) - 1] = '\0';
+        nvs_close(handle);
     }
 
-    if (mc665_http_read_data(&s_ota_drv.http, file_offset, header_size, data, 5000) == header_size)
+    return ret;
+}
+
+static void private_mc665_ota_save_progress(const mc665_ota_progress_t *progress)
+{
+    nvs_handle_t handle = 0;
+
+    if (ESP_OK == nvs_open(MC665_OTA_NVS_NAMESPACE, NVS_READWRITE, &handle))
     {
-        memcpy(&new_app_info, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-        ESP_LOGI(TAG, "New firmware version: %s", new_app_info.version);
+        if (progress)
+        {
+            nvs_set_blob(handle, MC665_OTA_NVS_KEY, progress, sizeof(mc665_ota_progress_t));
+        }
+        else
+        {
+            nvs_erase_key(handle, MC665_OTA_NVS_KEY);
+        }
+
+        nvs_commit(handle);
+        nvs_close(handle);
     }
-    else
+}
+
+static uint32_t private_mc665_ota_hash(const char *str)
+{
+    uint32_t hash = 5381;
+
+    while (*str)
     {
-        ESP_LOGW(TAG, "New app header read fail");
-        goto __exit;
+        hash = hash * 33 + (uint8_t)(*str++);
     }
 
-    if (esp_ota_get_partition_description(esp_ota_get_running_partition(), &running_app_info) == ESP_OK)
+    return hash;
+}
+
+// OTA分区的sink，直接写分区而不经过esp_ota句柄，写入前按扇区擦除，允许从任意位置继续写入
+static bool private_mc665_ota_write(void *param, const void *data, int len)
+{
+    uint32_t end = 0;
+    mc665_ota_writer_t *writer = (mc665_ota_writer_t *)param;
+
+    end = writer->offset + len;
+    if (end > writer->erased)
     {
-        ESP_LOGI(TAG, "Current running firmware version: %s", running_app_info.version);
+        end = (end + MC665_OTA_SECTOR_SIZE - 1) & ~(MC665_OTA_SECTOR_SIZE - 1);
+
+        if (ESP_OK != esp_partition_erase_range(writer->partition, writer->erased, end - writer->erased))
+        {
+            ESP_LOGE(TAG, "esp ota partition erase fail");
+            return false;
+        }
+
+        writer->erased = end;
     }
 
-    if (memcmp(new_app_info.version, running_app_info.version, sizeof(new_app_info.version)) == 0)
+    if (ESP_OK != esp_partition_write(writer->partition, writer->offset, data, len))
     {
-        ESP_LOGW(TAG, "Current running version is the same as a new. We will not continue the update.");
-        goto __exit;
+        ESP_LOGE(TAG, "esp ota partition write fail at %u", (unsigned int)writer->offset);
+        return false;
     }
-    
-    ret = true;
 
-__exit:
+    writer->offset += len;
+
+    return true;
+}
 
-    if (data)
+static void private_mc665_ota_chain_free(mc665_ota_chain_t *chain)
+{
+    if (chain->verify)
     {
-        free(data);
+        mc665_ota_verify_deinit(chain->verify);
+        free(chain->verify);
+        chain->verify = NULL;
     }
 
-    return ret;
+    if (chain->inflate)
+    {
+        mc665_ota_inflate_deinit(chain->inflate);
+        free(chain->inflate);
+        chain->inflate = NULL;
+    }
+
+    free(chain->delta);
+    chain->delta = NULL;
 }
 
-static void private_mc665_ota_task(void *pvParameter)
+// 根据文件开头的数据确定类型，并在verify之前插入还原或解压处理
+// 差分包以MC665_OTA_DELTA_MAGIC开头，压缩固件以zlib头开头，完整固件以0xE9开头
+static bool private_mc665_ota_chain_probe(mc665_ota_chain_t *chain)
 {
-    esp_err_t err;
-    bool ret = false;
-    char *data = NULL;
-    int total_len = 0;
-    int content_len = 0;
-    int read_offset = 0;
-    int received_file_length = 0;
-    mc665_http_resp_t resp = {0};
-    esp_ota_handle_t update_handle = {0};
-    const esp_partition_t *update_partition = NULL;
+    chain->probed = true;
+    chain->image = MC665_OTA_IMAGE_FULL;
+
+    if (mc665_ota_delta_is_patch(chain->head, chain->head_len))
+    {
+        chain->image = MC665_OTA_IMAGE_PATCH;
+    }
+    else if (mc665_ota_inflate_is_zlib(chain->head, chain->head_len))
+    {
+        chain->image = MC665_OTA_IMAGE_ZLIB;
+    }
+
+    if (MC665_OTA_IMAGE_FULL == chain->image)
+    {
+        if (chain->image_size > chain->partition->size)
+        {
+            chain->rejected = true;
+            ESP_LOGE(TAG, "ota image is too large (%u)", (unsigned int)chain->image_size);
+            return false;
+        }
+
+        return true;
+    }
+
+    /* 下载位置和固件写入位置不一致，不支持断点续传 */
+    ESP_LOGI(TAG, "ota %s detected, size:%u", (MC665_OTA_IMAGE_PATCH == chain->image) ? ("patch") : ("compressed image"), (unsigned int)chain->image_size);
+
+    /* 差分包先经过还原再写入flash，旧固件为当前运行的分区 */
+    if (MC665_OTA_IMAGE_PATCH == chain->image)
+    {
+        chain->delta = malloc(sizeof(mc665_ota_delta_t));
+        if (!chain->delta)
+        {
+            ESP_LOGE(TAG, "No memory to apply ota patch");
+            return false;
+        }
+
+        mc665_ota_delta_init(chain->delta, esp_ota_get_running_partition(), &chain->sink);
+        chain->sink.param = chain->delta;
+        chain->sink.write = mc665_ota_delta_write;
+    }
+
+    /* 压缩固件先解压再写入flash，解压器状态较大，在堆上分配 */
+    if (MC665_OTA_IMAGE_ZLIB == chain->image)
+    {
+        chain->inflate = malloc(sizeof(mc665_ota_inflate_t));
+        if (!chain->inflate || !mc665_ota_inflate_init(chain->inflate, &chain->sink))
+        {
+            ESP_LOGE(TAG, "No memory to inflate ota image");
+            return false;
+        }
+
+        chain->sink.param = chain->inflate;
+        chain->sink.write = mc665_ota_inflate_write;
+    }
+
+    return true;
+}
+
+// 作为写入任务的sink，在流水线送来的第一段数据中识别文件类型，不再单独读取文件头
+static bool private_mc665_ota_chain_write(void *param, const void *data, int len)
+{
+    int copy_len = 0;
+    mc665_ota_chain_t *chain = (mc665_ota_chain_t *)param;
+
+    if (!chain->probed)
+    {
+        copy_len = sizeof(chain->head) - chain->head_len;
+        (copy_len > len) ? (copy_len = len) : (0);
+        memcpy(chain->head + chain->head_len, data, copy_len);
+        chain->head_len += copy_len;
+        data = (const uint8_t *)data + copy_len;
+        len -= copy_len;
+
+        if (chain->head_len < sizeof(chain->head))
+        {
+            return true;
+        }
+
+        if (!private_mc665_ota_chain_probe(chain) || !chain->sink.write(chain->sink.param, chain->head, chain->head_len))
+        {
+            return false;
+        }
+    }
+
+    return (len <= 0) || chain->sink.write(chain->sink.param, data, len);
+}
+
+// 发起请求，range_start不为0时请求从该位置开始的数据
+static bool private_mc665_ota_request(mc665_ota_drv_t *obj, uint32_t range_start, mc665_http_resp_t *resp)
+{
+    char range[24] = {0};
+
+    /* 从0开始的Range同时会清除上一次请求设置的范围 */
+    snprintf(range, sizeof(range), "%u-", (unsigned int)range_start);
+    if (!mc665_http_set_param(&obj->http, MC665_HTTP_PARAM_CONTENT_RANGE, range))
+    {
+        ESP_LOGW(TAG, "http range set failed");
+    }
 
     /* 等待http连接 */
-    mc665_http_start(&s_ota_drv.http, MC665_HTTP_MODE_GET, 60);
-    if (MC665_HTTP_CONNECT_SUCCESS == mc665_http_read_status(&s_ota_drv.http, 60000))
+    mc665_http_start(&obj->http, MC665_HTTP_MODE_GET, 60);
+    if (MC665_HTTP_CONNECT_SUCCESS == mc665_http_read_status(&obj->http, 60000))
     {
-        ESP_LOGI(TAG, "http connect success!");
+        ESP_LOGI(TAG, "http connect success! (%u ms)", (unsigned int)obj->http.stats.connect_ms);
     }
     else
     {
         ESP_LOGE(TAG, "http connect failed!");
-        goto __exit;
+        return false;
     }
 
     /* 读取http应答 */
-    if (mc665_http_read_resp(&s_ota_drv.http, &resp, 60000))
+    if (mc665_http_read_resp(&obj->http, resp, 60000))
     {
-        read_offset = 0;
-        total_len = resp.length;
-        ESP_LOGI(TAG, "http file size:%d", total_len);
+        ESP_LOGI(TAG, "http file size:%d", resp->length);
     }
     else
     {
         ESP_LOGE(TAG, "http receive response timeout!");
-        goto __exit;
+        return false;
     }
 
-    /* 读取文件大小并计算出文件起始位置 */
-    content_len = mc665_read_content_length(&s_ota_drv.http, 100);
-    if (content_len > 0)
+    /* 一次读取响应头，得到文件大小和文件起始位置 */
+    if (!mc665_http_read_header(&obj->http, 10000) || (obj->http.header.content_length <= 0))
     {
-        read_offset = total_len - content_len;
+        ESP_LOGE(TAG, "http content length read fail");
+        return false;
     }
-    else
+
+    return true;
+}
+
+static mc665_ota_result_def private_mc665_ota_download(mc665_ota_drv_t *obj, const esp_partition_t *update_partition)
+{
+    esp_err_t err;
+    bool resume = false;
+    int read_offset = 0;
+    unsigned int range_start = 0;
+    unsigned int image_size = 0;
+    int64_t start_time = 0;
+    int64_t elapsed_ms = 0;
+    const char *etag = NULL;
+    const char *range = NULL;
+    mc665_http_resp_t resp = {0};
+    mc665_ota_progress_t progress = {0};
+    bool ret = false;
+    unsigned int received = 0;
+    mc665_ota_pipe_t pipe;
+    mc665_ota_writer_t writer = {.partition = update_partition};
+    esp_partition_pos_t part_pos = {.offset = update_partition->address, .size = update_partition->size};
+    esp_image_metadata_t metadata = {0};
+    mc665_ota_sink_t sink = {.param = &writer, .write = private_mc665_ota_write};
+    mc665_ota_sink_t chain_sink = {0};
+    mc665_ota_chain_t chain = {0};
+    mc665_ota_result_def result = MC665_OTA_RESULT_FAIL;
+
+    /* 存在同一文件的下载进度时从检查点继续 */
+    resume = private_mc665_ota_load_progress(&progress) &&
+             (progress.url_hash == obj->url_hash) &&
+             (progress.address == update_partition->address) &&
+             (progress.offset > 0) && (progress.offset < progress.size);
+
+    if (!private_mc665_ota_request(obj, (resume) ? (progress.offset) : (0), &resp))
     {
-        ESP_LOGE(TAG, "http content length read fail");
-        goto __exit;
+        return MC665_OTA_RESULT_RETRY;
     }
 
-    /* 读取下一个需要升级的分区，并验证app版本 */
-    update_partition = esp_ota_get_next_update_partition(NULL);
-    if (NULL == update_partition)
+    etag = mc665_http_get_header(&obj->http, MC665_HTTP_HEADER_ETAG);
+    range = mc665_http_get_header(&obj->http, MC665_HTTP_HEADER_CONTENT_RANGE);
+    read_offset = obj->http.header.body_offset;
+    image_size = obj->http.header.content_length;
+
+    /* Content-Range: bytes <start>-<end>/<size> */
+    if ((206 == obj->http.header.status) && (!range || (2 != sscanf(range, "bytes %u-%*u/%u", &range_start, &image_size))))
     {
-        ESP_LOGE(TAG, "esp ota partition read fail");
-        goto __exit;
+        ESP_LOGE(TAG, "http content range parse fail");
+        return MC665_OTA_RESULT_RETRY;
     }
 
-    /* 验证版本是否和当前不一致 */
-    if (!private_mc665_ota_validate_image_header(read_offset))
+    if (read_offset + image_size - range_start != resp.length)
     {
-        if (false == s_ota_drv.ignore_version_check)
-        {
-            goto __exit;
-        }
-        ESP_LOGW(TAG, "ignore app version check");
+        ESP_LOGW(TAG, "http body offset %d and image size %u mismatch total length %d", read_offset, image_size, resp.length);
     }
 
-    /* 开启ota */
-    err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle);
-    if (err != ESP_OK)
+    /* 文件已变化，清除进度后重新下载 */
+    if (resume && range_start && ((range_start != progress.offset) || (image_size != progress.size) || strcmp((etag) ? (etag) : (""), progress.etag)))
+    {
+        ESP_LOGW(TAG, "ota image changed, restart from beginning");
+        private_mc665_ota_save_progress(NULL);
+        return MC665_OTA_RESULT_RETRY;
+    }
+
+    if (0 == range_start)
+    {
+        /* 文件类型确定前不保存进度，只有完整固件在检查点保存 */
+        private_mc665_ota_save_progress(NULL);
+        memset(&progress, 0, sizeof(progress));
+        progress.url_hash = obj->url_hash;
+        progress.address = update_partition->address;
+        progress.size = image_size;
+        snprintf(progress.etag, sizeof(progress.etag), "%s", (etag) ? (etag) : (""));
+    }
+    else if (image_size > update_partition->size)
+    {
+        ESP_LOGE(TAG, "ota image is too large (%u)", image_size);
+        return MC665_OTA_RESULT_FAIL;
+    }
+    else
+    {
+        ESP_LOGI(TAG, "resume ota download from %u/%u", range_start, image_size);
+    }
+
+    ESP_LOGI(TAG, "writing ota partition %s at 0x%x", update_partition->label, (unsigned int)update_partition->address);
+
+    /* 检查点所在扇区在上次下载时已擦除 */
+    writer.offset = range_start;
+    writer.erased = (range_start + MC665_OTA_SECTOR_SIZE - 1) & ~(MC665_OTA_SECTOR_SIZE - 1);
+
+    /* 写入flash前检查版本并计算摘要，续传时已写入的部分从flash读回 */
+    chain.verify = malloc(sizeof(mc665_ota_verify_t));
+    if (!chain.verify)
+    {
+        ESP_LOGE(TAG, "No memory to verify ota image");
+        goto __exit;
+    }
+
+    mc665_ota_verify_init(chain.verify, &sink, !obj->ignore_version_check, (obj->use_sha256) ? (obj->sha256) : (NULL));
+    sink.param = chain.verify;
+    sink.write = mc665_ota_verify_write;
+
+    if (!mc665_ota_verify_resume(chain.verify, update_partition, range_start))
     {
-        esp_ota_abort(update_handle);
-        ESP_LOGE(TAG, "esp_ota_begin failed (%s)", esp_err_to_name(err));
         goto __exit;
     }
 
-    ESP_LOGI(TAG, "esp_ota_begin succeeded");
+    /* 续传的只能是完整固件，否则由第一段数据决定后续的处理 */
+    chain.sink = sink;
+    chain.partition = update_partition;
+    chain.image_size = image_size;
+    chain.probed = (0 != range_start);
+    chain_sink.param = &chain;
+    chain_sink.write = private_mc665_ota_chain_write;
 
-    /* 为读取OTA数据分配内存 */
-    data = malloc(MC665_OTA_PACKT_SIZE);
-    if (!data)
-    {  
-        ESP_LOGE(TAG, "No memory to recv http ota data");
+    /* 数据在AT客户端线程中读入缓冲，由写入任务写入flash，两者同时进行 */
+    if (!mc665_ota_pipe_init(&pipe, &chain_sink))
+    {
         goto __exit;
     }
 
-    for (; read_offset < total_len;)
+    start_time = esp_timer_get_time();
+
+    for (received = range_start; received < image_size;)
     {
         /* 计算读取长度 */
-        int read_len = total_len - read_offset;
-        (read_len >= MC665_OTA_PACKT_SIZE) ? (read_len = MC665_OTA_PACKT_SIZE) : (0);
+        int read_len = image_size - received;
+        (read_len >= MC665_OTA_READ_WINDOW) ? (read_len = MC665_OTA_READ_WINDOW) : (0);
 
-        /* 使用http读取文件 */
-        if (mc665_http_read_data(&s_ota_drv.http, read_offset, read_len, data, 5000) == read_len)
+        ret = (mc665_http_read_stream(&obj->http, read_offset, read_len, mc665_ota_pipe_push, &pipe, 30000) == read_len);
+        if (ret)
         {
             read_offset += read_len;
-            err = esp_ota_write(update_handle, (const void *)data, read_len);
+            received += read_len;
+        }
+
+        /* 定期、出错或结束时等待数据全部写入flash，保存已写入的位置 */
+        if (!ret || (received >= image_size) || (received - progress.offset >= MC665_OTA_CHECKPOINT_SIZE))
+        {
+            ret = mc665_ota_pipe_flush(&pipe, 30000) && ret;
 
-            if (err != ESP_OK)
+            /* flush超时时写入任务可能仍在写flash，先等它停止，只保存已确认写入的位置 */
+            if (!ret)
             {
-                esp_ota_abort(update_handle);
-                goto __exit;
+                mc665_ota_pipe_deinit(&pipe);
             }
 
-            received_file_length += read_len;
-            ESP_LOGD(TAG, "Written image length %d", received_file_length);
+            if (chain.probed && (MC665_OTA_IMAGE_FULL == chain.image))
+            {
+                progress.offset = writer.offset;
+                private_mc665_ota_save_progress(&progress);
+            }
         }
-        else
+
+        if (!ret)
         {
-            esp_ota_abort(update_handle);
-            ESP_LOGE(TAG, "Error: http data read error");
+            ESP_LOGE(TAG, "Error: ota data download error at %u", (unsigned int)writer.offset);
+            /* 版本检查未通过时不再重试 */
+            result = (chain.verify->rejected || chain.rejected) ? (MC665_OTA_RESULT_FAIL) : (MC665_OTA_RESULT_RETRY);
             goto __exit;
         }
+
+        ESP_LOGD(TAG, "Received image length %u", (unsigned int)received);
     }
 
-    err = esp_ota_end(update_handle);
+    mc665_ota_pipe_deinit(&pipe);
+    ret = chain.probed &&
+          (!chain.delta || mc665_ota_delta_finish(chain.delta)) &&
+          (!chain.inflate || mc665_ota_inflate_finish(chain.inflate)) &&
+          mc665_ota_verify_finish(chain.verify);
+    private_mc665_ota_chain_free(&chain);
+
+    /* 无论校验结果如何，下一次都需要重新下载 */
+    private_mc665_ota_save_progress(NULL);
+
+    if (!ret)
+    {
+        return MC665_OTA_RESULT_FAIL;
+    }
+
+    elapsed_ms = (esp_timer_get_time() - start_time) / 1000;
+    ESP_LOGI(TAG, "Download %u bytes in %d ms (%d KB/s)", image_size - range_start, (int)elapsed_ms,
+             (elapsed_ms > 0) ? ((int)((int64_t)(image_size - range_start) * 1000 / 1024 / elapsed_ms)) : (0));
+
+    /* 校验写入分区的完整固件，通过后由调用者设置启动分区 */
+    err = esp_image_verify(ESP_IMAGE_VERIFY, &part_pos, &metadata);
     if (err != ESP_OK)
     {
-        if (err == ESP_ERR_OTA_VALIDATE_FAILED)
-        {
-            ESP_LOGE(TAG, "Image validation failed, image is corrupted");
-        }
-        else
+        ESP_LOGE(TAG, "Image validation failed, image is corrupted (%s)", esp_err_to_name(err));
+        return MC665_OTA_RESULT_FAIL;
+    }
+
+    return MC665_OTA_RESULT_OK;
+
+__exit:
+
+    private_mc665_ota_chain_free(&chain);
+
+    return result;
+}
+
+static void private_mc665_ota_task(void *pvParameter)
+{
+    mc665_ota_drv_t *obj = (mc665_ota_drv_t *)pvParameter;
+    esp_err_t err;
+    bool ret = false;
+    mc665_ota_result_def result = MC665_OTA_RESULT_RETRY;
+    const esp_partition_t *update_partition = NULL;
+
+    /* 读取下一个需要升级的分区 */
+    update_partition = esp_ota_get_next_update_partition(NULL);
+    if (NULL == update_partition)
+    {
+        ESP_LOGE(TAG, "esp ota partition read fail");
+        goto __exit;
+    }
+
+    /* 下载中断时从检查点继续 */
+    for (int i = 0; (MC665_OTA_RESULT_RETRY == result) && (i < MC665_OTA_RETRY_NUM); i++)
+    {
+        if (i)
         {
-            ESP_LOGE(TAG, "esp_ota_end failed (%s)!", esp_err_to_name(err));
+            vTaskDelay(pdMS_TO_TICKS(5000));
         }
 
+        result = private_mc665_ota_download(obj, update_partition);
+    }
+
+    if (MC665_OTA_RESULT_OK != result)
+    {
         goto __exit;
     }
-    
+
     err = esp_ota_set_boot_partition(update_partition);
     if (err != ESP_OK)
     {
@@ -253,36 +600,35 @@ static void private_mc665_ota_task(void *pvParameter)
 
 __exit:
 
-    s_ota_drv.status = OTA_STATUS_IDLE;
-    if (s_ota_drv.event_cb.func)
+    /* 摘要只对本次升级有效 */
+    obj->use_sha256 = false;
+    obj->status = OTA_STATUS_IDLE;
+    if (obj->event_cb.func)
     {
-        s_ota_drv.event_cb.func(s_ota_drv.event_cb.param, (ret) ? (OTA_EVT_DOWNLOAD_SUCCESS) : (OTA_EVT_DOWNLOAD_FAIL));
-    }
-
-    if (data)
-    {
-        free(data);
+        obj->event_cb.func(obj->event_cb.param, (ret) ? (OTA_EVT_DOWNLOAD_SUCCESS) : (OTA_EVT_DOWNLOAD_FAIL));
     }
 
     vTaskDelete(NULL);
 }
 
-static bool private_mc665_ota_start(const char *url, bool ignore_version_check)
+static bool private_mc665_ota_start(void *user_data, const char *url, bool ignore_version_check)
 {
     bool ret = false;
+    mc665_ota_drv_t *obj = (mc665_ota_drv_t *)user_data;
 
-    if (OTA_STATUS_IDLE == s_ota_drv.status)
+    if (OTA_STATUS_IDLE == obj->status)
     {
-        ret = mc665_http_set_param(&s_ota_drv.http, MC665_HTTP_PARAM_URL, url);
-        ret = ret && mc665_http_set_param(&s_ota_drv.http, MC665_HTTP_PARAM_USER_AGENT, "fibocom");
-        ret = ret && mc665_http_set_param(&s_ota_drv.http, MC665_HTTP_PARAM_RESPONSEHEADER, "0");
-        ret = ret && mc665_http_set_param(&s_ota_drv.http, MC665_HTTP_PARAM_REDIR, "1");
-        ret = ret && (pdTRUE == xTaskCreate(private_mc665_ota_task, "mc665_ota_task", 1024 * 3, NULL, 5, NULL));
-        (ret) ? (s_ota_drv.status = OTA_STATUS_RUNNING) : (0);
+        ret = mc665_http_set_param(&obj->http, MC665_HTTP_PARAM_URL, url);
+        ret = ret && mc665_http_set_param(&obj->http, MC665_HTTP_PARAM_USER_AGENT, "fibocom");
+        ret = ret && mc665_http_set_param(&obj->http, MC665_HTTP_PARAM_RESPONSEHEADER, "0");
+        ret = ret && mc665_http_set_param(&obj->http, MC665_HTTP_PARAM_REDIR, "1");
+        obj->url_hash = private_mc665_ota_hash(url);
+        obj->ignore_version_check = ignore_version_check;
+        ret = ret && (pdTRUE == xTaskCreate(private_mc665_ota_task, "mc665_ota_task", 1024 * 3, obj, 5, NULL));
+        (ret) ? (obj->status = OTA_STATUS_RUNNING) : (0);
 
         if (ret)
         {
-            s_ota_drv.ignore_version_check = ignore_version_check;
             ESP_LOGI(TAG, "MC665 ota task start");
         }
         else
@@ -298,11 +644,51 @@ static bool private_mc665_ota_start(const char *url, bool ignore_version_check)
     return ret;
 }
 
-static void private_mc665_ota_restart(void)
+static void private_mc665_ota_restart(void *user_data)
 {
     esp_restart();
 }
 
+// 设置下一次升级的固件摘要(64个十六进制字符)，hex为NULL时不校验摘要
+bool mc665_ota_set_sha256(mc665_ota_drv_t *obj, const char *hex)
+{
+    unsigned int value = 0;
+
+    if (OTA_STATUS_RUNNING == obj->status)
+    {
+        ESP_LOGE(TAG, "MC665 ota task is running");
+        return false;
+    }
+
+    obj->use_sha256 = false;
+
+    if (!hex)
+    {
+        return true;
+    }
+
+    if (strlen(hex) != sizeof(obj->sha256) * 2)
+    {
+        ESP_LOGE(TAG, "ota sha256 length invalid");
+        return false;
+    }
+
+    for (int i = 0; i < sizeof(obj->sha256); i++)
+    {
+        if (1 != sscanf(hex + i * 2, "%2x", &value))
+        {
+            ESP_LOGE(TAG, "ota sha256 format invalid");
+            return false;
+        }
+
+        obj->sha256[i] = value;
+    }
+
+    obj->use_sha256 = true;
+
+    return true;
+}
+
 void mc665_ota_drv_get(ota_drv_t *drv)
 {
     if (drv)
@@ -314,9 +700,7 @@ void mc665_ota_drv_get(ota_drv_t *drv)
 
         if (!drv->user_data)
         {
-            ESP_LOGE(TAG, "The user_data is NULL! please pass the mc665_drv_t pointer and retry!");
+            ESP_LOGE(TAG, "The user_data is NULL! please pass the mc665_ota_drv_t pointer and retry!");
         }
-
-        s_ota_drv.drv = drv->user_data;
     }
 }
\ No newline at end of file
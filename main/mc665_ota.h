@@ -1,5 +1,24 @@
 #pragma once
 
+#include "mc665.h"
+#include "mc665_http.h"
 #include "ota_interface.h"
 
-void mc665_ota_drv_get(ota_drv_t *drv);
\ No newline at end of file
+typedef struct
+{
+    /* 忽略软件版本检查 */
+    bool ignore_version_check;
+    /* 当前下载地址的哈希，用于匹配断点续传的进度 */
+    uint32_t url_hash;
+    /* 固件的SHA-256，由升级清单提供，下载时边写入边校验 */
+    bool use_sha256;
+    uint8_t sha256[32];
+    mc665_drv_t *drv;
+    mc665_http_drv_t http;
+    ota_event_cb_t event_cb;
+    ota_status_def status;
+} mc665_ota_drv_t;
+
+void mc665_ota_drv_get(ota_drv_t *drv);
+/* ota_interface不传递摘要，需要校验时由应用在ota_start之前调用，只对下一次升级有效 */
+bool mc665_ota_set_sha256(mc665_ota_drv_t *obj, const char *hex);
\ No newline at end of file
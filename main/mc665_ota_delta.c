@@ -0,0 +1,240 @@
+#include "mc665_ota_delta.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+
+#include <string.h>
+
+static const char *TAG = "mc665_ota_delta";
+
+static uint32_t private_mc665_ota_delta_u32(const uint8_t *data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// 当前块结束，移动旧固件位置并准备读取下一个块
+static bool private_mc665_ota_delta_next_block(mc665_ota_delta_t *obj)
+{
+    int64_t old_pos = (int64_t)obj->old_pos + obj->seek;
+
+    if ((old_pos < 0) || (old_pos > obj->old_size))
+    {
+        ESP_LOGE(TAG, "patch seek out of range");
+        return false;
+    }
+
+    obj->old_pos = (uint32_t)old_pos;
+    obj->head_len = 0;
+    obj->state = (obj->new_pos == obj->new_size) ? (MC665_OTA_DELTA_STATE_DONE) : (MC665_OTA_DELTA_STATE_CTRL);
+
+    return true;
+}
+
+// 计算当前运行分区前old_size字节的CRC32，确认差分包基于当前固件生成
+static bool private_mc665_ota_delta_check_base(mc665_ota_delta_t *obj)
+{
+    uint32_t crc = 0;
+    uint32_t read_len = 0;
+
+    for (uint32_t pos = 0; pos < obj->old_size; pos += read_len)
+    {
+        read_len = obj->old_size - pos;
+        (read_len > sizeof(obj->buf)) ? (read_len = sizeof(obj->buf)) : (0);
+
+        if (ESP_OK != esp_partition_read(obj->old_partition, pos, obj->buf, read_len))
+        {
+            ESP_LOGE(TAG, "old partition read fail");
+            return false;
+        }
+
+        crc = esp_crc32_le(crc, obj->buf, read_len);
+    }
+
+    if (crc != obj->old_crc)
+    {
+        ESP_LOGE(TAG, "patch base mismatch (crc:%08x expect:%08x)", (unsigned int)crc, (unsigned int)obj->old_crc);
+        return false;
+    }
+
+    return true;
+}
+
+static bool private_mc665_ota_delta_parse_header(mc665_ota_delta_t *obj)
+{
+    if (memcmp(obj->head, MC665_OTA_DELTA_MAGIC, sizeof(MC665_OTA_DELTA_MAGIC) - 1))
+    {
+        ESP_LOGE(TAG, "patch magic mismatch");
+        return false;
+    }
+
+    obj->new_size = private_mc665_ota_delta_u32(obj->head + 4);
+    obj->old_size = private_mc665_ota_delta_u32(obj->head + 8);
+    obj->old_crc = private_mc665_ota_delta_u32(obj->head + 12);
+
+    if (!obj->new_size || (obj->old_size > obj->old_partition->size))
+    {
+        ESP_LOGE(TAG, "patch header invalid (new:%u old:%u)", (unsigned int)obj->new_size, (unsigned int)obj->old_size);
+        return false;
+    }
+
+    if (!private_mc665_ota_delta_check_base(obj))
+    {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "apply patch, new image size:%u", (unsigned int)obj->new_size);
+    obj->head_len = 0;
+    obj->state = MC665_OTA_DELTA_STATE_CTRL;
+
+    return true;
+}
+
+static bool private_mc665_ota_delta_parse_ctrl(mc665_ota_delta_t *obj)
+{
+    obj->diff_len = private_mc665_ota_delta_u32(obj->head);
+    obj->extra_len = private_mc665_ota_delta_u32(obj->head + 4);
+    obj->seek = (int32_t)private_mc665_ota_delta_u32(obj->head + 8);
+
+    if (((uint64_t)obj->new_pos + obj->diff_len + obj->extra_len > obj->new_size) ||
+        ((uint64_t)obj->old_pos + obj->diff_len > obj->old_size))
+    {
+        ESP_LOGE(TAG, "patch control block out of range");
+        return false;
+    }
+
+    if (obj->diff_len)
+    {
+        obj->state = MC665_OTA_DELTA_STATE_DIFF;
+    }
+    else if (obj->extra_len)
+    {
+        obj->state = MC665_OTA_DELTA_STATE_EXTRA;
+    }
+    else
+    {
+        return private_mc665_ota_delta_next_block(obj);
+    }
+
+    return true;
+}
+
+bool mc665_ota_delta_is_patch(const void *data, int len)
+{
+    return (len >= sizeof(MC665_OTA_DELTA_MAGIC) - 1) && !memcmp(data, MC665_OTA_DELTA_MAGIC, sizeof(MC665_OTA_DELTA_MAGIC) - 1);
+}
+
+void mc665_ota_delta_init(mc665_ota_delta_t *obj, const esp_partition_t *old_partition, const mc665_ota_sink_t *sink)
+{
+    memset(obj, 0, sizeof(mc665_ota_delta_t));
+    obj->sink = *sink;
+    obj->old_partition = old_partition;
+    obj->state = MC665_OTA_DELTA_STATE_HEADER;
+}
+
+// 作为sink使用，边接收差分包边还原新固件，内存占用固定
+bool mc665_ota_delta_write(void *param, const void *data, int len)
+{
+    int need = 0;
+    int copy_len = 0;
+    const uint8_t *patch = (const uint8_t *)data;
+    mc665_ota_delta_t *obj = (mc665_ota_delta_t *)param;
+
+    while (len > 0)
+    {
+        switch (obj->state)
+        {
+        case MC665_OTA_DELTA_STATE_HEADER:
+        case MC665_OTA_DELTA_STATE_CTRL:
+            need = (MC665_OTA_DELTA_STATE_HEADER == obj->state) ? (MC665_OTA_DELTA_HEADER_LEN) : (MC665_OTA_DELTA_CTRL_LEN);
+            copy_len = need - obj->head_len;
+            (copy_len > len) ? (copy_len = len) : (0);
+            memcpy(obj->head + obj->head_len, patch, copy_len);
+            obj->head_len += copy_len;
+
+            if (obj->head_len == need)
+            {
+                if (MC665_OTA_DELTA_STATE_HEADER == obj->state)
+                {
+                    if (!private_mc665_ota_delta_parse_header(obj))
+                    {
+                        return false;
+                    }
+                }
+                else if (!private_mc665_ota_delta_parse_ctrl(obj))
+                {
+                    return false;
+                }
+            }
+            break;
+        case MC665_OTA_DELTA_STATE_DIFF:
+            copy_len = (obj->diff_len > sizeof(obj->buf)) ? (sizeof(obj->buf)) : (obj->diff_len);
+            (copy_len > len) ? (copy_len = len) : (0);
+
+            if (ESP_OK != esp_partition_read(obj->old_partition, obj->old_pos, obj->buf, copy_len))
+            {
+                ESP_LOGE(TAG, "old partition read fail");
+                return false;
+            }
+
+            for (int i = 0; i < copy_len; i++)
+            {
+                obj->buf[i] += patch[i];
+            }
+
+            if (!obj->sink.write(obj->sink.param, obj->buf, copy_len))
+            {
+                return false;
+            }
+
+            obj->old_pos += copy_len;
+            obj->new_pos += copy_len;
+            obj->diff_len -= copy_len;
+
+            if (0 == obj->diff_len)
+            {
+                obj->state = MC665_OTA_DELTA_STATE_EXTRA;
+
+                if ((0 == obj->extra_len) && !private_mc665_ota_delta_next_block(obj))
+                {
+                    return false;
+                }
+            }
+            break;
+        case MC665_OTA_DELTA_STATE_EXTRA:
+            copy_len = (obj->extra_len > len) ? (len) : (obj->extra_len);
+
+            if (!obj->sink.write(obj->sink.param, patch, copy_len))
+            {
+                return false;
+            }
+
+            obj->new_pos += copy_len;
+            obj->extra_len -= copy_len;
+
+            if ((0 == obj->extra_len) && !private_mc665_ota_delta_next_block(obj))
+            {
+                return false;
+            }
+            break;
+        default:
+            ESP_LOGE(TAG, "unexpected data after patch end");
+            return false;
+        }
+
+        patch += copy_len;
+        len -= copy_len;
+    }
+
+    return true;
+}
+
+// 差分包接收完成后调用，检查新固件是否已完整还原
+bool mc665_ota_delta_finish(mc665_ota_delta_t *obj)
+{
+    if (MC665_OTA_DELTA_STATE_DONE != obj->state)
+    {
+        ESP_LOGE(TAG, "patch incomplete (%u/%u)", (unsigned int)obj->new_pos, (unsigned int)obj->new_size);
+        return false;
+    }
+
+    return true;
+}
\ No newline at end of file
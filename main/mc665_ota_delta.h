@@ -0,0 +1,56 @@
+#pragma once
+
+#include "mc665_ota_pipe.h"
+#include "esp_partition.h"
+
+/*
+ * 差分升级包格式（bsdiff风格，所有整数为小端）
+ *
+ * 头部(16字节): "MDP1" | new_size(u32) | old_size(u32) | old_crc(u32)
+ * old_crc为生成差分包时所用旧固件前old_size字节的CRC32（与zlib的crc32相同），
+ * 写入新固件前与当前运行的分区比较，不一致时拒绝升级
+ * 之后为若干个块，每个块:
+ *   diff_len(u32) | extra_len(u32) | seek(s32)
+ *   diff_len字节:  new[i] = old[old_pos + i] + diff[i]，之后old_pos += diff_len
+ *   extra_len字节: 直接写入新固件
+ *   old_pos += seek
+ * old为当前运行的分区，新固件写满new_size后结束
+ */
+#define MC665_OTA_DELTA_MAGIC "MDP1"
+#define MC665_OTA_DELTA_HEADER_LEN 16
+#define MC665_OTA_DELTA_CTRL_LEN 12
+/* 读取旧固件的缓冲大小 */
+#define MC665_OTA_DELTA_BUF_SIZE 512
+
+typedef enum
+{
+    MC665_OTA_DELTA_STATE_HEADER,
+    MC665_OTA_DELTA_STATE_CTRL,
+    MC665_OTA_DELTA_STATE_DIFF,
+    MC665_OTA_DELTA_STATE_EXTRA,
+    MC665_OTA_DELTA_STATE_DONE
+} mc665_ota_delta_state_def;
+
+typedef struct
+{
+    /* 还原后的新固件写入的sink */
+    mc665_ota_sink_t sink;
+    const esp_partition_t *old_partition;
+    mc665_ota_delta_state_def state;
+    uint8_t head[MC665_OTA_DELTA_HEADER_LEN];
+    int head_len;
+    uint32_t new_size;
+    uint32_t old_size;
+    uint32_t old_crc;
+    uint32_t diff_len;
+    uint32_t extra_len;
+    int32_t seek;
+    uint32_t old_pos;
+    uint32_t new_pos;
+    uint8_t buf[MC665_OTA_DELTA_BUF_SIZE];
+} mc665_ota_delta_t;
+
+bool mc665_ota_delta_is_patch(const void *data, int len);
+void mc665_ota_delta_init(mc665_ota_delta_t *obj, const esp_partition_t *old_partition, const mc665_ota_sink_t *sink);
+bool mc665_ota_delta_write(void *param, const void *data, int len);
+bool mc665_ota_delta_finish(mc665_ota_delta_t *obj);
\ No newline at end of file
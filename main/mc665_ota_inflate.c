@@ -0,0 +1,122 @@
+#include "mc665_ota_inflate.h"
+#include "esp_log.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+static const char *TAG = "mc665_ota_inflate";
+
+// zlib头: CMF(压缩方式8，窗口不超过32KB) FLG，两字节组成的数为31的倍数
+bool mc665_ota_inflate_is_zlib(const void *data, int len)
+{
+    const uint8_t *head = (const uint8_t *)data;
+
+    return (len >= 2) && (0x08 == (head[0] & 0x0F)) && ((head[0] >> 4) <= 7) && (0 == ((head[0] << 8) | head[1]) % 31);
+}
+
+// CINFO为窗口大小的log2减8，窗口大于解压缓冲时回溯距离会越过环形缓冲
+static bool private_mc665_ota_inflate_check_window(uint8_t cmf)
+{
+    if ((cmf >> 4) + 8 > MC665_OTA_INFLATE_WINDOW_BITS)
+    {
+        ESP_LOGE(TAG, "zlib window %d bytes exceeds %d, recompress with wbits=%d", 1 << ((cmf >> 4) + 8),
+                 MC665_OTA_INFLATE_DICT_SIZE, MC665_OTA_INFLATE_WINDOW_BITS);
+        return false;
+    }
+
+    return true;
+}
+
+bool mc665_ota_inflate_init(mc665_ota_inflate_t *obj, const mc665_ota_sink_t *sink)
+{
+    memset(obj, 0, sizeof(mc665_ota_inflate_t));
+    obj->sink = *sink;
+    tinfl_init(&obj->inflator);
+
+    obj->dict = malloc(MC665_OTA_INFLATE_DICT_SIZE);
+    if (!obj->dict)
+    {
+        ESP_LOGE(TAG, "No memory for inflate dictionary");
+        return false;
+    }
+
+    return true;
+}
+
+// 作为sink使用，解压后的数据在环形窗口中，每次解压后立即交给下一级sink
+bool mc665_ota_inflate_write(void *param, const void *data, int len)
+{
+    size_t in_bytes = 0;
+    size_t out_bytes = 0;
+    tinfl_status status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    const uint8_t *in = (const uint8_t *)data;
+    mc665_ota_inflate_t *obj = (mc665_ota_inflate_t *)param;
+
+    if ((0 == obj->in_total) && (len > 0) && !private_mc665_ota_inflate_check_window(in[0]))
+    {
+        return false;
+    }
+
+    while (!obj->done)
+    {
+        in_bytes = len;
+        out_bytes = MC665_OTA_INFLATE_DICT_SIZE - obj->dict_ofs;
+        status = tinfl_decompress(&obj->inflator, in, &in_bytes, obj->dict, obj->dict + obj->dict_ofs, &out_bytes,
+                                  TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT | TINFL_FLAG_COMPUTE_ADLER32);
+        in += in_bytes;
+        len -= in_bytes;
+        obj->in_total += in_bytes;
+
+        if (out_bytes)
+        {
+            if (!obj->sink.write(obj->sink.param, obj->dict + obj->dict_ofs, out_bytes))
+            {
+                return false;
+            }
+
+            obj->out_total += out_bytes;
+            obj->dict_ofs = (obj->dict_ofs + out_bytes) & (MC665_OTA_INFLATE_DICT_SIZE - 1);
+        }
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            ESP_LOGE(TAG, "inflate failed (%d) at %u", status, (unsigned int)obj->in_total);
+            return false;
+        }
+
+        (TINFL_STATUS_DONE == status) ? (obj->done = true) : (0);
+
+        /* 输入已用完且窗口中没有待输出的数据 */
+        if ((TINFL_STATUS_NEEDS_MORE_INPUT == status) && (0 == len))
+        {
+            break;
+        }
+    }
+
+    if (obj->done && (len > 0))
+    {
+        ESP_LOGW(TAG, "ignore %d bytes after compressed stream", len);
+    }
+
+    return true;
+}
+
+// 数据接收完成后调用，检查压缩流是否完整
+bool mc665_ota_inflate_finish(mc665_ota_inflate_t *obj)
+{
+    if (!obj->done)
+    {
+        ESP_LOGE(TAG, "compressed image incomplete (%u bytes inflated)", (unsigned int)obj->out_total);
+        return false;
+    }
+
+    ESP_LOGI(TAG, "inflate %u -> %u bytes", (unsigned int)obj->in_total, (unsigned int)obj->out_total);
+
+    return true;
+}
+
+void mc665_ota_inflate_deinit(mc665_ota_inflate_t *obj)
+{
+    free(obj->dict);
+    obj->dict = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mc665_ota_pipe.h"
+#include "rom/miniz.h"
+
+/*
+ * zlib压缩的固件（RFC1950），使用ROM中的miniz边接收边解压
+ * 解压窗口为固定大小的环形缓冲，压缩时的窗口不能超过该大小，
+ * 如python: zlib.compressobj(9, zlib.DEFLATED, MC665_OTA_INFLATE_WINDOW_BITS)
+ * 头部CINFO对应的窗口超出时拒绝解压
+ */
+#define MC665_OTA_INFLATE_WINDOW_BITS 12
+#define MC665_OTA_INFLATE_DICT_SIZE (1 << MC665_OTA_INFLATE_WINDOW_BITS)
+
+typedef struct
+{
+    /* 解压后的数据写入的sink */
+    mc665_ota_sink_t sink;
+    tinfl_decompressor inflator;
+    uint8_t *dict;
+    size_t dict_ofs;
+    bool done;
+    uint32_t in_total;
+    uint32_t out_total;
+} mc665_ota_inflate_t;
+
+bool mc665_ota_inflate_is_zlib(const void *data, int len);
+bool mc665_ota_inflate_init(mc665_ota_inflate_t *obj, const mc665_ota_sink_t *sink);
+bool mc665_ota_inflate_write(void *param, const void *data, int len);
+bool mc665_ota_inflate_finish(mc665_ota_inflate_t *obj);
+void mc665_ota_inflate_deinit(mc665_ota_inflate_t *obj);
\ No newline at end of file
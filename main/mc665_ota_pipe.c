@@ -0,0 +1,199 @@
+#include "mc665_ota_pipe.h"
+#include "esp_log.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define PIPE_FLUSH_BIT BIT0
+#define PIPE_EXIT_BIT BIT1
+
+/* AT客户端线程等待空闲缓冲的超时时间(ms)，超时后终止本次读取 */
+#define MC665_OTA_PIPE_TIMEOUT 500
+
+static const char *TAG = "mc665_ota_pipe";
+
+// 写入任务，将缓冲中的数据交给sink后归还缓冲，收到NULL代表一次flush，stop置位后收到NULL时退出
+static void private_mc665_ota_pipe_task(void *pvParameter)
+{
+    mc665_ota_buf_t *buf = NULL;
+    mc665_ota_pipe_t *obj = (mc665_ota_pipe_t *)pvParameter;
+
+    while (1)
+    {
+        if (pdTRUE != xQueueReceive(obj->full_queue, &buf, portMAX_DELAY))
+        {
+            continue;
+        }
+
+        if (!buf)
+        {
+            if (obj->stop)
+            {
+                break;
+            }
+
+            xEventGroupSetBits(obj->event, PIPE_FLUSH_BIT);
+            continue;
+        }
+
+        /* 出错或停止后继续归还缓冲，避免读取端阻塞 */
+        if (!obj->error && !obj->stop && !obj->sink.write(obj->sink.param, buf->buf, buf->len))
+        {
+            obj->error = true;
+            ESP_LOGE(TAG, "ota sink write failed!");
+        }
+
+        buf->len = 0;
+        xQueueSend(obj->free_queue, &buf, portMAX_DELAY);
+    }
+
+    /* 置位后不再访问obj，由deinit释放资源 */
+    xEventGroupSetBits(obj->event, PIPE_EXIT_BIT);
+    vTaskDelete(NULL);
+}
+
+bool mc665_ota_pipe_init(mc665_ota_pipe_t *obj, const mc665_ota_sink_t *sink)
+{
+    bool ret = false;
+    mc665_ota_buf_t *buf = NULL;
+
+    memset(obj, 0, sizeof(mc665_ota_pipe_t));
+    obj->sink = *sink;
+
+    obj->free_queue = xQueueCreate(MC665_OTA_PIPE_BUF_NUM, sizeof(mc665_ota_buf_t *));
+    obj->full_queue = xQueueCreate(MC665_OTA_PIPE_BUF_NUM + 1, sizeof(mc665_ota_buf_t *));
+    obj->event = xEventGroupCreate();
+    if (!obj->free_queue || !obj->full_queue || !obj->event)
+    {
+        ESP_LOGE(TAG, "Create ota pipe queue failed! memory not enough");
+        goto __exit;
+    }
+
+    for (int i = 0; i < MC665_OTA_PIPE_BUF_NUM; i++)
+    {
+        buf = &obj->pool[i];
+        buf->buf = malloc(MC665_OTA_PIPE_BUF_SIZE);
+        if (!buf->buf)
+        {
+            ESP_LOGE(TAG, "No memory for ota pipe buffer");
+            goto __exit;
+        }
+
+        xQueueSend(obj->free_queue, &buf, 0);
+    }
+
+    xTaskCreate(private_mc665_ota_pipe_task, "mc665_ota_write", 1024 * 4, obj, 5, &obj->task);
+    if (!obj->task)
+    {
+        ESP_LOGE(TAG, "mc665_ota_write task create failed! memory not enough");
+        goto __exit;
+    }
+
+    ret = true;
+
+__exit:
+
+    if (!ret)
+    {
+        mc665_ota_pipe_deinit(obj);
+    }
+
+    return ret;
+}
+
+// 作为http的sink使用，在AT客户端线程中把数据复制到空闲缓冲，缓冲写满后交给写入任务
+// 此时持有http锁，写入任务跟不上时只短暂等待，返回false终止本次读取，由调用者从检查点重试
+bool mc665_ota_pipe_push(void *param, const void *data, int len)
+{
+    int copy_len = 0;
+    mc665_ota_pipe_t *obj = (mc665_ota_pipe_t *)param;
+
+    while ((len > 0) && !obj->error)
+    {
+        if (!obj->cur && (pdTRUE != xQueueReceive(obj->free_queue, &obj->cur, pdMS_TO_TICKS(MC665_OTA_PIPE_TIMEOUT))))
+        {
+            obj->cur = NULL;
+            ESP_LOGE(TAG, "wait for free ota buffer timeout, abort transfer");
+            return false;
+        }
+
+        copy_len = MC665_OTA_PIPE_BUF_SIZE - obj->cur->len;
+        (copy_len > len) ? (copy_len = len) : (0);
+        memcpy(obj->cur->buf + obj->cur->len, data, copy_len);
+        obj->cur->len += copy_len;
+        data = (const uint8_t *)data + copy_len;
+        len -= copy_len;
+
+        if (MC665_OTA_PIPE_BUF_SIZE == obj->cur->len)
+        {
+            /* 队列长度大于缓冲数量，不会阻塞 */
+            xQueueSend(obj->full_queue, &obj->cur, 0);
+            obj->cur = NULL;
+        }
+    }
+
+    return !obj->error;
+}
+
+// 提交未写满的缓冲并等待全部数据写入sink
+bool mc665_ota_pipe_flush(mc665_ota_pipe_t *obj, uint32_t timeout)
+{
+    mc665_ota_buf_t *buf = NULL;
+
+    if (obj->cur)
+    {
+        xQueueSend((obj->cur->len) ? (obj->full_queue) : (obj->free_queue), &obj->cur, portMAX_DELAY);
+        obj->cur = NULL;
+    }
+
+    xEventGroupClearBits(obj->event, PIPE_FLUSH_BIT);
+    xQueueSend(obj->full_queue, &buf, portMAX_DELAY);
+
+    if (!(PIPE_FLUSH_BIT & xEventGroupWaitBits(obj->event, PIPE_FLUSH_BIT, pdTRUE, pdFALSE, timeout)))
+    {
+        ESP_LOGE(TAG, "ota pipe flush timeout");
+        return false;
+    }
+
+    return !obj->error;
+}
+
+// 通知写入任务退出并等待其确认，之后sink不会再被调用，未写入的数据被丢弃
+void mc665_ota_pipe_deinit(mc665_ota_pipe_t *obj)
+{
+    mc665_ota_buf_t *buf = NULL;
+
+    if (obj->task)
+    {
+        obj->stop = true;
+        xQueueSend(obj->full_queue, &buf, portMAX_DELAY);
+
+        /* 写入任务可能正在写flash，必须等它结束后才能释放缓冲 */
+        xEventGroupWaitBits(obj->event, PIPE_EXIT_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+        obj->task = NULL;
+    }
+
+    for (int i = 0; i < MC665_OTA_PIPE_BUF_NUM; i++)
+    {
+        free(obj->pool[i].buf);
+        obj->pool[i].buf = NULL;
+    }
+
+    if (obj->free_queue)
+    {
+        vQueueDelete(obj->free_queue);
+        obj->free_queue = NULL;
+    }
+
+    if (obj->full_queue)
+    {
+        vQueueDelete(obj->full_queue);
+        obj->full_queue = NULL;
+    }
+
+    if (obj->event)
+    {
+        vEventGroupDelete(obj->event);
+        obj->event = NULL;
+    }
+}
\ No newline at end of file
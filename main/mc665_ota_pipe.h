@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+
+/* 缓冲数量及大小，读取和写入可以同时进行 */
+#define MC665_OTA_PIPE_BUF_NUM 3
+#define MC665_OTA_PIPE_BUF_SIZE 4096
+
+/* 数据的最终去向（如OTA分区），返回false代表写入失败 */
+typedef struct
+{
+    void *param;
+    bool (*write)(void *param, const void *data, int len);
+} mc665_ota_sink_t;
+
+typedef struct
+{
+    uint8_t *buf;
+    int len;
+} mc665_ota_buf_t;
+
+typedef struct
+{
+    mc665_ota_sink_t sink;
+    /* 空闲缓冲和待写入缓冲 */
+    QueueHandle_t free_queue;
+    QueueHandle_t full_queue;
+    EventGroupHandle_t event;
+    TaskHandle_t task;
+    /* 正在填充的缓冲 */
+    mc665_ota_buf_t *cur;
+    volatile bool error;
+    /* 通知写入任务退出 */
+    volatile bool stop;
+    mc665_ota_buf_t pool[MC665_OTA_PIPE_BUF_NUM];
+} mc665_ota_pipe_t;
+
+bool mc665_ota_pipe_init(mc665_ota_pipe_t *obj, const mc665_ota_sink_t *sink);
+bool mc665_ota_pipe_push(void *param, const void *data, int len);
+bool mc665_ota_pipe_flush(mc665_ota_pipe_t *obj, uint32_t timeout);
+void mc665_ota_pipe_deinit(mc665_ota_pipe_t *obj);
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "mc665_ota_verify.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+
+#include <string.h>
+
+static const char *TAG = "mc665_ota_verify";
+
+// 固件头部接收完整后检查版本是否和当前运行的一致
+static bool private_mc665_ota_verify_header(mc665_ota_verify_t *obj)
+{
+    esp_app_desc_t new_app_info = {0};
+    esp_app_desc_t running_app_info = {0};
+
+    memcpy(&new_app_info, obj->head + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
+    ESP_LOGI(TAG, "New firmware version: %s", new_app_info.version);
+
+    if (esp_ota_get_partition_description(esp_ota_get_running_partition(), &running_app_info) == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Current running firmware version: %s", running_app_info.version);
+    }
+
+    if (memcmp(new_app_info.version, running_app_info.version, sizeof(new_app_info.version)) == 0)
+    {
+        if (obj->check_version)
+        {
+            ESP_LOGW(TAG, "Current running version is the same as a new. We will not continue the update.");
+            obj->rejected = true;
+            return false;
+        }
+
+        ESP_LOGW(TAG, "ignore app version check");
+    }
+
+    return true;
+}
+
+// 更新摘要，并从数据中截取固件头部
+static bool private_mc665_ota_verify_update(mc665_ota_verify_t *obj, const void *data, int len)
+{
+    int copy_len = 0;
+
+    if (obj->offset < sizeof(obj->head))
+    {
+        copy_len = sizeof(obj->head) - obj->offset;
+        (copy_len > len) ? (copy_len = len) : (0);
+        memcpy(obj->head + obj->offset, data, copy_len);
+
+        if ((obj->offset + copy_len == sizeof(obj->head)) && !private_mc665_ota_verify_header(obj))
+        {
+            return false;
+        }
+    }
+
+    if (obj->use_digest)
+    {
+        mbedtls_sha256_update(&obj->sha, data, len);
+    }
+
+    obj->offset += len;
+
+    return true;
+}
+
+// digest为NULL时只检查版本
+void mc665_ota_verify_init(mc665_ota_verify_t *obj, const mc665_ota_sink_t *sink, bool check_version, const uint8_t *digest)
+{
+    memset(obj, 0, sizeof(mc665_ota_verify_t));
+    obj->sink = *sink;
+    obj->check_version = check_version;
+
+    if (digest)
+    {
+        obj->use_digest = true;
+        memcpy(obj->digest, digest, sizeof(obj->digest));
+        mbedtls_sha256_init(&obj->sha);
+        mbedtls_sha256_starts(&obj->sha, 0);
+    }
+}
+
+// 断点续传时，已写入flash的部分从分区中读回参与校验
+bool mc665_ota_verify_resume(mc665_ota_verify_t *obj, const esp_partition_t *partition, uint32_t length)
+{
+    int read_len = 0;
+
+    (!obj->use_digest && (length > sizeof(obj->head))) ? (length = sizeof(obj->head)) : (0);
+
+    while (obj->offset < length)
+    {
+        read_len = length - obj->offset;
+        (read_len > sizeof(obj->buf)) ? (read_len = sizeof(obj->buf)) : (0);
+
+        if (ESP_OK != esp_partition_read(partition, obj->offset, obj->buf, read_len))
+        {
+            ESP_LOGE(TAG, "ota partition read fail");
+            return false;
+        }
+
+        if (!private_mc665_ota_verify_update(obj, obj->buf, read_len))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// 作为sink使用，校验通过的数据交给下一级sink
+bool mc665_ota_verify_write(void *param, const void *data, int len)
+{
+    mc665_ota_verify_t *obj = (mc665_ota_verify_t *)param;
+
+    return private_mc665_ota_verify_update(obj, data, len) && obj->sink.write(obj->sink.param, data, len);
+}
+
+// 固件写入完成后调用，在esp_image_verify之前比较摘要
+bool mc665_ota_verify_finish(mc665_ota_verify_t *obj)
+{
+    uint8_t digest[MC665_OTA_VERIFY_DIGEST_LEN] = {0};
+
+    if (obj->offset < sizeof(obj->head))
+    {
+        ESP_LOGE(TAG, "ota image too short (%u)", (unsigned int)obj->offset);
+        return false;
+    }
+
+    if (obj->use_digest)
+    {
+        mbedtls_sha256_finish(&obj->sha, digest);
+
+        if (memcmp(digest, obj->digest, sizeof(digest)))
+        {
+            ESP_LOGE(TAG, "ota image sha256 mismatch");
+            return false;
+        }
+
+        ESP_LOGI(TAG, "ota image sha256 verified");
+    }
+
+    return true;
+}
+
+void mc665_ota_verify_deinit(mc665_ota_verify_t *obj)
+{
+    if (obj->use_digest)
+    {
+        mbedtls_sha256_free(&obj->sha);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "mc665_ota_pipe.h"
+#include "esp_partition.h"
+#include "esp_app_format.h"
+#include "mbedtls/sha256.h"
+
+/* 固件开头包含app描述的部分，第一次收到时检查版本 */
+#define MC665_OTA_VERIFY_HEADER_SIZE (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+#define MC665_OTA_VERIFY_DIGEST_LEN 32
+/* 断点续传时读取已写入数据的缓冲大小 */
+#define MC665_OTA_VERIFY_BUF_SIZE 512
+
+typedef struct
+{
+    /* 校验后的数据写入的sink */
+    mc665_ota_sink_t sink;
+    bool check_version;
+    /* 版本相同被拒绝，不需要重试 */
+    bool rejected;
+    uint8_t head[MC665_OTA_VERIFY_HEADER_SIZE];
+    uint32_t offset;
+    bool use_digest;
+    uint8_t digest[MC665_OTA_VERIFY_DIGEST_LEN];
+    mbedtls_sha256_context sha;
+    uint8_t buf[MC665_OTA_VERIFY_BUF_SIZE];
+} mc665_ota_verify_t;
+
+void mc665_ota_verify_init(mc665_ota_verify_t *obj, const mc665_ota_sink_t *sink, bool check_version, const uint8_t *digest);
+bool mc665_ota_verify_resume(mc665_ota_verify_t *obj, const esp_partition_t *partition, uint32_t length);
+bool mc665_ota_verify_write(void *param, const void *data, int len);
+bool mc665_ota_verify_finish(mc665_ota_verify_t *obj);
+void mc665_ota_verify_deinit(mc665_ota_verify_t *obj);
\ No newline at end of file
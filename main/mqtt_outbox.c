@@ -0,0 +1,452 @@
+#include "mqtt_outbox.h"
+#include "esp_log.h"
+#include "esp_crc.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define OUTBOX_ALIGN(x) (((x) + 3) & ~3)
+#define OUTBOX_ADDR(sector, offset) ((sector) * MQTT_OUTBOX_SECTOR_SIZE + (offset))
+
+static const char *TAG = "mqtt_outbox";
+
+static uint32_t private_mqtt_outbox_record_size(const mqtt_outbox_record_t *record)
+{
+    return OUTBOX_ALIGN(sizeof(mqtt_outbox_record_t) + record->topic_len + record->data_len);
+}
+
+static bool private_mqtt_outbox_sector_valid(mqtt_outbox_t *obj, int sector, uint32_t *seq)
+{
+    mqtt_outbox_sector_t head = {0};
+
+    if ((ESP_OK != esp_partition_read(obj->partition, OUTBOX_ADDR(sector, 0), &head, sizeof(head))) || (MQTT_OUTBOX_MAGIC != head.magic))
+    {
+        return false;
+    }
+
+    (seq) ? (*seq = head.seq) : (0);
+
+    return true;
+}
+
+// 读取记录头，返回1为有效记录，0为扇区中没有更多记录，-1为记录损坏
+static int private_mqtt_outbox_read_record(mqtt_outbox_t *obj, int sector, uint32_t offset, mqtt_outbox_record_t *record)
+{
+    if (offset + sizeof(mqtt_outbox_record_t) > MQTT_OUTBOX_SECTOR_SIZE)
+    {
+        return 0;
+    }
+
+    if (ESP_OK != esp_partition_read(obj->partition, OUTBOX_ADDR(sector, offset), record, sizeof(mqtt_outbox_record_t)))
+    {
+        return -1;
+    }
+
+    if (MQTT_OUTBOX_STATE_EMPTY == record->state)
+    {
+        return 0;
+    }
+
+    if (((MQTT_OUTBOX_STATE_VALID != record->state) && (MQTT_OUTBOX_STATE_SENT != record->state)) ||
+        (offset + private_mqtt_outbox_record_size(record) > MQTT_OUTBOX_SECTOR_SIZE))
+    {
+        return -1;
+    }
+
+    return 1;
+}
+
+// 把读取位置移动到下一条未发送的记录，调用前需持有互斥锁
+static void private_mqtt_outbox_seek_tail(mqtt_outbox_t *obj)
+{
+    mqtt_outbox_record_t record = {0};
+
+    while ((obj->tail_sector != obj->head_sector) || (obj->tail_offset < obj->head_offset))
+    {
+        if (1 != private_mqtt_outbox_read_record(obj, obj->tail_sector, obj->tail_offset, &record))
+        {
+            obj->tail_sector = (obj->tail_sector + 1) % obj->sector_num;
+            obj->tail_offset = sizeof(mqtt_outbox_sector_t);
+        }
+        else if (MQTT_OUTBOX_STATE_SENT == record.state)
+        {
+            obj->tail_offset += private_mqtt_outbox_record_size(&record);
+        }
+        else
+        {
+            return;
+        }
+    }
+}
+
+// 统计扇区中offset之后未发送的记录数
+static uint32_t private_mqtt_outbox_count(mqtt_outbox_t *obj, int sector, uint32_t offset, uint32_t *end)
+{
+    int ret = 0;
+    uint32_t count = 0;
+    mqtt_outbox_record_t record = {0};
+
+    while (1 == (ret = private_mqtt_outbox_read_record(obj, sector, offset, &record)))
+    {
+        (MQTT_OUTBOX_STATE_VALID == record.state) ? (count++) : (0);
+        offset += private_mqtt_outbox_record_size(&record);
+    }
+
+    /* 损坏的记录之后不再写入 */
+    (end) ? (*end = (ret < 0) ? (MQTT_OUTBOX_SECTOR_SIZE) : (offset)) : (0);
+
+    return count;
+}
+
+// 擦除下一个扇区作为写入位置，调用前需持有互斥锁
+static bool private_mqtt_outbox_next_sector(mqtt_outbox_t *obj)
+{
+    uint32_t drop = 0;
+    int next = (obj->head_sector + 1) % obj->sector_num;
+    mqtt_outbox_sector_t head = {.magic = MQTT_OUTBOX_MAGIC, .seq = obj->seq + 1};
+
+    /* 追上未发送的记录时丢弃最早的扇区 */
+    if (obj->pending && (next == obj->tail_sector))
+    {
+        drop = private_mqtt_outbox_count(obj, obj->tail_sector, obj->tail_offset, NULL);
+        obj->pending -= drop;
+        obj->drop_num += drop;
+        obj->tail_sector = (next + 1) % obj->sector_num;
+        obj->tail_offset = sizeof(mqtt_outbox_sector_t);
+        ESP_LOGW(TAG, "outbox is full, drop %u messages", (unsigned int)drop);
+    }
+
+    if ((ESP_OK != esp_partition_erase_range(obj->partition, OUTBOX_ADDR(next, 0), MQTT_OUTBOX_SECTOR_SIZE)) ||
+        (ESP_OK != esp_partition_write(obj->partition, OUTBOX_ADDR(next, 0), &head, sizeof(head))))
+    {
+        ESP_LOGE(TAG, "outbox sector %d prepare failed", next);
+        return false;
+    }
+
+    obj->seq = head.seq;
+    obj->head_sector = next;
+    obj->head_offset = sizeof(mqtt_outbox_sector_t);
+
+    if (!obj->pending)
+    {
+        obj->tail_sector = obj->head_sector;
+        obj->tail_offset = obj->head_offset;
+    }
+
+    return true;
+}
+
+// 根据扇区序号找到写入位置和最早的未发送记录
+static bool private_mqtt_outbox_recover(mqtt_outbox_t *obj)
+{
+    int sector = 0;
+    uint32_t seq = 0;
+    uint32_t count = 0;
+    bool found = false;
+
+    for (int i = 0; i < obj->sector_num; i++)
+    {
+        if (private_mqtt_outbox_sector_valid(obj, i, &seq) && (!found || ((int32_t)(seq - obj->seq) > 0)))
+        {
+            found = true;
+            obj->seq = seq;
+            obj->head_sector = i;
+        }
+    }
+
+    if (!found)
+    {
+        obj->seq = 0;
+        obj->head_sector = obj->sector_num - 1;
+        return private_mqtt_outbox_next_sector(obj);
+    }
+
+    private_mqtt_outbox_count(obj, obj->head_sector, sizeof(mqtt_outbox_sector_t), &obj->head_offset);
+
+    /* 从最早的扇区开始统计未发送的记录 */
+    obj->tail_sector = obj->head_sector;
+    obj->tail_offset = obj->head_offset;
+
+    for (int i = 1; i <= obj->sector_num; i++)
+    {
+        sector = (obj->head_sector + i) % obj->sector_num;
+
+        if (private_mqtt_outbox_sector_valid(obj, sector, NULL))
+        {
+            count = private_mqtt_outbox_count(obj, sector, sizeof(mqtt_outbox_sector_t), NULL);
+
+            if (count && !obj->pending)
+            {
+                obj->tail_sector = sector;
+                obj->tail_offset = sizeof(mqtt_outbox_sector_t);
+            }
+
+            obj->pending += count;
+        }
+    }
+
+    private_mqtt_outbox_seek_tail(obj);
+
+    return true;
+}
+
+// 等待消息的送达结果，其他消息的结果被忽略，超时后当作发送失败稍后重发
+static bool private_mqtt_outbox_wait_ack(mqtt_outbox_t *obj, int msg_id)
+{
+    TickType_t elapsed = 0;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(MQTT_OUTBOX_ACK_TIMEOUT);
+
+    while ((elapsed = xTaskGetTickCount() - start) < timeout)
+    {
+        if ((pdTRUE == xSemaphoreTake(obj->ack, timeout - elapsed)) && (msg_id == obj->ack_id))
+        {
+            return obj->ack_ok;
+        }
+    }
+
+    ESP_LOGW(TAG, "outbox message %d not acknowledged", msg_id);
+
+    return false;
+}
+
+// 发送最早的一条记录，没有记录或发送失败时返回false
+static bool private_mqtt_outbox_drain_one(mqtt_outbox_t *obj)
+{
+    bool ret = false;
+    bool sent = false;
+    int msg_id = 0;
+    int sector = 0;
+    uint32_t offset = 0;
+    char *buf = NULL;
+    mqtt_outbox_record_t record = {0};
+
+    if (pdTRUE != xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        return false;
+    }
+
+    sector = obj->tail_sector;
+    offset = obj->tail_offset;
+    ret = obj->pending && (1 == private_mqtt_outbox_read_record(obj, sector, offset, &record));
+    xSemaphoreGive(obj->mutex);
+
+    if (!ret)
+    {
+        return false;
+    }
+
+    buf = malloc(record.topic_len + 1 + record.data_len);
+    if (!buf)
+    {
+        ESP_LOGE(TAG, "No memory to read outbox message");
+        return false;
+    }
+
+    /* topic和data连续存放，topic后补充结束符 */
+    ret = (ESP_OK == esp_partition_read(obj->partition, OUTBOX_ADDR(sector, offset + sizeof(record)), buf, record.topic_len)) &&
+          (ESP_OK == esp_partition_read(obj->partition, OUTBOX_ADDR(sector, offset + sizeof(record) + record.topic_len), buf + record.topic_len + 1, record.data_len));
+    ret = ret && (record.crc == esp_crc16_le(esp_crc16_le(0, (uint8_t *)buf, record.topic_len), (uint8_t *)buf + record.topic_len + 1, record.data_len));
+    buf[record.topic_len] = '\0';
+
+    if (!ret)
+    {
+        ESP_LOGW(TAG, "drop damaged outbox message");
+    }
+    else
+    {
+        /* 不阻塞在模组的应答上，QoS0没有送达确认，模组接受即可 */
+        xSemaphoreTake(obj->ack, 0);
+        msg_id = mqtt_publish_async(obj->mqtt, buf, buf + record.topic_len + 1, record.data_len, record.qos, record.retain);
+        sent = (msg_id >= 0) && (!record.qos || private_mqtt_outbox_wait_ack(obj, msg_id));
+    }
+
+    free(buf);
+
+    if (ret && !sent)
+    {
+        return false;
+    }
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        /* 发送期间扇区可能因写满被丢弃 */
+        if ((sector == obj->tail_sector) && (offset == obj->tail_offset))
+        {
+            record.state = MQTT_OUTBOX_STATE_SENT;
+            esp_partition_write(obj->partition, OUTBOX_ADDR(sector, offset), &record.state, sizeof(record.state));
+            obj->tail_offset += private_mqtt_outbox_record_size(&record);
+            obj->pending--;
+            (sent) ? (obj->drain_num++) : (obj->drop_num++);
+            private_mqtt_outbox_seek_tail(obj);
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    return true;
+}
+
+static void private_mqtt_outbox_task(void *argument)
+{
+    mqtt_outbox_t *obj = (mqtt_outbox_t *)argument;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, (obj->connected && obj->pending) ? (pdMS_TO_TICKS(MQTT_OUTBOX_RETRY_INTERVAL)) : (portMAX_DELAY));
+
+        while (obj->connected && private_mqtt_outbox_drain_one(obj))
+        {
+        }
+    }
+}
+
+bool mqtt_outbox_init(mqtt_outbox_t *obj, mqtt_inface_t *mqtt)
+{
+    bool ret = false;
+
+    obj->mqtt = mqtt;
+    obj->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, MQTT_OUTBOX_PARTITION);
+    if (!obj->partition)
+    {
+        ESP_LOGE(TAG, "outbox partition not found");
+        goto __exit;
+    }
+
+    obj->sector_num = obj->partition->size / MQTT_OUTBOX_SECTOR_SIZE;
+    if (obj->sector_num < 2)
+    {
+        ESP_LOGE(TAG, "outbox partition is too small");
+        goto __exit;
+    }
+
+    obj->mutex = xSemaphoreCreateMutex();
+    if (!obj->mutex)
+    {
+        ESP_LOGE(TAG, "Create mutex object failed! memory not enough");
+        goto __exit;
+    }
+
+    obj->ack = xSemaphoreCreateBinary();
+    if (!obj->ack)
+    {
+        ESP_LOGE(TAG, "Create semaphore object failed! memory not enough");
+        goto __exit;
+    }
+
+    if (!private_mqtt_outbox_recover(obj))
+    {
+        goto __exit;
+    }
+
+    xTaskCreate(private_mqtt_outbox_task, "mqtt_outbox_task", 1024 * 3, obj, 5, &obj->task);
+    if (!obj->task)
+    {
+        ESP_LOGE(TAG, "mqtt_outbox_task create failed! memory not enough");
+        goto __exit;
+    }
+
+    ret = true;
+    ESP_LOGI(TAG, "outbox ready, %u messages pending", (unsigned int)obj->pending);
+
+__exit:
+
+    if (!ret && obj->mutex)
+    {
+        vSemaphoreDelete(obj->mutex);
+        obj->mutex = NULL;
+    }
+
+    if (!ret && obj->ack)
+    {
+        vSemaphoreDelete(obj->ack);
+        obj->ack = NULL;
+    }
+
+    return ret;
+}
+
+// 所有消息先追加到flash中，由发送任务按顺序异步发送，发送超时不会产生重复的记录
+bool mqtt_outbox_publish(mqtt_outbox_t *obj, const char *topic, const char *data, int len, int qos, int retain)
+{
+    bool ret = false;
+    uint16_t crc = 0;
+    int topic_len = strlen(topic);
+    mqtt_outbox_record_t record = {
+        .state = MQTT_OUTBOX_STATE_VALID,
+        .qos = qos,
+        .retain = retain,
+        .topic_len = topic_len,
+        .data_len = len};
+
+    if ((topic_len > 0xFF) || (len > 0xFFFF) ||
+        (private_mqtt_outbox_record_size(&record) > MQTT_OUTBOX_SECTOR_SIZE - sizeof(mqtt_outbox_sector_t)))
+    {
+        ESP_LOGE(TAG, "message is too long for outbox (%d)", len);
+        return false;
+    }
+
+    crc = esp_crc16_le(0, (const uint8_t *)topic, topic_len);
+    record.crc = esp_crc16_le(crc, (const uint8_t *)data, len);
+
+    if (pdTRUE == xSemaphoreTake(obj->mutex, portMAX_DELAY))
+    {
+        ret = (obj->head_offset + private_mqtt_outbox_record_size(&record) <= MQTT_OUTBOX_SECTOR_SIZE) || private_mqtt_outbox_next_sector(obj);
+
+        /* 先写记录头，掉电时未写完的数据由CRC发现 */
+        ret = ret && (ESP_OK == esp_partition_write(obj->partition, OUTBOX_ADDR(obj->head_sector, obj->head_offset), &record, sizeof(record)));
+        ret = ret && (ESP_OK == esp_partition_write(obj->partition, OUTBOX_ADDR(obj->head_sector, obj->head_offset + sizeof(record)), topic, topic_len));
+        ret = ret && (!len || (ESP_OK == esp_partition_write(obj->partition, OUTBOX_ADDR(obj->head_sector, obj->head_offset + sizeof(record) + topic_len), data, len)));
+
+        if (ret)
+        {
+            if (!obj->pending)
+            {
+                obj->tail_sector = obj->head_sector;
+                obj->tail_offset = obj->head_offset;
+            }
+
+            obj->head_offset += private_mqtt_outbox_record_size(&record);
+            obj->pending++;
+            obj->append_num++;
+        }
+        else
+        {
+            /* 写入失败的位置不再使用 */
+            obj->head_offset = MQTT_OUTBOX_SECTOR_SIZE;
+            ESP_LOGE(TAG, "outbox append failed");
+        }
+
+        xSemaphoreGive(obj->mutex);
+    }
+
+    if (ret && obj->connected)
+    {
+        xTaskNotifyGive(obj->task);
+    }
+
+    return ret;
+}
+
+// 由MQTT事件回调调用，连接后开始发送积压的消息
+void mqtt_outbox_set_connected(mqtt_outbox_t *obj, bool connected)
+{
+    obj->connected = connected;
+
+    if (connected && obj->task)
+    {
+        xTaskNotifyGive(obj->task);
+    }
+}
+
+void mqtt_outbox_published(mqtt_outbox_t *obj, int msg_id, bool ok)
+{
+    if (!obj->ack)
+    {
+        return;
+    }
+
+    obj->ack_id = msg_id;
+    obj->ack_ok = ok;
+    xSemaphoreGive(obj->ack);
+}
\ No newline at end of file
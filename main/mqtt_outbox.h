@@ -0,0 +1,79 @@
+#pragma once
+
+#include "mqtt_interface.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/*
+ * 离线时的MQTT消息保存在flash分区中，分区按扇区组成环形日志:
+ *   扇区头: magic(u32) | seq(u32)，seq随每次擦除递增，用于重启后确定扇区顺序
+ *   记录:   mqtt_outbox_record_t | topic | data，按4字节对齐，不跨扇区
+ * 记录只追加，发送后把state清零标记为已发送，扇区在被再次写入时才擦除，
+ * 每个扇区每轮只擦除一次。分区写满时丢弃最早的扇区。
+ */
+#define MQTT_OUTBOX_PARTITION "outbox"
+#define MQTT_OUTBOX_SECTOR_SIZE 4096
+#define MQTT_OUTBOX_MAGIC 0x31424F4D
+/* 连接后发送失败的重试间隔(ms) */
+#define MQTT_OUTBOX_RETRY_INTERVAL 5000
+/* 等待QoS1/2消息送达确认的时间(ms)，应大于驱动的发送超时 */
+#define MQTT_OUTBOX_ACK_TIMEOUT 10000
+
+typedef enum
+{
+    MQTT_OUTBOX_STATE_EMPTY = 0xFF,
+    MQTT_OUTBOX_STATE_VALID = 0xFE,
+    MQTT_OUTBOX_STATE_SENT = 0x00
+} mqtt_outbox_state_def;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+} mqtt_outbox_sector_t;
+
+typedef struct
+{
+    uint8_t state;
+    uint8_t qos;
+    uint8_t retain;
+    uint8_t topic_len;
+    uint16_t data_len;
+    /* topic和data的CRC，用于发现掉电时未写完的记录 */
+    uint16_t crc;
+} mqtt_outbox_record_t;
+
+typedef struct
+{
+    mqtt_inface_t *mqtt;
+    const esp_partition_t *partition;
+    int sector_num;
+    /* 写入位置 */
+    int head_sector;
+    uint32_t head_offset;
+    uint32_t seq;
+    /* 下一条待发送的记录 */
+    int tail_sector;
+    uint32_t tail_offset;
+    /* 待发送的消息数 */
+    uint32_t pending;
+    bool connected;
+    SemaphoreHandle_t mutex;
+    TaskHandle_t task;
+    /* 最近一次MQTT_EVT_PUBLISHED/MQTT_EVT_DELETED的结果 */
+    SemaphoreHandle_t ack;
+    volatile int ack_id;
+    volatile bool ack_ok;
+    /* 统计 */
+    uint32_t append_num;
+    uint32_t drain_num;
+    uint32_t drop_num;
+} mqtt_outbox_t;
+
+bool mqtt_outbox_init(mqtt_outbox_t *obj, mqtt_inface_t *mqtt);
+bool mqtt_outbox_publish(mqtt_outbox_t *obj, const char *topic, const char *data, int len, int qos, int retain);
+void mqtt_outbox_set_connected(mqtt_outbox_t *obj, bool connected);
+/* 由MQTT事件回调在MQTT_EVT_PUBLISHED(ok为true)和MQTT_EVT_DELETED时调用 */
+void mqtt_outbox_published(mqtt_outbox_t *obj, int msg_id, bool ok);
\ No newline at end of file